@@ -48,8 +48,13 @@ enum val_type {
     VAL_INC,
     VAL_TIME,
     VAL_THREAD_CPU_TIME,
+    VAL_HISTOGRAM,
 };
 
+// Bucket n counts durations < 2^n us (and >= 2^(n-1) us). The last bucket also
+// counts all longer durations.
+#define HIST_BUCKETS 16
+
 struct stat_entry {
     char name[32];
     const char *full_name; // including stats_ctx.prefix
@@ -61,6 +66,8 @@ struct stat_entry {
     int64_t time_start_us;
     int64_t cpu_start_ns;
     pthread_t thread;
+    int64_t hist[HIST_BUCKETS];
+    int64_t hist_max;
 };
 
 #define IS_ACTIVE(ctx) \
@@ -203,6 +210,21 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
             e->cpu_start_ns = t;
             break;
         }
+        case VAL_HISTOGRAM: {
+            double t_max = e->hist_max / 1e3;
+            add_stat(out, e, "max", t_max, mp_tprintf(80, "%.3f ms", t_max));
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                if (!e->hist[b])
+                    continue;
+                char *suffix = b == HIST_BUCKETS - 1
+                    ? mp_tprintf(20, ">=%dus", 1 << (b - 1))
+                    : mp_tprintf(20, "<%dus", 1 << b);
+                add_stat(out, e, suffix, e->hist[b], NULL);
+            }
+            memset(e->hist, 0, sizeof(e->hist));
+            e->hist_max = 0;
+            break;
+        }
         default: ;
         }
     }
@@ -319,6 +341,25 @@ void stats_event(struct stats_ctx *ctx, const char *name)
     pthread_mutex_unlock(&ctx->base->lock);
 }
 
+void stats_histogram_us(struct stats_ctx *ctx, const char *name, int64_t us)
+{
+    if (!IS_ACTIVE(ctx))
+        return;
+    pthread_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = find_entry(ctx, name);
+    if (e->type != VAL_HISTOGRAM) {
+        memset(e->hist, 0, sizeof(e->hist));
+        e->hist_max = 0;
+        e->type = VAL_HISTOGRAM;
+    }
+    int b = 0;
+    while (b < HIST_BUCKETS - 1 && us >= (INT64_C(1) << b))
+        b++;
+    e->hist[b] += 1;
+    e->hist_max = MPMAX(e->hist_max, us);
+    pthread_mutex_unlock(&ctx->base->lock);
+}
+
 static void register_thread(struct stats_ctx *ctx, const char *name,
                             enum val_type type)
 {
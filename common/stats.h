@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 struct mpv_global;
 struct mpv_node;
 struct stats_ctx;
@@ -25,6 +27,10 @@ void stats_time_end(struct stats_ctx *ctx, const char *name);
 // Display number of events per poll period.
 void stats_event(struct stats_ctx *ctx, const char *name);
 
+// Add a duration in microseconds to a histogram. Reports the number of
+// durations per power-of-2 bucket, and the maximum, per poll period.
+void stats_histogram_us(struct stats_ctx *ctx, const char *name, int64_t us);
+
 // Report the thread's CPU time. This needs to be called only once per thread.
 // The current thread is assumed to stay valid until the stats_ctx is destroyed
 // or stats_unregister_thread() is called, otherwise UB will occur.
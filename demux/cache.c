@@ -15,13 +15,26 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <libavutil/buffer.h>
+#include <libavutil/sha.h>
+#include <libavutil/mem.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/file.h>
+#endif
+
 #include "cache.h"
 #include "common/msg.h"
 #include "common/av_common.h"
@@ -30,10 +43,14 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "osdep/io.h"
+#include "stream/stream.h"
 
 struct demux_cache_opts {
     char *cache_dir;
     int unlink_files;
+    int persist;
+    int64_t persist_max_bytes;
+    int mmap;
 };
 
 #define OPT_BASE_STRUCT struct demux_cache_opts
@@ -44,25 +61,61 @@ const struct m_sub_options demux_cache_conf = {
         {"cache-unlink-files", OPT_CHOICE(unlink_files,
             {"immediate", 2}, {"whendone", 1}, {"no", 0}),
         },
+        {"cache-persist", OPT_FLAG(persist)},
+        {"cache-persist-max-bytes", OPT_BYTE_SIZE(persist_max_bytes)},
+        {"cache-mmap", OPT_FLAG(mmap)},
         {0}
     },
     .size = sizeof(struct demux_cache_opts),
     .defaults = &(const struct demux_cache_opts){
         .unlink_files = 2,
+        .persist_max_bytes = 4LL * 1024 * 1024 * 1024,
     },
 };
 
+// Size and alignment of the regions mapped with --cache-mmap. A mapping covers
+// two of them, so that packets smaller than MAP_CHUNK always fit into one.
+#define MAP_CHUNK (32 * 1024 * 1024)
+// Number of mappings kept around by the cache (packets keep their own refs).
+#define MAX_MAPS 4
+// Amount of data to hint to the OS ahead of the read position.
+#define MAP_READAHEAD (8 * 1024 * 1024)
+
+struct cache_map {
+    AVBufferRef *ref;       // owns the mapping (NULL if unused)
+    uint64_t offset;        // file offset of ref->data
+    size_t size;
+};
+
 struct demux_cache {
     struct mp_log *log;
+    struct mpv_global *global;
     struct demux_cache_opts *opts;
 
     char *filename;
+    char *index_filename;   // only set if persistent
+    char *url;              // only set if persistent
+    char *dir, *base;       // only set if persistent (see prune_persistent())
     bool need_unlink;
     int fd;
     int64_t file_pos;
     uint64_t file_size;
+    uint64_t initial_size;  // size of the persistent file when it was opened
+    uint64_t max_size;      // persistent file size limit (0 if unlimited)
+    bool full;              // max_size was reached
+
+    struct cache_map maps[MAX_MAPS];
+    int next_map;           // maps[] entry to replace next
+    // Bounds set by demux_cache_set_readahead(), and end of the last hint.
+    uint64_t ra_start, ra_end, ra_pos;
 };
 
+// Header of the persistent index file. The FFmpeg version is included because
+// side data is stored as memory dump (see demux_cache_write()).
+#define INDEX_HEADER "mpv demux cache index v2 lavc=%u\n"
+
+// The packet data is followed by AV_INPUT_BUFFER_PADDING_SIZE zero bytes, so
+// that it can be passed to decoders directly from a mapping.
 struct pkt_header {
     uint32_t data_len;
     uint32_t av_flags;
@@ -74,10 +127,97 @@ struct sd_header {
     uint32_t len;
 };
 
+struct persist_file {
+    char *base;             // path without .dat/.idx suffix
+    int64_t mtime;
+    uint64_t size;
+};
+
+static int cmp_persist_file(const void *a, const void *b)
+{
+    const struct persist_file *fa = a, *fb = b;
+    return fa->mtime < fb->mtime ? -1 : (fa->mtime > fb->mtime ? 1 : 0);
+}
+
+// Whether name is a persistent cache file as created by open_persistent().
+static bool is_persist_name(const char *name)
+{
+    size_t len = strspn(name, "0123456789abcdef");
+    return len == 256 / 8 * 2 && strcmp(name + len, ".dat") == 0;
+}
+
+// Delete the least recently used persistent cache files other than this one,
+// until they use at most budget bytes. Files locked by other player instances
+// are left alone.
+static void prune_persistent(struct demux_cache *cache, uint64_t budget)
+{
+    void *tmp = talloc_new(NULL);
+    struct persist_file *files = NULL;
+    int num_files = 0;
+    uint64_t total = 0;
+
+    DIR *dp = opendir(cache->dir);
+    if (!dp)
+        goto done;
+    struct dirent *ep;
+    while ((ep = readdir(dp))) {
+        if (!is_persist_name(ep->d_name))
+            continue;
+        char *filename = mp_path_join(tmp, cache->dir, ep->d_name);
+        struct stat st;
+        if (stat(filename, &st) || !S_ISREG(st.st_mode))
+            continue;
+        struct persist_file f = {
+            .base = talloc_strndup(tmp, filename, strlen(filename) - 4),
+            .mtime = st.st_mtime,
+            .size = st.st_size,
+        };
+        if (strcmp(f.base, cache->base) != 0) {
+            MP_TARRAY_APPEND(tmp, files, num_files, f);
+            total += f.size;
+        }
+    }
+    closedir(dp);
+
+    qsort(files, num_files, sizeof(files[0]), cmp_persist_file);
+
+    for (int n = 0; n < num_files && total > budget; n++) {
+        char *filename = talloc_asprintf(tmp, "%s.dat", files[n].base);
+        int fd = -1;
+#if HAVE_POSIX
+        fd = open(filename, O_RDWR | O_CLOEXEC);
+        if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB)) {
+            close(fd);
+            continue;
+        }
+#endif
+        // Remove the index first, so that a partially removed entry is never
+        // mistaken for a truncated cache file.
+        unlink(talloc_asprintf(tmp, "%s.idx", files[n].base));
+        if (unlink(filename) == 0) {
+            MP_VERBOSE(cache, "Removed persistent cache file %s.\n", filename);
+            total -= files[n].size;
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static void cache_destroy(void *p)
 {
     struct demux_cache *cache = p;
 
+    for (int n = 0; n < MAX_MAPS; n++)
+        av_buffer_unref(&cache->maps[n].ref);
+
+    // Make room for what was appended to the file.
+    if (cache->max_size)
+        prune_persistent(cache, cache->max_size - MPMIN(cache->file_size,
+                                                        cache->max_size));
+
     if (cache->fd >= 0)
         close(cache->fd);
 
@@ -87,16 +227,110 @@ static void cache_destroy(void *p)
     }
 }
 
+// Try to open the cache file for url, which is kept across player runs. Returns
+// false if this is not possible; then the caller falls back to a temporary file.
+static bool open_persistent(struct demux_cache *cache, const char *cache_dir,
+                            const char *url)
+{
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, (const uint8_t *)url, strlen(url));
+
+    uint8_t hash[256 / 8];
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char hashstr[256 / 8 * 2 + 1];
+    for (int n = 0; n < 256 / 8; n++)
+        snprintf(hashstr + n * 2, sizeof(hashstr) - n * 2, "%02x", hash[n]);
+
+    char *dir = mp_get_user_path(tmp, cache->global, cache_dir);
+    mp_mkdirp(dir);
+
+    char *base = mp_path_join(tmp, dir, hashstr);
+    char *filename = talloc_asprintf(cache, "%s.dat", base);
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        MP_WARN(cache, "Failed to open persistent cache file: %s\n",
+                mp_strerror(errno));
+        goto done;
+    }
+
+#if HAVE_POSIX
+    // Another player instance may be appending to the same file.
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        MP_WARN(cache, "Persistent cache file is in use.\n");
+        close(fd);
+        goto done;
+    }
+#endif
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size == (off_t)-1) {
+        MP_ERR(cache, "Failed to seek in cache file.\n");
+        close(fd);
+        goto done;
+    }
+
+    char *index_filename = talloc_asprintf(cache, "%s.idx", base);
+    uint64_t budget = cache->opts->persist_max_bytes;
+
+    // The file is append-only, so once it is full, start over.
+    if (budget && size >= budget) {
+        MP_VERBOSE(cache, "Persistent cache file is full, discarding it.\n");
+        unlink(index_filename);
+        if (ftruncate(fd, 0)) {
+            MP_ERR(cache, "Failed to truncate cache file.\n");
+            close(fd);
+            goto done;
+        }
+        size = 0;
+    }
+
+#if HAVE_POSIX
+    // Mark it as recently used for prune_persistent().
+    futimens(fd, NULL);
+#endif
+
+    cache->fd = fd;
+    cache->filename = filename;
+    cache->index_filename = index_filename;
+    cache->dir = talloc_strdup(cache, dir);
+    cache->base = talloc_strdup(cache, base);
+    cache->max_size = budget;
+    if (budget)
+        prune_persistent(cache, budget - size);
+    cache->url = talloc_strdup(cache, url);
+    cache->file_pos = size;
+    cache->file_size = size;
+    cache->initial_size = size;
+    MP_VERBOSE(cache, "Using persistent cache file %s (%"PRIu64" bytes).\n",
+               filename, cache->file_size);
+    ok = true;
+
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
 // Create a cache. This also initializes the cache file from the options. The
-// log parameter must stay valid until demux_cache is destroyed.
+// log parameter must stay valid until demux_cache is destroyed. url is used to
+// locate the cache file if --cache-persist is enabled, and can be NULL.
 // Free with talloc_free().
 struct demux_cache *demux_cache_create(struct mpv_global *global,
-                                       struct mp_log *log)
+                                       struct mp_log *log, const char *url)
 {
     struct demux_cache *cache = talloc_zero(NULL, struct demux_cache);
     talloc_set_destructor(cache, cache_destroy);
     cache->opts = mp_get_config_group(cache, global, &demux_cache_conf);
     cache->log = log;
+    cache->global = global;
     cache->fd = -1;
 
     char *cache_dir = cache->opts->cache_dir;
@@ -105,6 +339,10 @@ struct demux_cache *demux_cache_create(struct mpv_global *global,
         goto fail;
     }
 
+    if (cache->opts->persist && url && url[0] &&
+        open_persistent(cache, cache_dir, url))
+        return cache;
+
     cache->filename = mp_path_join(cache, cache_dir, "mpv-cache-XXXXXX.dat");
     cache->fd = mp_mkostemps(cache->filename, 4, O_CLOEXEC);
     if (cache->fd < 0) {
@@ -131,6 +369,102 @@ uint64_t demux_cache_get_size(struct demux_cache *cache)
     return cache->file_size;
 }
 
+// Whether the cache file outlives the cache (see --cache-persist).
+bool demux_cache_is_persistent(struct demux_cache *cache)
+{
+    return !!cache->index_filename;
+}
+
+// Return the index data previously stored with demux_cache_write_index(). The
+// caller is responsible for interpreting it. Returns an empty bstr if there is
+// none, or if it does not match this cache file.
+struct bstr demux_cache_read_index(struct demux_cache *cache, void *talloc_ctx)
+{
+    if (!cache->index_filename)
+        return (struct bstr){0};
+
+    void *tmp = talloc_new(NULL);
+    struct bstr res = {0};
+
+    if (stat(cache->index_filename, &(struct stat){0}) != 0)
+        goto done;
+
+    struct bstr data = stream_read_file(cache->index_filename, tmp,
+                                        cache->global, 1000000000);
+
+    char *header = talloc_asprintf(tmp, INDEX_HEADER, (unsigned)LIBAVCODEC_VERSION_INT);
+    if (!bstr_eatstart0(&data, header)) {
+        MP_WARN(cache, "Discarding incompatible cache index.\n");
+        goto done;
+    }
+
+    struct bstr url = bstr_getline(data, &data);
+    if (!bstr_equals0(bstr_strip_linebreaks(url), cache->url)) {
+        MP_WARN(cache, "Cache index belongs to another URL.\n");
+        goto done;
+    }
+
+    uint64_t size = 0;
+    if (data.len < sizeof(size))
+        goto done;
+    memcpy(&size, data.start, sizeof(size));
+    data = bstr_cut(data, sizeof(size));
+
+    // The data file must contain everything the index refers to.
+    if (size > cache->initial_size) {
+        MP_WARN(cache, "Cache file is truncated, discarding index.\n");
+        goto done;
+    }
+
+    res = bstrdup(talloc_ctx, data);
+
+done:
+    talloc_free(tmp);
+    return res;
+}
+
+// Store the given data along with the cache file, to be returned by
+// demux_cache_read_index() when the same URL is opened again. All packet
+// positions referenced by the data must have been written already.
+bool demux_cache_write_index(struct demux_cache *cache, struct bstr data)
+{
+    if (!cache->index_filename)
+        return false;
+
+    char *tmpname = talloc_asprintf(NULL, "%s.tmp", cache->index_filename);
+    bool ok = false;
+
+    FILE *out = fopen(tmpname, "wb");
+    if (!out) {
+        MP_ERR(cache, "Failed to write cache index: %s\n", mp_strerror(errno));
+        goto done;
+    }
+
+    uint64_t size = cache->file_size;
+    ok = fprintf(out, INDEX_HEADER, (unsigned)LIBAVCODEC_VERSION_INT) > 0;
+    ok &= fprintf(out, "%s\n", cache->url) > 0;
+    ok &= fwrite(&size, sizeof(size), 1, out) == 1;
+    ok &= fwrite(data.start, data.len, 1, out) == 1 || !data.len;
+    ok &= fclose(out) == 0;
+
+    if (ok) {
+        if (rename(tmpname, cache->index_filename)) {
+            // (Windows refuses to replace existing files.)
+            unlink(cache->index_filename);
+            ok = rename(tmpname, cache->index_filename) == 0;
+        }
+    }
+
+    if (!ok) {
+        MP_ERR(cache, "Failed to write cache index.\n");
+        unlink(tmpname);
+    }
+
+done:
+    talloc_free(tmpname);
+    return ok;
+}
+
 static bool do_seek(struct demux_cache *cache, uint64_t pos)
 {
     if (cache->file_pos == pos)
@@ -206,6 +540,15 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
         return -1;
     }
 
+    if (cache->max_size && cache->file_size >= cache->max_size) {
+        if (!cache->full) {
+            MP_WARN(cache, "Persistent cache file reached "
+                    "--cache-persist-max-bytes, not caching more data.\n");
+        }
+        cache->full = true;
+        return -1;
+    }
+
     assert(!dp->is_cached);
     assert(dp->len >= 0 && dp->len <= INT32_MAX);
     assert(dp->avpacket->flags >= 0 && dp->avpacket->flags <= INT32_MAX);
@@ -229,6 +572,10 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
     if (!write_raw(cache, dp->buffer, dp->len))
         goto fail;
 
+    static const uint8_t padding[AV_INPUT_BUFFER_PADDING_SIZE];
+    if (!write_raw(cache, (void *)padding, sizeof(padding)))
+        goto fail;
+
     // The handling of FFmpeg side data requires an extra long comment to
     // explain why this code is fragile and insane.
     // FFmpeg packet side data is per-packet out of band data, that contains
@@ -276,8 +623,166 @@ fail:
     return -1;
 }
 
+static void free_map(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+// Return a mapping that contains the file range [pos, pos + len), or NULL.
+static struct cache_map *get_map(struct demux_cache *cache, uint64_t pos,
+                                 uint64_t len)
+{
+    for (int n = 0; n < MAX_MAPS; n++) {
+        struct cache_map *m = &cache->maps[n];
+        if (m->ref && pos >= m->offset && pos + len <= m->offset + m->size)
+            return m;
+    }
+
+    uint64_t offset = pos / MAP_CHUNK * MAP_CHUNK;
+    uint64_t end = MPMIN(cache->file_size, offset + 2 * MAP_CHUNK);
+    if (pos + len > end)
+        return NULL;
+
+    size_t size = end - offset;
+    void *ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, cache->fd, offset);
+    if (ptr == MAP_FAILED) {
+        MP_ERR(cache, "Failed to map cache file: %s\n", mp_strerror(errno));
+        return NULL;
+    }
+
+    AVBufferRef *ref = av_buffer_create(ptr, size, free_map,
+                                        (void *)(uintptr_t)size,
+                                        AV_BUFFER_FLAG_READONLY);
+    if (!ref) {
+        munmap(ptr, size);
+        return NULL;
+    }
+
+    struct cache_map *m = &cache->maps[cache->next_map];
+    cache->next_map = (cache->next_map + 1) % MAX_MAPS;
+    av_buffer_unref(&m->ref);
+    *m = (struct cache_map){
+        .ref = ref,
+        .offset = offset,
+        .size = size,
+    };
+    return m;
+}
+
+static bool read_mapped(struct demux_cache *cache, uint64_t *pos, void *ptr,
+                        size_t len)
+{
+    struct cache_map *m = get_map(cache, *pos, len);
+    if (!m)
+        return false;
+    memcpy(ptr, m->ref->data + (*pos - m->offset), len);
+    *pos += len;
+    return true;
+}
+
+// Tell the OS to prefetch the data following pos, as far as it's within the
+// bounds set with demux_cache_set_readahead().
+static void do_readahead(struct demux_cache *cache, struct cache_map *m,
+                         uint64_t pos)
+{
+#if HAVE_POSIX
+    if (pos < cache->ra_start || pos >= cache->ra_end)
+        return;
+
+    // Avoid issuing a hint for every packet.
+    if (pos + MAP_READAHEAD / 2 < cache->ra_pos)
+        return;
+
+    uint64_t start = MPMAX(pos, cache->ra_pos);
+    uint64_t end = MPMIN(cache->ra_end, pos + MAP_READAHEAD);
+    end = MPMIN(end, m->offset + m->size);
+    if (start >= end)
+        return;
+
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t a_start = (start - m->offset) / page * page;
+    posix_madvise(m->ref->data + a_start, end - m->offset - a_start,
+                  POSIX_MADV_WILLNEED);
+    cache->ra_pos = end;
+#endif
+}
+
+// Read a packet by referencing the mapped file data instead of copying it.
+static struct demux_packet *read_packet_mapped(struct demux_cache *cache,
+                                               uint64_t pos)
+{
+    struct pkt_header hd;
+
+    if (!read_mapped(cache, &pos, &hd, sizeof(hd)))
+        return NULL;
+
+    if (hd.data_len > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return NULL;
+
+    struct cache_map *m =
+        get_map(cache, pos, hd.data_len + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!m)
+        return NULL;
+
+    AVPacket avpkt = {
+        .buf = m->ref,
+        .data = m->ref->data + (pos - m->offset),
+        .size = hd.data_len,
+    };
+    struct demux_packet *dp = new_demux_packet_from_avpacket(&avpkt);
+    if (!dp)
+        return NULL;
+
+    do_readahead(cache, m, pos);
+
+    pos += hd.data_len + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    dp->avpacket->flags = hd.av_flags;
+
+    for (uint32_t n = 0; n < hd.num_sd; n++) {
+        struct sd_header sd_hd;
+
+        if (!read_mapped(cache, &pos, &sd_hd, sizeof(sd_hd)))
+            goto fail;
+
+        if (sd_hd.len > INT_MAX)
+            goto fail;
+
+        uint8_t *sd = av_packet_new_side_data(dp->avpacket, sd_hd.av_type,
+                                              sd_hd.len);
+        if (!sd)
+            goto fail;
+
+        if (!read_mapped(cache, &pos, sd, sd_hd.len))
+            goto fail;
+    }
+
+    return dp;
+
+fail:
+    talloc_free(dp);
+    return NULL;
+}
+
+// Hint that the packets in the file range [start, end) are going to be read in
+// order (e.g. when a cached seek range is replayed). Only used with mmap.
+void demux_cache_set_readahead(struct demux_cache *cache, uint64_t start,
+                               uint64_t end)
+{
+    cache->ra_start = start;
+    cache->ra_end = end;
+    cache->ra_pos = start;
+}
+
 struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
 {
+    if (cache->opts->mmap) {
+        struct demux_packet *dp = read_packet_mapped(cache, pos);
+        if (dp)
+            return dp;
+        // Fall back to normal reads, e.g. for packets larger than MAP_CHUNK.
+    }
+
     if (!do_seek(cache, pos))
         return NULL;
 
@@ -293,7 +798,8 @@ struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
     if (!dp)
         goto fail;
 
-    if (!read_raw(cache, dp->buffer, dp->len))
+    // (Reads the padding too, which the packet allocation includes.)
+    if (!read_raw(cache, dp->buffer, dp->len + AV_INPUT_BUFFER_PADDING_SIZE))
         goto fail;
 
     dp->avpacket->flags = hd.av_flags;
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "misc/bstr.h"
+
 struct demux_packet;
 struct mp_log;
 struct mpv_global;
@@ -9,8 +12,14 @@ struct mpv_global;
 struct demux_cache;
 
 struct demux_cache *demux_cache_create(struct mpv_global *global,
-                                       struct mp_log *log);
+                                       struct mp_log *log, const char *url);
 
 int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *pkt);
 struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos);
 uint64_t demux_cache_get_size(struct demux_cache *cache);
+void demux_cache_set_readahead(struct demux_cache *cache, uint64_t start,
+                               uint64_t end);
+
+bool demux_cache_is_persistent(struct demux_cache *cache);
+struct bstr demux_cache_read_index(struct demux_cache *cache, void *talloc_ctx);
+bool demux_cache_write_index(struct demux_cache *cache, struct bstr data);
@@ -30,6 +30,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <zlib.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+
 #include "cache.h"
 #include "config.h"
 #include "options/m_config.h"
@@ -48,6 +53,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "seek_index.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
@@ -87,6 +93,9 @@ static const demuxer_desc_t *const demuxer_list[] = {
 struct demux_opts {
     int enable_cache;
     int disk_cache;
+    int cache_spill;
+    int back_compress;
+    double back_compress_delay;
     int64_t max_bytes;
     int64_t max_bytes_bw;
     int donate_fw;
@@ -114,12 +123,16 @@ const struct m_sub_options demux_conf = {
         {"cache", OPT_CHOICE(enable_cache,
             {"no", 0}, {"auto", -1}, {"yes", 1})},
         {"cache-on-disk", OPT_FLAG(disk_cache)},
+        {"cache-spill", OPT_FLAG(cache_spill)},
         {"demuxer-readahead-secs", OPT_DOUBLE(min_secs), M_RANGE(0, DBL_MAX)},
         {"demuxer-max-bytes", OPT_BYTE_SIZE(max_bytes),
             M_RANGE(0, M_MAX_MEM_BYTES)},
         {"demuxer-max-back-bytes", OPT_BYTE_SIZE(max_bytes_bw),
             M_RANGE(0, M_MAX_MEM_BYTES)},
         {"demuxer-donate-buffer", OPT_FLAG(donate_fw)},
+        {"demuxer-back-compress", OPT_FLAG(back_compress)},
+        {"demuxer-back-compress-delay", OPT_DOUBLE(back_compress_delay),
+            M_RANGE(0, DBL_MAX)},
         {"force-seekable", OPT_FLAG(force_seekable)},
         {"cache-secs", OPT_DOUBLE(min_secs_cache), M_RANGE(0, DBL_MAX),
             .deprecation_message = "will use unlimited time"},
@@ -149,6 +162,7 @@ const struct m_sub_options demux_conf = {
         .max_bytes = 150 * 1024 * 1024,
         .max_bytes_bw = 50 * 1024 * 1024,
         .donate_fw = 1,
+        .back_compress_delay = 10,
         .min_secs = 1.0,
         .min_secs_cache = 1000.0 * 60 * 60,
         .seekable_cache = -1,
@@ -165,6 +179,26 @@ const struct m_sub_options demux_conf = {
     .get_sub_options = get_demux_sub_opts,
 };
 
+// Maximum number of packets prune_old_packets() and free_garbage() remove per
+// call, to bound the time the lock is held.
+#define PRUNE_BUDGET 2000
+#define FREE_BUDGET 2000
+
+// Packets with less data are not compressed by compress_old_packets().
+#define COMPRESS_MIN_SIZE 256
+// Limits on the work done by a compress_old_packets() call.
+#define MAX_COMPRESS_JOBS 64
+#define COMPRESS_BATCH_BYTES (1024 * 1024)
+
+struct compress_job {
+    struct demux_queue *queue;
+    struct demux_packet *dp;    // NULL if the packet was removed meanwhile
+    AVBufferRef *ref;           // reference to the uncompressed data
+    uint8_t *data;
+    size_t len;
+    AVBufferRef *out;           // compressed data, or NULL if not worth it
+};
+
 struct demux_internal {
     struct mp_log *log;
     struct mpv_global *global;
@@ -207,6 +241,7 @@ struct demux_internal {
     int events;
 
     struct demux_cache *cache;
+    bool cache_restore_pending; // persistent cache index not loaded yet
 
     bool warned_queue_overflow;
     bool eof;                   // whether we're in EOF state
@@ -260,6 +295,19 @@ struct demux_internal {
     int num_ranges;
 
     size_t total_bytes;         // total sum of packet data buffered
+    // Part of total_bytes that is not in RAM, because the packet data was moved
+    // to the disk cache by spill_old_packets(), or was compressed.
+    size_t saved_bytes;
+    bool promote_pending;       // promote_packets() has work to do
+
+    // Packets compress_old_packets() is compressing with the lock released.
+    struct compress_job compress_jobs[MAX_COMPRESS_JOBS];
+    int num_compress_jobs;
+
+    // Packets removed by clear_queue(), freed by free_garbage() in batches.
+    struct demux_packet *garbage_head, *garbage_tail;
+    bool prune_pending;         // prune_old_packets() stopped due to its budget
+    bool compress_turn;         // alternate compression with reading
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is normally never NULL. This is always ranges[num_ranges - 1].
     // This is can be NULL during initialization or deinitialization.
@@ -321,22 +369,10 @@ struct demux_cached_range {
     int num_metadata;
 };
 
-#define QUEUE_INDEX_SIZE_MASK(queue) ((queue)->index_size - 1)
-
-// Access the idx-th entry in the given demux_queue.
-// Requirement: idx >= 0 && idx < queue->num_index
-#define QUEUE_INDEX_ENTRY(queue, idx) \
-    ((queue)->index[((queue)->index0 + (idx)) & QUEUE_INDEX_SIZE_MASK(queue)])
-
 // Don't index packets whose timestamps that are within the last index entry by
 // this amount of time (it's better to seek them manually).
 #define INDEX_STEP_SIZE 1.0
 
-struct index_entry {
-    double pts;
-    struct demux_packet *pkt;
-};
-
 // A continuous list of cached packets for a single stream/range. There is one
 // for each stream and range. Also contains some state for use during demuxing
 // (keeping it across seeks makes it easier to resume demuxing).
@@ -364,14 +400,21 @@ struct demux_queue {
     double seek_start, seek_end;
     double last_pruned;     // timestamp of last pruned keyframe
 
+    // Last packet considered by spill_old_packets() and compress_old_packets()
+    // (NULL: start with head).
+    struct demux_packet *spill_last;
+    struct demux_packet *compress_last;
+
     bool is_bof;            // started demuxing at beginning of file
     bool is_eof;            // received true EOF here
 
     // Complete index, though it may skip some entries to reduce density.
-    struct index_entry *index;  // ring buffer
-    size_t index_size;          // size of index[] (0 or a power of 2)
-    size_t index0;              // first index entry
-    size_t num_index;           // number of index entries (wraps on index_size)
+    struct seek_index index;
+    size_t index_bytes;     // memory used by index (included in total_bytes)
+
+    size_t saved_bytes;     // part of demux_internal.saved_bytes
+    // Sum of the compressed and original sizes of compressed packets.
+    uint64_t compressed_bytes, uncompressed_bytes;
 };
 
 struct demux_stream {
@@ -467,6 +510,8 @@ static struct demux_packet *find_seek_target(struct demux_queue *queue,
 static void prune_old_packets(struct demux_internal *in);
 static void dumper_close(struct demux_internal *in);
 static void demux_convert_tags_charset(struct demuxer *demuxer);
+static void save_persistent_cache(struct demux_internal *in);
+static void restore_persistent_cache(struct demux_internal *in);
 
 static uint64_t get_foward_buffered_bytes(struct demux_stream *ds)
 {
@@ -519,13 +564,13 @@ static void check_queue_consistency(struct demux_internal *in)
                 if (!dp->next)
                     assert(queue->tail == dp);
 
-                if (next_index < queue->num_index &&
-                    QUEUE_INDEX_ENTRY(queue, next_index).pkt == dp)
+                if (next_index < queue->index.num &&
+                    seek_index_get(&queue->index, next_index)->pkt == dp)
                     next_index += 1;
             }
             if (!queue->head)
                 assert(!queue->tail);
-            assert(next_index == queue->num_index);
+            assert(next_index == queue->index.num);
 
             uint64_t queue_total_bytes2 = 0;
             if (queue->head)
@@ -551,7 +596,7 @@ static void check_queue_consistency(struct demux_internal *in)
             if (queue->keyframe_latest)
                 assert(queue->keyframe_latest->keyframe);
 
-            total_bytes += queue->index_size * sizeof(struct index_entry);
+            total_bytes += seek_index_get_alloc_size(&queue->index);
         }
 
         // Invariant needed by pruning; violation has worse effects than just
@@ -696,6 +741,60 @@ broken:
     prune_metadata(range);
 }
 
+// Return how much less RAM the packet uses than accounted for in cum_pos. This
+// is non-0 for packets whose data was moved to disk by spill_old_packets(), or
+// compressed by compress_old_packets().
+static uint64_t get_saved_bytes(struct demux_queue *queue,
+                                struct demux_packet *dp)
+{
+    if (!dp->is_cached && !dp->is_compressed)
+        return 0;
+    uint64_t end_pos = dp->next ? dp->next->cum_pos : queue->tail_cum_pos;
+    return end_pos - dp->cum_pos - demux_packet_estimate_total_size(dp);
+}
+
+static void add_saved_bytes(struct demux_queue *queue, int64_t bytes)
+{
+    queue->saved_bytes += bytes;
+    queue->ds->in->saved_bytes += bytes;
+}
+
+static uint32_t get_uncompressed_size(struct demux_packet *dp)
+{
+    uint32_t size;
+    memcpy(&size, dp->buffer, sizeof(size));
+    return size;
+}
+
+// Must be called before dp's data is freed or replaced. Aborts compressing it,
+// and removes it from the compression stats.
+static void release_packet_data(struct demux_queue *queue,
+                                struct demux_packet *dp)
+{
+    struct demux_internal *in = queue->ds->in;
+
+    if (dp->compress_busy) {
+        for (int n = 0; n < in->num_compress_jobs; n++) {
+            if (in->compress_jobs[n].dp == dp)
+                in->compress_jobs[n].dp = NULL;
+        }
+        dp->compress_busy = false;
+    }
+
+    if (dp->is_compressed) {
+        queue->compressed_bytes -= dp->len;
+        queue->uncompressed_bytes -= get_uncompressed_size(dp);
+    }
+}
+
+// Must be called after queue->index was changed.
+static void update_index_bytes(struct demux_queue *queue)
+{
+    size_t size = seek_index_get_alloc_size(&queue->index);
+    queue->ds->in->total_bytes += size - queue->index_bytes;
+    queue->index_bytes = size;
+}
+
 // Remove queue->head from the queue.
 static void remove_head_packet(struct demux_queue *queue)
 {
@@ -710,10 +809,17 @@ static void remove_head_packet(struct demux_queue *queue)
 
     uint64_t end_pos = dp->next ? dp->next->cum_pos : queue->tail_cum_pos;
     queue->ds->in->total_bytes -= end_pos - dp->cum_pos;
+    add_saved_bytes(queue, -(int64_t)get_saved_bytes(queue, dp));
+    release_packet_data(queue, dp);
+    if (queue->spill_last == dp)
+        queue->spill_last = NULL;
+    if (queue->compress_last == dp)
+        queue->compress_last = NULL;
 
-    if (queue->num_index && queue->index[queue->index0].pkt == dp) {
-        queue->index0 = (queue->index0 + 1) & QUEUE_INDEX_SIZE_MASK(queue);
-        queue->num_index -= 1;
+    struct seek_index_entry *e = seek_index_first(&queue->index);
+    if (e && e->pkt == dp) {
+        seek_index_remove_first(&queue->index);
+        update_index_bytes(queue);
     }
 
     queue->head = dp->next;
@@ -725,14 +831,8 @@ static void remove_head_packet(struct demux_queue *queue)
 
 static void free_index(struct demux_queue *queue)
 {
-    struct demux_stream *ds = queue->ds;
-    struct demux_internal *in = ds->in;
-
-    in->total_bytes -= queue->index_size * sizeof(queue->index[0]);
-    queue->index_size = 0;
-    queue->index0 = 0;
-    queue->num_index = 0;
-    TA_FREEP(&queue->index);
+    seek_index_clear(&queue->index);
+    update_index_bytes(queue);
 }
 
 static void clear_queue(struct demux_queue *queue)
@@ -745,14 +845,27 @@ static void clear_queue(struct demux_queue *queue)
 
     free_index(queue);
 
-    struct demux_packet *dp = queue->head;
-    while (dp) {
-        struct demux_packet *dn = dp->next;
-        assert(ds->reader_head != dp);
-        talloc_free(dp);
-        dp = dn;
+    add_saved_bytes(queue, -(int64_t)queue->saved_bytes);
+    queue->compressed_bytes = queue->uncompressed_bytes = 0;
+
+    for (int n = 0; n < in->num_compress_jobs; n++) {
+        if (in->compress_jobs[n].queue == queue)
+            in->compress_jobs[n].dp = NULL;
+    }
+
+    // Freeing a large number of packets can take a while, so defer it.
+    if (queue->head) {
+        assert(!ds->reader_head || ds->queue != queue);
+        if (in->garbage_tail) {
+            in->garbage_tail->next = queue->head;
+        } else {
+            in->garbage_head = queue->head;
+        }
+        in->garbage_tail = queue->tail;
     }
     queue->head = queue->tail = NULL;
+    queue->spill_last = NULL;
+    queue->compress_last = NULL;
     queue->keyframe_first = NULL;
     queue->keyframe_latest = NULL;
     queue->seek_start = queue->seek_end = queue->last_pruned = MP_NOPTS_VALUE;
@@ -766,6 +879,25 @@ static void clear_queue(struct demux_queue *queue)
     queue->is_bof = false;
 }
 
+// Free packets removed by clear_queue(). Frees at most max packets, and returns
+// whether there are more.
+static bool free_garbage(struct demux_internal *in, size_t max)
+{
+    int64_t start = mp_time_us();
+
+    for (size_t n = 0; n < max && in->garbage_head; n++) {
+        struct demux_packet *dp = in->garbage_head;
+        in->garbage_head = dp->next;
+        talloc_free(dp);
+    }
+    if (!in->garbage_head)
+        in->garbage_tail = NULL;
+
+    stats_histogram_us(in->stats, "lock-free", mp_time_us() - start);
+
+    return !!in->garbage_head;
+}
+
 static void clear_cached_range(struct demux_internal *in,
                                struct demux_cached_range *range)
 {
@@ -1097,6 +1229,8 @@ static void demux_shutdown(struct demux_internal *in)
 
     dumper_close(in);
 
+    save_persistent_cache(in);
+
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
     demuxer->priv = NULL;
@@ -1104,6 +1238,7 @@ static void demux_shutdown(struct demux_internal *in)
 
     demux_flush(demuxer);
     assert(in->total_bytes == 0);
+    free_garbage(in, SIZE_MAX);
 
     in->current_range = NULL;
     free_empty_cached_ranges(in);
@@ -1615,41 +1750,14 @@ static void back_demux_see_packets(struct demux_stream *ds)
 static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp,
                             double pts)
 {
-    struct demux_internal *in = queue->ds->in;
-
     assert(dp->keyframe && pts != MP_NOPTS_VALUE);
 
-    if (queue->num_index > 0) {
-        struct index_entry *last = &QUEUE_INDEX_ENTRY(queue, queue->num_index - 1);
-        if (pts - last->pts < INDEX_STEP_SIZE)
-            return;
-    }
-
-    if (queue->num_index == queue->index_size) {
-        // Needs to honor power-of-2 requirement.
-        size_t new_size = MPMAX(128, queue->index_size * 2);
-        assert(!(new_size & (new_size - 1)));
-        MP_DBG(in, "stream %d: resize index to %zu\n", queue->ds->index,
-               new_size);
-        // Note: we could tolerate allocation failure, and just discard the
-        // entire index (and prevent the index from being recreated).
-        MP_RESIZE_ARRAY(NULL, queue->index, new_size);
-        size_t highest_index = queue->index0 + queue->num_index;
-        for (size_t n = queue->index_size; n < highest_index; n++)
-            queue->index[n] = queue->index[n - queue->index_size];
-        in->total_bytes +=
-            (new_size - queue->index_size) * sizeof(queue->index[0]);
-        queue->index_size = new_size;
-    }
-
-    assert(queue->num_index < queue->index_size);
-
-    queue->num_index += 1;
+    struct seek_index_entry *last = seek_index_last(&queue->index);
+    if (last && pts - last->pts < INDEX_STEP_SIZE)
+        return;
 
-    QUEUE_INDEX_ENTRY(queue, queue->num_index - 1) = (struct index_entry){
-        .pts = pts,
-        .pkt = dp,
-    };
+    seek_index_append(&queue->index, pts, dp);
+    update_index_bytes(queue);
 }
 
 // Check whether the next range in the list is, and if it appears to overlap,
@@ -1679,6 +1787,8 @@ static void attempt_range_joining(struct demux_internal *in)
     if (!next)
         return;
 
+    int64_t start = mp_time_us();
+
     MP_VERBOSE(in, "going to join ranges %f-%f + %f-%f\n",
                current->seek_start, current->seek_end,
                next->seek_start, next->seek_end);
@@ -1787,27 +1897,46 @@ static void attempt_range_joining(struct demux_internal *in)
         q1->last_pos_fixup = -1;
 
         q2->head = q2->tail = NULL;
+        q2->spill_last = NULL;
+        q2->compress_last = NULL;
         q2->keyframe_first = NULL;
         q2->keyframe_latest = NULL;
 
+        q1->saved_bytes += q2->saved_bytes;
+        q1->compressed_bytes += q2->compressed_bytes;
+        q1->uncompressed_bytes += q2->uncompressed_bytes;
+        q2->saved_bytes = q2->compressed_bytes = q2->uncompressed_bytes = 0;
+
         if (ds->selected && !ds->reader_head)
             ds->reader_head = join_point;
         ds->skip_to_keyframe = false;
 
-        // Make the cum_pos values in all q2 packets continuous.
-        for (struct demux_packet *dp = join_point; dp; dp = dp->next) {
-            uint64_t next_pos = dp->next ? dp->next->cum_pos : q2->tail_cum_pos;
-            uint64_t size = next_pos - dp->cum_pos;
-            dp->cum_pos = q1->tail_cum_pos;
-            q1->tail_cum_pos += size;
+        if (join_point) {
+            // Make the cum_pos values continuous. Only differences between
+            // cum_pos values matter, so either the q1 or the q2 packets can be
+            // shifted. Shift the shorter list (walking both in lockstep to
+            // find it), so that this does not get slow with long ranges.
+            uint64_t delta = q1->tail_cum_pos - join_point->cum_pos;
+            struct demux_packet *dp1 = q1->head, *dp2 = join_point;
+            while (dp1 != join_point && dp2) {
+                dp1 = dp1->next;
+                dp2 = dp2->next;
+            }
+            if (!dp2) {
+                for (dp2 = join_point; dp2; dp2 = dp2->next)
+                    dp2->cum_pos += delta;
+                q1->tail_cum_pos = q2->tail_cum_pos + delta;
+            } else {
+                for (dp1 = q1->head; dp1 != join_point; dp1 = dp1->next)
+                    dp1->cum_pos -= delta;
+                q1->tail_cum_pos = q2->tail_cum_pos;
+            }
         }
 
         // And update the index with packets from q2.
-        for (size_t i = 0; i < q2->num_index; i++) {
-            struct index_entry *e = &QUEUE_INDEX_ENTRY(q2, i);
-            add_index_entry(q1, e->pkt, e->pts);
-        }
-        free_index(q2);
+        seek_index_move(&q1->index, &q2->index, INDEX_STEP_SIZE);
+        update_index_bytes(q1);
+        update_index_bytes(q2);
 
         // For moving demuxer position.
         ds->refreshing = ds->selected;
@@ -1834,6 +1963,8 @@ static void attempt_range_joining(struct demux_internal *in)
 failed:
     clear_cached_range(in, next);
     free_empty_cached_ranges(in);
+
+    stats_histogram_us(in->stats, "lock-join", mp_time_us() - start);
 }
 
 // Compute the assumed first and last frame timestamp for keyframe range
@@ -2055,7 +2186,7 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 
     record_packet(in, dp);
 
-    if (in->cache && in->opts->disk_cache) {
+    if (in->cache && in->opts->disk_cache && !in->opts->cache_spill) {
         int64_t pos = demux_cache_write(in->cache, dp);
         if (pos >= 0) {
             demux_packet_unref_contents(dp);
@@ -2175,6 +2306,15 @@ static bool read_packet(struct demux_internal *in)
     if (!was_reading || in->blocked || demux_cancel_test(in->d_thread))
         return false;
 
+    // The reader selected its streams, so the restored ranges can be used.
+    if (in->cache_restore_pending) {
+        restore_persistent_cache(in);
+        // Nothing was demuxed yet; serve the start from the cache if possible.
+        if (in->after_seek_to_start && !in->seeking &&
+            queue_seek(in, in->d_thread->start_time, SEEK_CACHED | SEEK_HR, true))
+            return true;
+    }
+
     // Check if we need to read a new packet. We do this if all queues are below
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
@@ -2288,26 +2428,316 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Return by how much the backward cache exceeds its RAM limit.
+static uint64_t get_back_bytes_excess(struct demux_internal *in)
+{
+    uint64_t fw_bytes = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        fw_bytes += get_foward_buffered_bytes(ds);
+    }
+    uint64_t max_avail = in->max_bytes_bw;
+    // Backward cache (if enabled at all) can use unused forward cache.
+    // Still leave 1 byte free, so the read_packet logic doesn't get stuck.
+    if (max_avail && in->max_bytes > (fw_bytes + 1) && in->opts->donate_fw)
+        max_avail += in->max_bytes - (fw_bytes + 1);
+    uint64_t used = in->total_bytes - in->saved_bytes;
+    // (Spilled packets after the reader position are still counted as forward
+    // bytes, so this can "underflow".)
+    if (used <= fw_bytes + max_avail)
+        return 0;
+    return used - fw_bytes - max_avail;
+}
+
+// Return a new packet with the uncompressed contents of dp (which must have
+// been compressed by compress_old_packets()), or NULL on error.
+static struct demux_packet *uncompress_packet(struct demux_packet *dp)
+{
+    uint32_t size = get_uncompressed_size(dp);
+    struct demux_packet *new = new_demux_packet(size);
+    if (!new)
+        return NULL;
+
+    uLongf len = size;
+    if (uncompress(new->buffer, &len, dp->buffer + sizeof(size),
+                   dp->len - sizeof(size)) != Z_OK || len != size ||
+        av_packet_copy_props(new->avpacket, dp->avpacket) < 0)
+    {
+        talloc_free(new);
+        return NULL;
+    }
+
+    demux_packet_copy_attribs(new, dp);
+    return new;
+}
+
+// Run with the demuxer lock released.
+static void run_compress_job(struct compress_job *job, uint8_t **tmp)
+{
+    uint32_t size = job->len;
+    uLong bound = compressBound(job->len) + sizeof(size);
+    MP_TARRAY_GROW(NULL, *tmp, bound);
+
+    uLongf len = bound - sizeof(size);
+    if (compress2(*tmp + sizeof(size), &len, job->data, job->len,
+                  Z_BEST_SPEED) != Z_OK)
+        return;
+    len += sizeof(size);
+
+    // Not worth the trouble if it saves less than 1/8 of the size.
+    if (len > job->len - job->len / 8)
+        return;
+
+    memcpy(*tmp, &size, sizeof(size));
+    job->out = av_buffer_alloc(len);
+    if (job->out)
+        memcpy(job->out->data, *tmp, len);
+}
+
+static void finish_compress_job(struct demux_internal *in,
+                                struct compress_job *job)
+{
+    struct demux_packet *dp = job->dp;
+
+    av_buffer_unref(&job->ref);
+
+    if (dp) {
+        dp->compress_busy = false;
+
+        if (job->out) {
+            uint64_t prev = demux_packet_estimate_total_size(dp);
+
+            AVPacket *avpkt = dp->avpacket;
+            av_buffer_unref(&avpkt->buf);
+            avpkt->buf = job->out;
+            avpkt->data = dp->buffer = job->out->data;
+            avpkt->size = dp->len = job->out->size;
+            dp->is_compressed = true;
+            job->out = NULL;
+
+            add_saved_bytes(job->queue,
+                            prev - demux_packet_estimate_total_size(dp));
+            job->queue->compressed_bytes += dp->len;
+            job->queue->uncompressed_bytes += job->len;
+        }
+    }
+
+    av_buffer_unref(&job->out);
+}
+
+// Compress the data of packets in the backward cache that are older than the
+// reader position by --demuxer-back-compress-delay. The compression is done
+// with the lock released. Does a limited amount of work per call, and returns
+// false if there was nothing to do.
+static bool compress_old_packets(struct demux_internal *in)
+{
+    double delay = in->opts->back_compress_delay;
+    size_t batch = 0;
+
+    assert(!in->num_compress_jobs);
+
+    for (int r = 0; r < in->num_ranges; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+            struct demux_stream *ds = queue->ds;
+
+            while (in->num_compress_jobs < MAX_COMPRESS_JOBS &&
+                   batch < COMPRESS_BATCH_BYTES)
+            {
+                struct demux_packet *dp = queue->compress_last
+                                    ? queue->compress_last->next : queue->head;
+                if (!dp || dp == ds->reader_head)
+                    break;
+
+                if (range == in->current_range) {
+                    double ts = MP_PTS_OR_DEF(dp->dts, dp->pts);
+                    if (ts != MP_NOPTS_VALUE && ds->base_ts != MP_NOPTS_VALUE &&
+                        ts > ds->base_ts - delay)
+                        break;
+                }
+
+                if (!dp->is_cached && !dp->is_compressed &&
+                    dp->len >= COMPRESS_MIN_SIZE && dp->avpacket->buf)
+                {
+                    AVBufferRef *ref = av_buffer_ref(dp->avpacket->buf);
+                    if (!ref)
+                        break;
+                    in->compress_jobs[in->num_compress_jobs++] =
+                        (struct compress_job){
+                            .queue = queue,
+                            .dp = dp,
+                            .ref = ref,
+                            .data = dp->buffer,
+                            .len = dp->len,
+                        };
+                    dp->compress_busy = true;
+                    batch += dp->len;
+                }
+
+                queue->compress_last = dp;
+            }
+        }
+    }
+
+    if (!in->num_compress_jobs)
+        return false;
+
+    pthread_mutex_unlock(&in->lock);
+
+    uint8_t *tmp = NULL;
+    for (int n = 0; n < in->num_compress_jobs; n++)
+        run_compress_job(&in->compress_jobs[n], &tmp);
+    talloc_free(tmp);
+
+    pthread_mutex_lock(&in->lock);
+
+    for (int n = 0; n < in->num_compress_jobs; n++)
+        finish_compress_job(in, &in->compress_jobs[n]);
+    in->num_compress_jobs = 0;
+
+    return true;
+}
+
+// Move the data of packets from the backward cache to the disk cache, until
+// the RAM limit is met. The packet metadata stays in RAM, and is pruned only
+// if even that exceeds the limit. Starts with the least recently used range.
+static void spill_old_packets(struct demux_internal *in)
+{
+    uint64_t excess = get_back_bytes_excess(in);
+
+    for (int r = 0; r < in->num_ranges && excess; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+
+        for (int n = 0; n < range->num_streams && excess; n++) {
+            struct demux_queue *queue = range->streams[n];
+
+            while (excess) {
+                struct demux_packet *dp = queue->spill_last
+                                        ? queue->spill_last->next : queue->head;
+                if (!dp || dp == queue->ds->reader_head)
+                    break;
+
+                if (!dp->is_cached) {
+                    int64_t pos = dp->spill_pos;
+                    if (pos < 0) {
+                        struct demux_packet *src = dp;
+                        if (dp->is_compressed)
+                            src = uncompress_packet(dp);
+                        if (src)
+                            pos = demux_cache_write(in->cache, src);
+                        if (src != dp)
+                            talloc_free(src);
+                    }
+                    if (pos < 0)
+                        return;
+
+                    uint64_t prev = get_saved_bytes(queue, dp);
+                    release_packet_data(queue, dp);
+                    demux_packet_unref_contents(dp);
+                    dp->is_compressed = false;
+                    dp->is_cached = true;
+                    dp->cached_data.pos = pos;
+
+                    uint64_t saved = get_saved_bytes(queue, dp) - prev;
+                    add_saved_bytes(queue, saved);
+                    excess -= MPMIN(excess, saved);
+                }
+
+                queue->spill_last = dp;
+            }
+        }
+    }
+}
+
+// Read packets spilled to disk after the reader position back into RAM, as
+// long as they're within the forward cache limit. Since this is done after a
+// seek into a spilled range, the forward path does not need to wait for disk
+// reads. Does a limited amount of work per call.
+static void promote_packets(struct demux_internal *in)
+{
+    int num_selected = 0;
+    for (int n = 0; n < in->num_streams; n++)
+        num_selected += in->streams[n]->ds->selected;
+
+    uint64_t budget = 4 * 1024 * 1024; // per call
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->selected || !ds->reader_head)
+            continue;
+
+        // Share of the forward cache for this stream.
+        uint64_t max = in->max_bytes / num_selected;
+
+        for (struct demux_packet *dp = ds->reader_head;
+             dp && dp->cum_pos - ds->reader_head->cum_pos < max; dp = dp->next)
+        {
+            if (!dp->is_cached)
+                continue;
+
+            if (!budget)
+                return;
+
+            struct demux_packet *pkt =
+                demux_cache_read(in->cache, dp->cached_data.pos);
+            if (!pkt) {
+                MP_ERR(in, "Failed to retrieve packet from cache.\n");
+                goto done;
+            }
+
+            uint64_t saved = get_saved_bytes(ds->queue, dp);
+            add_saved_bytes(ds->queue, -(int64_t)saved);
+            budget -= MPMIN(budget, saved);
+
+            int64_t pos = dp->cached_data.pos;
+            dp->is_cached = false;
+            dp->buffer = pkt->buffer;
+            dp->len = pkt->len;
+            dp->avpacket = pkt->avpacket;
+            talloc_steal(dp, dp->avpacket);
+            // Keep the disk copy, in case the packet is spilled again.
+            dp->spill_pos = pos;
+            pkt->avpacket = NULL;
+            talloc_free(pkt);
+
+            // May have to spill or compress it again when the reader moves
+            // past it.
+            ds->queue->spill_last = NULL;
+            ds->queue->compress_last = NULL;
+        }
+    }
+
+done:
+    in->promote_pending = false;
+}
+
 static void prune_old_packets(struct demux_internal *in)
 {
     assert(in->current_range == in->ranges[in->num_ranges - 1]);
 
+    int64_t start = mp_time_us();
+    // Limit the time the lock is held if a lot has to be pruned (e.g. after
+    // the cache size was reduced). The rest is done in later iterations.
+    int budget = PRUNE_BUDGET;
+
+    in->prune_pending = false;
+
+    if (in->cache && in->opts->cache_spill)
+        spill_old_packets(in);
+
     // It's not clear what the ideal way to prune old packets is. For now, we
     // prune the oldest packet runs, as long as the total cache amount is too
     // big.
     while (1) {
-        uint64_t fw_bytes = 0;
-        for (int n = 0; n < in->num_streams; n++) {
-            struct demux_stream *ds = in->streams[n]->ds;
-            fw_bytes += get_foward_buffered_bytes(ds);
-        }
-        uint64_t max_avail = in->max_bytes_bw;
-        // Backward cache (if enabled at all) can use unused forward cache.
-        // Still leave 1 byte free, so the read_packet logic doesn't get stuck.
-        if (max_avail && in->max_bytes > (fw_bytes + 1) && in->opts->donate_fw)
-            max_avail += in->max_bytes - (fw_bytes + 1);
-        if (in->total_bytes - fw_bytes <= max_avail)
+        if (!get_back_bytes_excess(in))
+            break;
+
+        if (budget <= 0) {
+            in->prune_pending = true;
             break;
+        }
 
         // (Start from least recently used range.)
         struct demux_cached_range *range = in->ranges[0];
@@ -2360,6 +2790,7 @@ static void prune_old_packets(struct demux_internal *in)
             }
 
             remove_head_packet(queue);
+            budget--;
         }
 
         // Need to update the seekable time range.
@@ -2401,6 +2832,8 @@ static void prune_old_packets(struct demux_internal *in)
         if (range != in->current_range && range->seek_start == MP_NOPTS_VALUE)
             free_empty_cached_ranges(in);
     }
+
+    stats_histogram_us(in->stats, "lock-prune", mp_time_us() - start);
 }
 
 static void execute_trackswitch(struct demux_internal *in)
@@ -2487,9 +2920,12 @@ static void update_opts(struct demux_internal *in)
     }
 
     if (in->seekable_cache && opts->disk_cache && !in->cache) {
-        in->cache = demux_cache_create(in->global, in->log);
+        in->cache = demux_cache_create(in->global, in->log,
+                                       in->d_thread->filename);
         if (!in->cache)
             MP_ERR(in, "Failed to create file cache.\n");
+        in->cache_restore_pending =
+            in->cache && demux_cache_is_persistent(in->cache);
     }
 
     // The filename option really decides whether recording should be active.
@@ -2538,6 +2974,20 @@ static bool thread_work(struct demux_internal *in)
         execute_seek(in);
         return true;
     }
+    if (in->promote_pending) {
+        promote_packets(in);
+        return true;
+    }
+    if (in->prune_pending) {
+        prune_old_packets(in);
+        return true;
+    }
+    if (in->garbage_head && free_garbage(in, FREE_BUDGET))
+        return true;
+    // (Alternate with read_packet(), so that neither starves the other.)
+    in->compress_turn = !in->compress_turn;
+    if (in->opts->back_compress && in->compress_turn && compress_old_packets(in))
+        return true;
     if (read_packet(in))
         return true; // read_packet unlocked, so recheck conditions
     if (mp_time_us() >= in->next_cache_update) {
@@ -2595,7 +3045,8 @@ static struct demux_packet *advance_reader_head(struct demux_stream *ds)
 
 // Return a newly allocated new packet. The pkt parameter may be either a
 // in-memory packet (then a new reference is made), or a reference to
-// packet in the disk cache (then the packet is read from disk).
+// packet in the disk cache (then the packet is read from disk). Compressed
+// packets are uncompressed.
 static struct demux_packet *read_packet_from_cache(struct demux_internal *in,
                                                    struct demux_packet *pkt)
 {
@@ -2611,6 +3062,10 @@ static struct demux_packet *read_packet_from_cache(struct demux_internal *in,
         } else {
             MP_ERR(in, "Failed to retrieve packet from cache.\n");
         }
+    } else if (pkt->is_compressed) {
+        pkt = uncompress_packet(pkt);
+        if (!pkt)
+            MP_ERR(in, "Failed to uncompress cached packet.\n");
     } else {
         // The returned packet is mutated etc. and will be owned by the user.
         pkt = demux_copy_packet(pkt);
@@ -3547,26 +4002,8 @@ static void switch_current_range(struct demux_internal *in,
 // Search for the entry with the highest index with entry.pts <= pts true.
 static struct demux_packet *search_index(struct demux_queue *queue, double pts)
 {
-    size_t a = 0;
-    size_t b = queue->num_index;
-
-    while (a < b) {
-        size_t m = a + (b - a) / 2;
-        struct index_entry *e = &QUEUE_INDEX_ENTRY(queue, m);
-
-        bool m_ok = e->pts <= pts;
-
-        if (a + 1 == b)
-            return m_ok ? e->pkt : NULL;
-
-        if (m_ok) {
-            a = m;
-        } else {
-            b = m;
-        }
-    }
-
-    return NULL;
+    struct seek_index_entry *e = seek_index_find(&queue->index, pts);
+    return e ? e->pkt : NULL;
 }
 
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
@@ -3688,11 +4125,19 @@ static void execute_cache_seek(struct demux_internal *in,
 {
     adjust_cache_seek_target(in, range, &pts, &flags);
 
+    // File range of the disk cache the reader is going to go through.
+    uint64_t ra_start = UINT64_MAX, ra_end = 0;
+
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
         struct demux_queue *queue = range->streams[n];
 
         struct demux_packet *target = find_seek_target(queue, pts, flags);
+        if (target && target->is_cached && ds->selected) {
+            ra_start = MPMIN(ra_start, target->cached_data.pos);
+            if (queue->tail && queue->tail->is_cached)
+                ra_end = MPMAX(ra_end, queue->tail->cached_data.pos);
+        }
         ds->reader_head = target;
         ds->skip_to_keyframe = !target;
         if (ds->reader_head)
@@ -3708,6 +4153,11 @@ static void execute_cache_seek(struct demux_internal *in,
         }
     }
 
+    if (in->cache && ra_start < ra_end)
+        demux_cache_set_readahead(in->cache, ra_start, ra_end);
+
+    in->promote_pending = in->saved_bytes > 0;
+
     // If we seek to another range, we want to seek the low level demuxer to
     // there as well, because reader and demuxer queue must be the same.
     if (in->current_range != range) {
@@ -3751,6 +4201,304 @@ static void switch_to_fresh_cache_range(struct demux_internal *in)
     switch_current_range(in, range);
 }
 
+// Persistent disk cache (--cache-persist). The cache file retains the packet
+// data, while the packet metadata and seek ranges are dumped into the cache
+// index on close. This is a plain memory dump, and is only meant to be read by
+// the same mpv build on the same machine.
+
+struct persist_header {
+    uint32_t num_streams;
+    uint32_t num_ranges;
+};
+
+struct persist_stream {
+    int32_t type;
+    int32_t demuxer_id;
+    uint32_t codec_len;     // followed by codec name
+};
+
+struct persist_queue {
+    double seek_start, seek_end;
+    double last_pruned;
+    double last_dts, last_ts;
+    int64_t last_pos;
+    uint64_t num_packets;   // followed by num_packets persist_packet
+    uint8_t correct_dts, correct_pos;
+    uint8_t is_bof, is_eof;
+};
+
+struct persist_packet {
+    double pts, dts, duration;
+    int64_t pos;
+    uint64_t cached_pos;
+    uint8_t keyframe;
+};
+
+static void put_data(void *ta_ctx, bstr *s, void *p, size_t size)
+{
+    bstr_xappend(ta_ctx, s, (bstr){p, size});
+}
+
+static bool get_data(bstr *s, void *p, size_t size)
+{
+    if (s->len < size)
+        return false;
+    memcpy(p, s->start, size);
+    *s = bstr_cut(*s, size);
+    return true;
+}
+
+#define PUT_DATA(ta_ctx, s, v) put_data(ta_ctx, s, &(v), sizeof(v))
+#define GET_DATA(s, v) get_data(s, &(v), sizeof(v))
+
+// Whether all packets of the range can be recreated from the cache file.
+static bool range_is_persistent(struct demux_cached_range *range)
+{
+    if (range->seek_start == MP_NOPTS_VALUE)
+        return false;
+
+    for (int n = 0; n < range->num_streams; n++) {
+        for (struct demux_packet *dp = range->streams[n]->head; dp; dp = dp->next)
+        {
+            if (!dp->is_cached || dp->segmented)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void save_persistent_cache(struct demux_internal *in)
+{
+    if (!in->cache || !demux_cache_is_persistent(in->cache))
+        return;
+
+    pthread_mutex_lock(&in->lock);
+
+    // If the index was never loaded, keep it as it is.
+    if (in->cache_restore_pending) {
+        pthread_mutex_unlock(&in->lock);
+        return;
+    }
+
+    void *tmp = talloc_new(NULL);
+    bstr data = {0};
+
+    struct demux_cached_range **ranges = NULL;
+    int num_ranges = 0;
+    for (int n = 0; n < in->num_ranges; n++) {
+        if (range_is_persistent(in->ranges[n]))
+            MP_TARRAY_APPEND(tmp, ranges, num_ranges, in->ranges[n]);
+    }
+
+    struct persist_header hdr = {
+        .num_streams = in->num_streams,
+        .num_ranges = num_ranges,
+    };
+    PUT_DATA(tmp, &data, hdr);
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct sh_stream *sh = in->streams[n];
+        struct persist_stream ps = {
+            .type = sh->type,
+            .demuxer_id = sh->demuxer_id,
+            .codec_len = strlen(sh->codec->codec),
+        };
+        PUT_DATA(tmp, &data, ps);
+        bstr_xappend(tmp, &data, bstr0(sh->codec->codec));
+    }
+
+    for (int r = 0; r < num_ranges; r++) {
+        struct demux_cached_range *range = ranges[r];
+
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+
+            uint64_t num_packets = 0;
+            for (struct demux_packet *dp = queue->head; dp; dp = dp->next)
+                num_packets++;
+
+            struct persist_queue pq = {
+                .seek_start = queue->seek_start,
+                .seek_end = queue->seek_end,
+                .last_pruned = queue->last_pruned,
+                .last_dts = queue->last_dts,
+                .last_ts = queue->last_ts,
+                .last_pos = queue->last_pos,
+                .num_packets = num_packets,
+                .correct_dts = queue->correct_dts,
+                .correct_pos = queue->correct_pos,
+                .is_bof = queue->is_bof,
+                .is_eof = queue->is_eof,
+            };
+            PUT_DATA(tmp, &data, pq);
+
+            for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
+                struct persist_packet pp = {
+                    .pts = dp->pts,
+                    .dts = dp->dts,
+                    .duration = dp->duration,
+                    .pos = dp->pos,
+                    .cached_pos = dp->cached_data.pos,
+                    .keyframe = dp->keyframe,
+                };
+                PUT_DATA(tmp, &data, pp);
+            }
+        }
+    }
+
+    MP_VERBOSE(in, "Writing %d ranges to cache index.\n", num_ranges);
+    demux_cache_write_index(in->cache, data);
+
+    talloc_free(tmp);
+    pthread_mutex_unlock(&in->lock);
+}
+
+static bool restore_persistent_queue(struct demux_queue *queue, bstr *data)
+{
+    struct demux_stream *ds = queue->ds;
+    struct demux_internal *in = ds->in;
+
+    struct persist_queue pq;
+    if (!GET_DATA(data, pq))
+        return false;
+
+    for (uint64_t i = 0; i < pq.num_packets; i++) {
+        struct persist_packet pp;
+        if (!GET_DATA(data, pp))
+            return false;
+
+        struct demux_packet *dp = talloc_zero(NULL, struct demux_packet);
+        *dp = (struct demux_packet){
+            .pts = pp.pts,
+            .dts = pp.dts,
+            .duration = pp.duration,
+            .pos = pp.pos,
+            .cached_data.pos = pp.cached_pos,
+            .stream = ds->index,
+            .keyframe = pp.keyframe,
+            .is_cached = true,
+            .spill_pos = -1,
+            .start = MP_NOPTS_VALUE,
+            .end = MP_NOPTS_VALUE,
+        };
+
+        size_t bytes = demux_packet_estimate_total_size(dp);
+        in->total_bytes += bytes;
+        dp->cum_pos = queue->tail_cum_pos;
+        queue->tail_cum_pos += bytes;
+
+        if (queue->tail) {
+            queue->tail->next = dp;
+        } else {
+            queue->head = dp;
+        }
+        queue->tail = dp;
+
+        if (dp->keyframe) {
+            if (!queue->keyframe_first)
+                queue->keyframe_first = dp;
+            queue->keyframe_latest = dp;
+        }
+    }
+
+    // The last keyframe range is indexed only once it's complete, same as
+    // with adjust_seek_range_on_packet().
+    for (struct demux_packet *dp = queue->keyframe_first;
+         dp && dp != queue->keyframe_latest;)
+    {
+        double kf_min;
+        struct demux_packet *next = compute_keyframe_times(dp, &kf_min, NULL);
+        if (kf_min != MP_NOPTS_VALUE)
+            add_index_entry(queue, dp, kf_min);
+        dp = next;
+    }
+
+    queue->seek_start = pq.seek_start;
+    queue->seek_end = pq.seek_end;
+    queue->last_pruned = pq.last_pruned;
+    queue->last_dts = pq.last_dts;
+    queue->last_ts = pq.last_ts;
+    queue->last_pos = pq.last_pos;
+    queue->correct_dts = pq.correct_dts;
+    queue->correct_pos = pq.correct_pos;
+    queue->is_bof = pq.is_bof;
+    queue->is_eof = pq.is_eof;
+
+    ds->global_correct_dts &= queue->correct_dts;
+    ds->global_correct_pos &= queue->correct_pos;
+    return true;
+}
+
+// Load the ranges stored by save_persistent_cache(). This must happen after the
+// streams were selected, or the ranges would be considered empty.
+static void restore_persistent_cache(struct demux_internal *in)
+{
+    in->cache_restore_pending = false;
+
+    void *tmp = talloc_new(NULL);
+    bstr data = demux_cache_read_index(in->cache, tmp);
+    if (!data.len)
+        goto done;
+
+    struct persist_header hdr;
+    if (!GET_DATA(&data, hdr) || hdr.num_streams != in->num_streams)
+        goto mismatch;
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct sh_stream *sh = in->streams[n];
+        struct persist_stream ps;
+        if (!GET_DATA(&data, ps) || ps.type != sh->type ||
+            ps.demuxer_id != sh->demuxer_id || ps.codec_len > data.len)
+            goto mismatch;
+        bstr codec = bstr_splice(data, 0, ps.codec_len);
+        data = bstr_cut(data, ps.codec_len);
+        if (!bstr_equals0(codec, sh->codec->codec))
+            goto mismatch;
+    }
+
+    int num_restored = 0;
+    for (uint32_t r = 0; r < hdr.num_ranges; r++) {
+        if (in->num_ranges >= MAX_SEEK_RANGES)
+            break;
+
+        struct demux_cached_range *range = talloc_ptrtype(NULL, range);
+        *range = (struct demux_cached_range){
+            .seek_start = MP_NOPTS_VALUE,
+            .seek_end = MP_NOPTS_VALUE,
+        };
+        // (Least recently used, so it's the first to be pruned.)
+        MP_TARRAY_INSERT_AT(in, in->ranges, in->num_ranges, 0, range);
+        add_missing_streams(in, range);
+
+        bool ok = true;
+        for (int n = 0; n < range->num_streams; n++)
+            ok &= restore_persistent_queue(range->streams[n], &data);
+
+        if (!ok) {
+            MP_WARN(in, "Cache index is corrupted.\n");
+            clear_cached_range(in, range);
+            break;
+        }
+
+        update_seek_ranges(range);
+        if (range->seek_start != MP_NOPTS_VALUE) {
+            MP_VERBOSE(in, "restored cached range %f <-> %f\n",
+                       range->seek_start, range->seek_end);
+            num_restored++;
+        }
+    }
+
+    free_empty_cached_ranges(in);
+    MP_VERBOSE(in, "Restored %d ranges from cache index.\n", num_restored);
+    goto done;
+
+mismatch:
+    MP_WARN(in, "Cache index does not match the opened file.\n");
+done:
+    talloc_free(tmp);
+}
+
 int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
 {
     struct demux_internal *in = demuxer->in;
@@ -3778,6 +4526,9 @@ static bool queue_seek(struct demux_internal *in, double seek_pts, int flags,
     MP_VERBOSE(in, "queuing seek to %f%s\n", seek_pts,
                in->seeking ? " (cascade)" : "");
 
+    if (in->cache_restore_pending)
+        restore_persistent_cache(in);
+
     bool require_cache = flags & SEEK_CACHED;
     flags &= ~(unsigned)SEEK_CACHED;
 
@@ -4437,7 +5188,7 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
         .ts_reader = MP_NOPTS_VALUE,
         .ts_end = MP_NOPTS_VALUE,
         .ts_duration = -1,
-        .total_bytes = in->total_bytes,
+        .total_bytes = in->total_bytes - in->saved_bytes,
         .seeking = in->seeking_in_progress,
         .low_level_seeks = in->low_level_seeks,
         .ts_last = in->demux_ts,
@@ -4467,11 +5218,16 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
     for (int n = 0; n < MPMIN(in->num_ranges, MAX_SEEK_RANGES); n++) {
         struct demux_cached_range *range = in->ranges[n];
         if (range->seek_start != MP_NOPTS_VALUE) {
-            r->seek_ranges[r->num_seek_ranges++] =
-                (struct demux_seek_range){
-                    .start = MP_ADD_PTS(range->seek_start, in->ts_offset),
-                    .end = MP_ADD_PTS(range->seek_end, in->ts_offset),
-                };
+            struct demux_seek_range *sr =
+                &r->seek_ranges[r->num_seek_ranges++];
+            *sr = (struct demux_seek_range){
+                .start = MP_ADD_PTS(range->seek_start, in->ts_offset),
+                .end = MP_ADD_PTS(range->seek_end, in->ts_offset),
+            };
+            for (int i = 0; i < range->num_streams; i++) {
+                sr->compressed_bytes += range->streams[i]->compressed_bytes;
+                sr->uncompressed_bytes += range->streams[i]->uncompressed_bytes;
+            }
             r->bof_cached |= range->is_bof;
             r->eof_cached |= range->is_eof;
         }
@@ -34,6 +34,9 @@
 
 struct demux_seek_range {
     double start, end;
+    // --demuxer-back-compress stats: total compressed and original size of
+    // compressed packets in this range
+    int64_t compressed_bytes, uncompressed_bytes;
 };
 
 struct demux_reader_state {
@@ -27,11 +27,14 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/avstring.h>
+#include <libavutil/sha.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -46,7 +49,9 @@
 #include "common/av_common.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "misc/bstr.h"
+#include "osdep/io.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -154,6 +159,28 @@ typedef struct mkv_index {
     uint64_t filepos; // position of the cluster which contains the packet
 } mkv_index_t;
 
+// Header of the files written by --demuxer-mkv-index-cache. Identifies the
+// file the index belongs to; the file name is a hash of the same data. The
+// fields are laid out so that there is no padding before duration.
+#define INDEX_CACHE_MAGIC "mpv mkv index v1\n"
+
+struct index_cache_header {
+    char magic[24];
+    uint64_t file_size;
+    int64_t mtime;
+    int64_t segment_start;
+    unsigned char segment_uid[16];
+    double duration;                // 0 if unknown
+    uint32_t has_durations;
+    uint32_t num_entries;           // followed by index_cache_entry[]
+};
+
+struct index_cache_entry {
+    int64_t tnum;
+    int64_t timecode, duration;
+    uint64_t filepos;
+};
+
 struct block_info {
     uint64_t duration, discardpadding;
     bool simple, keyframe, duration_known;
@@ -216,6 +243,11 @@ typedef struct mkv_demuxer {
     int num_packets;
 
     bool probably_webm_dash_init;
+
+    // Set if --demuxer-mkv-index-cache is used for this file.
+    char *index_cache_dir, *index_cache_file;
+    struct index_cache_header index_cache_header;
+    size_t index_cache_entries;     // number of entries loaded from the cache
 } mkv_demuxer_t;
 
 #define OPT_BASE_STRUCT struct demux_mkv_opts
@@ -225,6 +257,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    int index_cache;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -238,6 +271,7 @@ const struct m_sub_options demux_mkv_conf = {
         {"probe-video-duration", OPT_CHOICE(probe_duration,
             {"no", 0}, {"yes", 1}, {"full", 2})},
         {"probe-start-time", OPT_FLAG(probe_start_time)},
+        {"index-cache", OPT_FLAG(index_cache)},
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -1991,6 +2025,196 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
     return 0;
 }
 
+// Determine the index cache file name, if the index cache can be used.
+static void init_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    stream_t *s = demuxer->stream;
+
+    if (!mkv_d->opts->index_cache || mkv_d->index_mode != 1 ||
+        !s->is_local_file || !s->path)
+        return;
+
+    // Files with cues don't need this.
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return;
+    }
+    if (mkv_d->index_complete)
+        return;
+
+    char *cache_dir = NULL;
+    mp_read_option_raw(demuxer->global, "cache-dir", &m_option_type_string,
+                       &cache_dir);
+    if (!cache_dir || !cache_dir[0]) {
+        MP_WARN(demuxer, "--demuxer-mkv-index-cache requires --cache-dir.\n");
+        talloc_free(cache_dir);
+        return;
+    }
+
+    struct stat st;
+    if (stat(s->path, &st) || !S_ISREG(st.st_mode)) {
+        talloc_free(cache_dir);
+        return;
+    }
+
+    struct index_cache_header *hdr = &mkv_d->index_cache_header;
+    *hdr = (struct index_cache_header){
+        .magic = INDEX_CACHE_MAGIC,
+        .file_size = st.st_size,
+        .mtime = st.st_mtime,
+        .segment_start = mkv_d->segment_start,
+    };
+    memcpy(hdr->segment_uid, demuxer->matroska_data.uid.segment,
+           sizeof(hdr->segment_uid));
+
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, (const uint8_t *)hdr,
+                  offsetof(struct index_cache_header, duration));
+    uint8_t hash[256 / 8];
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char hashstr[256 / 8 * 2 + 1];
+    for (int n = 0; n < 256 / 8; n++)
+        snprintf(hashstr + n * 2, sizeof(hashstr) - n * 2, "%02x", hash[n]);
+
+    char *dir = mp_get_user_path(NULL, demuxer->global, cache_dir);
+    mkv_d->index_cache_dir = mp_path_join(mkv_d, dir, "mkv-index");
+    mkv_d->index_cache_file =
+        mp_path_join(mkv_d, mkv_d->index_cache_dir, hashstr);
+    talloc_free(dir);
+    talloc_free(cache_dir);
+}
+
+// Restore the index created by a previous run. It's not necessarily complete,
+// so incremental index creation continues from its last entry.
+static void load_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (!mkv_d->index_cache_file)
+        return;
+
+    FILE *f = fopen(mkv_d->index_cache_file, "rb");
+    if (!f)
+        return;
+
+    struct index_cache_header *ref = &mkv_d->index_cache_header;
+    struct index_cache_header hdr;
+    struct stat st;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(&hdr, ref, offsetof(struct index_cache_header, duration)) != 0)
+    {
+        MP_WARN(demuxer, "Ignoring invalid index cache file.\n");
+        goto done;
+    }
+
+    // Don't trust num_entries for the allocation size.
+    if (fstat(fileno(f), &st) != 0 ||
+        (uint64_t)st.st_size != sizeof(hdr) +
+            hdr.num_entries * (uint64_t)sizeof(struct index_cache_entry))
+    {
+        MP_WARN(demuxer, "Ignoring index cache file with wrong size.\n");
+        goto done;
+    }
+
+    struct index_cache_entry *entries =
+        talloc_array(NULL, struct index_cache_entry, hdr.num_entries);
+    if (fread(entries, sizeof(entries[0]), hdr.num_entries, f) !=
+        hdr.num_entries)
+    {
+        MP_WARN(demuxer, "Ignoring truncated index cache file.\n");
+        talloc_free(entries);
+        goto done;
+    }
+
+    mkv_d->num_indexes = 0;
+    for (size_t i = 0; i < hdr.num_entries; i++) {
+        struct index_cache_entry *e = &entries[i];
+        cue_index_add(demuxer, e->tnum, e->filepos, e->timecode, e->duration);
+        for (int n = 0; n < mkv_d->num_tracks; n++) {
+            if (mkv_d->tracks[n]->tnum == e->tnum)
+                mkv_d->tracks[n]->last_index_entry = mkv_d->num_indexes - 1;
+        }
+    }
+    talloc_free(entries);
+
+    mkv_d->index_has_durations = hdr.has_durations;
+    mkv_d->index_cache_entries = mkv_d->num_indexes;
+    if (hdr.duration > 0 && mkv_d->duration <= 0) {
+        mkv_d->duration = hdr.duration;
+        demuxer->duration = mkv_d->duration;
+    }
+    ref->duration = hdr.duration;
+
+    MP_VERBOSE(demuxer, "Loaded %zu index entries from %s\n",
+               mkv_d->num_indexes, mkv_d->index_cache_file);
+
+done:
+    fclose(f);
+}
+
+static void save_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (!mkv_d->index_cache_file || mkv_d->index_complete)
+        return;
+
+    struct index_cache_header hdr = mkv_d->index_cache_header;
+    if (mkv_d->num_indexes == mkv_d->index_cache_entries &&
+        (mkv_d->duration <= 0 || mkv_d->duration == hdr.duration))
+        return;
+    if (mkv_d->num_indexes > UINT32_MAX)
+        return;
+
+    hdr.duration = MPMAX(mkv_d->duration, 0);
+    hdr.has_durations = mkv_d->index_has_durations;
+    hdr.num_entries = mkv_d->num_indexes;
+
+    mp_mkdirp(mkv_d->index_cache_dir);
+
+    // Write to a temporary file first, so other instances never see a partial
+    // index file.
+    char *tmp = talloc_asprintf(NULL, "%s.tmp", mkv_d->index_cache_file);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        MP_WARN(demuxer, "Could not write index cache file.\n");
+        goto done;
+    }
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (size_t i = 0; i < mkv_d->num_indexes; i++) {
+        mkv_index_t *index = &mkv_d->indexes[i];
+        struct index_cache_entry e = {
+            .tnum = index->tnum,
+            .timecode = index->timecode,
+            .duration = index->duration,
+            .filepos = index->filepos,
+        };
+        ok &= fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmp, mkv_d->index_cache_file) != 0) {
+        // (Windows refuses to replace existing files.)
+        unlink(mkv_d->index_cache_file);
+        ok = rename(tmp, mkv_d->index_cache_file) == 0;
+    }
+    if (ok) {
+        MP_VERBOSE(demuxer, "Wrote %zu index entries to %s\n",
+                   mkv_d->num_indexes, mkv_d->index_cache_file);
+    } else {
+        MP_WARN(demuxer, "Could not write index cache file.\n");
+        unlink(tmp);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 {
     stream_t *s = demuxer->stream;
@@ -2111,8 +2335,12 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     add_coverart(demuxer);
     process_tags(demuxer);
 
+    init_index_cache(demuxer);
+    load_index_cache(demuxer);
+
     probe_first_timestamp(demuxer);
-    if (mkv_d->opts->probe_duration)
+    // (Skip if the index cache already provided it.)
+    if (mkv_d->opts->probe_duration && !mkv_d->index_cache_header.duration)
         probe_last_timestamp(demuxer, start_pos);
     probe_x264_garbage(demuxer);
 
@@ -2190,16 +2418,20 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
         uint32_t size = lace_size[i];
         if (stream_tell(s) + size > endpos || size > (1 << 30))
             goto error;
-        int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
-        if (!buf)
-            goto error;
-        buf->size = size;
-        if (stream_read(s, buf->data, buf->size) != buf->size) {
-            av_buffer_unref(&buf);
-            goto error;
+        // Reference the data without copying if the stream allows it.
+        AVBufferRef *buf = stream_read_ref(s, size);
+        if (!buf) {
+            int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
+            buf = av_buffer_alloc(size + pad);
+            if (!buf)
+                goto error;
+            buf->size = size;
+            if (stream_read(s, buf->data, buf->size) != buf->size) {
+                av_buffer_unref(&buf);
+                goto error;
+            }
+            memset(buf->data + buf->size, 0, pad);
         }
-        memset(buf->data + buf->size, 0, pad);
         block->laces[block->num_laces++] = buf;
     }
 
@@ -3230,6 +3462,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
@@ -55,6 +55,68 @@ bool ebml_is_mkv_level1_id(uint32_t id)
     }
 }
 
+static uint32_t ebml_parse_id(uint8_t *data, size_t data_len, int *length)
+{
+    *length = -1;
+    uint8_t *end = data + data_len;
+    if (data == end)
+        return EBML_ID_INVALID;
+    int len = 1;
+    uint32_t id = *data++;
+    for (int len_mask = 0x80; !(id & len_mask); len_mask >>= 1) {
+        len++;
+        if (len > 4)
+            return EBML_ID_INVALID;
+    }
+    *length = len;
+    while (--len && data < end)
+        id = (id << 8) | *data++;
+    return id;
+}
+
+static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
+{
+    *length = -1;
+    uint8_t *end = data + data_len;
+    if (data == end)
+        return -1;
+    uint64_t r = *data++;
+    int len = 1;
+    int len_mask;
+    for (len_mask = 0x80; !(r & len_mask); len_mask >>= 1) {
+        len++;
+        if (len > 8)
+            return -1;
+    }
+    r &= len_mask - 1;
+
+    int num_allones = 0;
+    if (r == len_mask - 1)
+        num_allones++;
+    for (int i = 1; i < len; i++) {
+        if (data == end)
+            return -1;
+        if (*data == 255)
+            num_allones++;
+        r = (r << 8) | *data++;
+    }
+    // According to Matroska specs this means "unknown length"
+    // Could be supported if there are any actual files using it
+    if (num_allones == len)
+        return -1;
+    *length = len;
+    return r;
+}
+
+static uint64_t ebml_parse_uint(uint8_t *data, int length)
+{
+    assert(length >= 0 && length <= 8);
+    uint64_t r = 0;
+    while (length--)
+        r = (r << 8) + *data++;
+    return r;
+}
+
 /*
  * Read: the element content data ID.
  * Return: the ID.
@@ -64,6 +126,15 @@ uint32_t ebml_read_id(stream_t *s)
     int i, len_mask = 0x80;
     uint32_t id;
 
+    // Fast path: parse directly from the stream buffer.
+    int avail, len;
+    uint8_t *data = stream_peek_buffered(s, &avail);
+    id = ebml_parse_id(data, avail, &len);
+    if (len > 0 && len <= avail) {
+        stream_skip_buffered(s, len);
+        return id;
+    }
+
     for (i = 0, id = stream_read_char(s); i < 4 && !(id & len_mask); i++)
         len_mask >>= 1;
     if (i >= 4)
@@ -81,6 +152,16 @@ uint64_t ebml_read_length(stream_t *s)
     int i, j, num_ffs = 0, len_mask = 0x80;
     uint64_t len;
 
+    // Fast path (falls back to the code below on errors and at the end of the
+    // buffered data).
+    int avail, bytes;
+    uint8_t *data = stream_peek_buffered(s, &avail);
+    len = ebml_parse_length(data, avail, &bytes);
+    if (bytes > 0) {
+        stream_skip_buffered(s, bytes);
+        return len;
+    }
+
     for (i = 0, len = stream_read_char(s); i < 8 && !(len & len_mask); i++)
         len_mask >>= 1;
     if (i >= 8)
@@ -130,6 +211,13 @@ uint64_t ebml_read_uint(stream_t *s)
     if (len == EBML_UINT_INVALID || len > 8)
         return EBML_UINT_INVALID;
 
+    int avail;
+    uint8_t *data = stream_peek_buffered(s, &avail);
+    if (avail >= len) {
+        stream_skip_buffered(s, len);
+        return ebml_parse_uint(data, len);
+    }
+
     while (len--)
         value = (value << 8) | stream_read_char(s);
 
@@ -235,68 +323,6 @@ int ebml_resync_cluster(struct mp_log *log, stream_t *s)
 struct generic;
 #define generic_struct struct generic
 
-static uint32_t ebml_parse_id(uint8_t *data, size_t data_len, int *length)
-{
-    *length = -1;
-    uint8_t *end = data + data_len;
-    if (data == end)
-        return EBML_ID_INVALID;
-    int len = 1;
-    uint32_t id = *data++;
-    for (int len_mask = 0x80; !(id & len_mask); len_mask >>= 1) {
-        len++;
-        if (len > 4)
-            return EBML_ID_INVALID;
-    }
-    *length = len;
-    while (--len && data < end)
-        id = (id << 8) | *data++;
-    return id;
-}
-
-static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
-{
-    *length = -1;
-    uint8_t *end = data + data_len;
-    if (data == end)
-        return -1;
-    uint64_t r = *data++;
-    int len = 1;
-    int len_mask;
-    for (len_mask = 0x80; !(r & len_mask); len_mask >>= 1) {
-        len++;
-        if (len > 8)
-            return -1;
-    }
-    r &= len_mask - 1;
-
-    int num_allones = 0;
-    if (r == len_mask - 1)
-        num_allones++;
-    for (int i = 1; i < len; i++) {
-        if (data == end)
-            return -1;
-        if (*data == 255)
-            num_allones++;
-        r = (r << 8) | *data++;
-    }
-    // According to Matroska specs this means "unknown length"
-    // Could be supported if there are any actual files using it
-    if (num_allones == len)
-        return -1;
-    *length = len;
-    return r;
-}
-
-static uint64_t ebml_parse_uint(uint8_t *data, int length)
-{
-    assert(length >= 0 && length <= 8);
-    uint64_t r = 0;
-    while (length--)
-        r = (r << 8) + *data++;
-    return r;
-}
-
 static int64_t ebml_parse_sint(uint8_t *data, int length)
 {
     assert(length >= 0 && length <= 8);
@@ -70,6 +70,7 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
+        .spill_pos = -1,
         .avpacket = talloc_zero(dp, AVPacket),
     };
     av_init_packet(dp->avpacket);
@@ -52,6 +52,10 @@ typedef struct demux_packet {
 
     // If true, cached_data is valid, while buffer/len are not.
     bool is_cached : 1;
+    // demux.c internal: buffer/len contains the compressed packet data.
+    bool is_compressed : 1;
+    // demux.c internal: data is being compressed.
+    bool compress_busy : 1;
 
     // segmentation (ordered chapters, EDL)
     bool segmented;
@@ -62,6 +66,7 @@ typedef struct demux_packet {
     struct demux_packet *next;
     struct AVPacket *avpacket;   // keep the buffer allocation and sidedata
     uint64_t cum_pos; // demux.c internal: cumulative size until _start_ of pkt
+    int64_t spill_pos; // demux.c internal: disk cache copy of data, or -1
 } demux_packet_t;
 
 struct AVBufferRef;
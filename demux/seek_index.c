@@ -0,0 +1,192 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "seek_index.h"
+
+struct seek_index_block {
+    size_t start, end;      // used range of entries[] (never empty)
+    struct seek_index_entry entries[SEEK_INDEX_BLOCK_SIZE];
+};
+
+#define BLOCK(idx, n) ((idx)->blocks[(idx)->blocks0 + (n)])
+
+void seek_index_clear(struct seek_index *idx)
+{
+    for (size_t n = 0; n < idx->num_blocks; n++)
+        talloc_free(BLOCK(idx, n));
+    talloc_free(idx->blocks);
+    *idx = (struct seek_index){0};
+}
+
+static void add_block(struct seek_index *idx, struct seek_index_block *block)
+{
+    if (idx->blocks0 + idx->num_blocks == idx->blocks_alloc) {
+        // Reuse the space of removed blocks if it's at least half of blocks[].
+        if (idx->blocks0 && idx->blocks0 >= idx->num_blocks) {
+            memmove(idx->blocks, idx->blocks + idx->blocks0,
+                    idx->num_blocks * sizeof(idx->blocks[0]));
+            idx->blocks0 = 0;
+        } else {
+            size_t new_size = MPMAX(16, idx->blocks_alloc * 2);
+            MP_RESIZE_ARRAY(NULL, idx->blocks, new_size);
+            idx->blocks_alloc = new_size;
+        }
+    }
+
+    idx->blocks[idx->blocks0 + idx->num_blocks++] = block;
+}
+
+static void remove_first_block(struct seek_index *idx)
+{
+    assert(idx->num_blocks);
+    talloc_free(BLOCK(idx, 0));
+    idx->blocks0 += 1;
+    idx->num_blocks -= 1;
+    if (!idx->num_blocks)
+        idx->blocks0 = 0;
+}
+
+// The caller must make sure the entries stay sorted.
+void seek_index_append(struct seek_index *idx, double pts,
+                       struct demux_packet *pkt)
+{
+    struct seek_index_block *block =
+        idx->num_blocks ? BLOCK(idx, idx->num_blocks - 1) : NULL;
+
+    if (!block || block->end == SEEK_INDEX_BLOCK_SIZE) {
+        block = talloc_ptrtype(NULL, block);
+        block->start = block->end = 0;
+        add_block(idx, block);
+    }
+
+    block->entries[block->end++] = (struct seek_index_entry){
+        .pts = pts,
+        .pkt = pkt,
+    };
+    idx->num += 1;
+}
+
+void seek_index_remove_first(struct seek_index *idx)
+{
+    assert(idx->num);
+
+    struct seek_index_block *block = BLOCK(idx, 0);
+    block->start += 1;
+    idx->num -= 1;
+
+    if (block->start == block->end)
+        remove_first_block(idx);
+}
+
+// Append all entries of src to dst, and clear src. Entries from the start of
+// src are dropped if they're not at least min_dist after the last dst entry.
+// This does not copy entries, so it's O(number of blocks).
+void seek_index_move(struct seek_index *dst, struct seek_index *src,
+                     double min_dist)
+{
+    struct seek_index_entry *last = seek_index_last(dst);
+    if (last) {
+        while (src->num && seek_index_first(src)->pts - last->pts < min_dist)
+            seek_index_remove_first(src);
+    }
+
+    for (size_t n = 0; n < src->num_blocks; n++)
+        add_block(dst, BLOCK(src, n));
+    dst->num += src->num;
+
+    src->num_blocks = 0;
+    seek_index_clear(src);
+}
+
+struct seek_index_entry *seek_index_first(struct seek_index *idx)
+{
+    if (!idx->num)
+        return NULL;
+    struct seek_index_block *block = BLOCK(idx, 0);
+    return &block->entries[block->start];
+}
+
+struct seek_index_entry *seek_index_last(struct seek_index *idx)
+{
+    if (!idx->num)
+        return NULL;
+    struct seek_index_block *block = BLOCK(idx, idx->num_blocks - 1);
+    return &block->entries[block->end - 1];
+}
+
+// Return the i-th entry. This is O(number of blocks), and meant for debugging.
+struct seek_index_entry *seek_index_get(struct seek_index *idx, size_t i)
+{
+    for (size_t n = 0; n < idx->num_blocks; n++) {
+        struct seek_index_block *block = BLOCK(idx, n);
+        size_t num = block->end - block->start;
+        if (i < num)
+            return &block->entries[block->start + i];
+        i -= num;
+    }
+    return NULL;
+}
+
+// Return the last entry with entry.pts <= pts, or NULL if there is none.
+struct seek_index_entry *seek_index_find(struct seek_index *idx, double pts)
+{
+    if (!idx->num)
+        return NULL;
+
+    // Last block whose first entry is <= pts.
+    size_t a = 0;
+    size_t b = idx->num_blocks;
+    while (b - a > 1) {
+        size_t m = a + (b - a) / 2;
+        struct seek_index_block *block = BLOCK(idx, m);
+        if (block->entries[block->start].pts <= pts) {
+            a = m;
+        } else {
+            b = m;
+        }
+    }
+
+    struct seek_index_block *block = BLOCK(idx, a);
+    if (block->entries[block->start].pts > pts)
+        return NULL;
+
+    // Same within the block.
+    a = block->start;
+    b = block->end;
+    while (b - a > 1) {
+        size_t m = a + (b - a) / 2;
+        if (block->entries[m].pts <= pts) {
+            a = m;
+        } else {
+            b = m;
+        }
+    }
+
+    return &block->entries[a];
+}
+
+// Approximate memory used by the index.
+size_t seek_index_get_alloc_size(struct seek_index *idx)
+{
+    return idx->blocks_alloc * sizeof(idx->blocks[0]) +
+           idx->num_blocks * sizeof(struct seek_index_block);
+}
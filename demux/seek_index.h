@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+struct demux_packet;
+
+// Number of entries per block. The blocks are allocated on demand, so this
+// is a trade-off between wasted memory and size of the block list.
+#define SEEK_INDEX_BLOCK_SIZE 256
+
+struct seek_index_entry {
+    double pts;
+    struct demux_packet *pkt;
+};
+
+struct seek_index_block;
+
+// Index of keyframes, sorted by pts. Entries can be appended at the end, and
+// removed from the start. It's a two-level structure (a list of fixed-size
+// blocks), so lookups are O(log n), and growing never copies entries.
+// Zero-initialize to create an empty index. Free with seek_index_clear().
+struct seek_index {
+    struct seek_index_block **blocks;
+    size_t blocks_alloc;    // allocated size of blocks[]
+    size_t blocks0;         // first used entry in blocks[]
+    size_t num_blocks;      // number of used entries after blocks0
+    size_t num;             // total number of entries
+};
+
+void seek_index_clear(struct seek_index *idx);
+void seek_index_append(struct seek_index *idx, double pts,
+                       struct demux_packet *pkt);
+void seek_index_remove_first(struct seek_index *idx);
+void seek_index_move(struct seek_index *dst, struct seek_index *src,
+                     double min_dist);
+struct seek_index_entry *seek_index_first(struct seek_index *idx);
+struct seek_index_entry *seek_index_last(struct seek_index *idx);
+struct seek_index_entry *seek_index_get(struct seek_index *idx, size_t i);
+struct seek_index_entry *seek_index_find(struct seek_index *idx, double pts);
+size_t seek_index_get_alloc_size(struct seek_index *idx);
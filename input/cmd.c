@@ -16,8 +16,10 @@
  */
 
 #include <stddef.h>
+#include <pthread.h>
 
 #include "misc/bstr.h"
+#include "misc/name_index.h"
 #include "misc/node.h"
 #include "common/common.h"
 #include "common/msg.h"
@@ -68,13 +70,21 @@ static bool apply_flag(struct mp_cmd *cmd, bstr str)
     return false;
 }
 
-static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
+// Maps command names to mp_cmds entries. Built on first use, and never freed
+// on purpose: like mp_cmds itself it is process-wide, and with libmpv there
+// is no point at which all users are known to be gone. Its size is fixed.
+static pthread_once_t cmd_index_once = PTHREAD_ONCE_INIT;
+static struct mp_name_index *cmd_index;
+
+static void init_cmd_index(void)
 {
-    if (name.len == 0) {
-        mp_err(log, "Command name missing.\n");
-        return false;
-    }
+    cmd_index = mp_name_index_create(NULL);
+    for (int n = 0; mp_cmds[n].name; n++)
+        mp_name_index_add(cmd_index, mp_cmds[n].name, (void *)&mp_cmds[n]);
+}
 
+const struct mp_cmd_def *mp_find_cmd_def(bstr name)
+{
     char nname[80];
     snprintf(nname, sizeof(nname), "%.*s", BSTR_P(name));
     for (int n = 0; nname[n]; n++) {
@@ -82,12 +92,22 @@ static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
             nname[n] = '-';
     }
 
-    for (int n = 0; mp_cmds[n].name; n++) {
-        if (strcmp(nname, mp_cmds[n].name) == 0) {
-            cmd->def = &mp_cmds[n];
-            cmd->name = (char *)cmd->def->name;
-            return true;
-        }
+    pthread_once(&cmd_index_once, init_cmd_index);
+    return mp_name_index_get(cmd_index, bstr0(nname));
+}
+
+static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
+{
+    if (name.len == 0) {
+        mp_err(log, "Command name missing.\n");
+        return false;
+    }
+
+    const struct mp_cmd_def *def = mp_find_cmd_def(name);
+    if (def) {
+        cmd->def = def;
+        cmd->name = (char *)cmd->def->name;
+        return true;
     }
     mp_err(log, "Command '%.*s' not found.\n", BSTR_P(name));
     return false;
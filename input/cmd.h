@@ -128,6 +128,10 @@ bool mp_input_is_scalable_cmd(struct mp_cmd *cmd);
 
 void mp_print_cmd_list(struct mp_log *out);
 
+// Return the mp_cmds entry with the given name ('_' is treated as '-'), or
+// NULL if there is none.
+const struct mp_cmd_def *mp_find_cmd_def(bstr name);
+
 // Parse text and return corresponding struct mp_cmd.
 // The location parameter is for error messages.
 struct mp_cmd *mp_input_parse_cmd_str(struct mp_log *log, bstr str,
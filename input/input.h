@@ -227,13 +227,60 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
                               int out_fd[2]);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
+// Wire format of an IPC connection. Always starts as MP_IPC_JSON, and can be
+// switched by the client with the "set_encoding" command.
+enum {
+    MP_IPC_JSON,        // newline-separated JSON (or text commands)
+    MP_IPC_MSGPACK,     // concatenated MessagePack maps
+};
+
 // Serialize the given mpv_event structure to JSON. Returns an allocated string.
 struct mpv_event;
 char *mp_json_encode_event(struct mpv_event *event);
 
+// Serialize the given mpv_event structure with the given MP_IPC_* encoding.
+// Returns a buffer allocated under ta_parent ({0} on error). JSON output
+// is 0-terminated.
+bstr mp_ipc_encode_event(void *ta_parent, struct mpv_event *event, int encoding);
+
 // Given the raw IPC input buffer "buf", remove the first newline-separated
 // command, execute it and return the result (if any) as an allocated string.
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Per-connection state of an IPC client: the wire format (which the client can
+// change with the "set_encoding" command), how much of an incomplete
+// MessagePack message was already checked, and requests whose replies are
+// still pending. If defer is set, requests that need the core are made with
+// the async client API, and their replies are formatted when the client API
+// returns them (with mp_ipc_conn_encode_event()). This allows serving many
+// clients from a single thread.
+struct mp_ipc_conn;
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent, bool defer);
+
+// Whether a deferred request, which was synchronous for the client, is still
+// running. No further messages are consumed until its reply was encoded, so
+// that the replies are in the same order as the requests.
+bool mp_ipc_conn_busy(struct mp_ipc_conn *conn);
+
+// Number of requests whose replies are pending (including async commands).
+int mp_ipc_conn_pending(struct mp_ipc_conn *conn);
+
+// Like mp_ipc_encode_event() with the connection's encoding, but replies to
+// deferred requests are formatted like the reply to the original request.
+// Returns false on error. Otherwise, *out is allocated under ta_parent, and
+// can be empty if nothing is to be sent.
+bool mp_ipc_conn_encode_event(struct mp_ipc_conn *conn, void *ta_parent,
+                              struct mpv_event *event, bstr *out);
+
+// Like mp_ipc_consume_next_command(), but for the connection's current
+// encoding. Returns false (and leaves buf alone) if buf contains no complete
+// message, or if conn is busy. Otherwise, buf is replaced by a new allocation
+// (talloc parent NULL) with the rest of the data, and *reply is set to the
+// encoded reply, allocated under ta_parent (len 0 if there is none, or if it's
+// deferred). If conn is NULL, only JSON is supported.
+bool mp_ipc_consume_next_message(struct mpv_handle *client, void *ta_parent,
+                                 struct mp_ipc_conn *conn, bstr *buf,
+                                 bstr *reply);
+
 #endif /* MPLAYER_INPUT_H */
@@ -28,12 +28,14 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "input/input.h"
 #include "libmpv/client.h"
 #include "options/m_config.h"
@@ -52,6 +54,9 @@ struct mp_ipc_ctx {
 
     pthread_t thread;
     int death_pipe[2];
+
+    // If not NULL, ipc_thread() runs this instead of starting client threads.
+    struct poll_server *poll_server;
 };
 
 struct client_arg {
@@ -63,11 +68,11 @@ struct client_arg {
     bool close_client_fd;
 
     bool writable;
+    struct mp_ipc_conn *conn;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static int ipc_write(struct client_arg *client, const char *buf, size_t count)
 {
-    size_t count = strlen(buf);
     while (count > 0) {
         ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
         if (rc <= 0) {
@@ -147,14 +152,16 @@ static void *client_thread(void *p)
                 if (!arg->writable)
                     continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
+                bstr event_msg;
+                if (!mp_ipc_conn_encode_event(arg->conn, NULL, event,
+                                              &event_msg))
+                {
                     MP_ERR(arg, "Encoding error\n");
                     goto done;
                 }
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                rc = ipc_write(arg, event_msg.start, event_msg.len);
+                talloc_free(event_msg.start);
                 if (rc < 0) {
                     MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
                     goto done;
@@ -185,20 +192,21 @@ static void *client_thread(void *p)
 
                 bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
+                bstr reply_msg;
+                while (mp_ipc_consume_next_message(arg->client, NULL,
+                                                   arg->conn, &client_msg,
+                                                   &reply_msg))
+                {
+                    if (reply_msg.len && arg->writable) {
+                        rc = ipc_write(arg, reply_msg.start, reply_msg.len);
                         if (rc < 0) {
                             MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
+                            talloc_free(reply_msg.start);
                             goto done;
                         }
                     }
 
-                    talloc_free(reply_msg);
+                    talloc_free(reply_msg.start);
                 }
             }
         }
@@ -224,6 +232,7 @@ static bool ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client,
         goto err;
 
     client->log = mp_client_get_log(client->client);
+    client->conn = mp_ipc_conn_create(client, false);
 
     pthread_t client_thr;
     if (pthread_create(&client_thr, NULL, client_thread, client))
@@ -285,6 +294,448 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
     return true;
 }
 
+// --input-ipc-server-mode=poll: all clients connected to the server socket are
+// handled by a single thread with non-blocking I/O. Output that the client
+// doesn't read is buffered up to ipc_output_limit per client; after that,
+// events are left in the client API's queue or the client is disconnected, and
+// no further commands are read from it until the buffer drains. Requests that
+// need the core are made with the async client API (see mp_ipc_conn), so a
+// slow command only delays further requests from the same client.
+
+enum {
+    OVERFLOW_DROP,
+    OVERFLOW_DISCONNECT,
+};
+
+struct poll_server {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_client_api *client_api;
+    size_t output_limit;
+    int overflow;
+
+    int death_fd;       // -1 after the server socket was closed
+    int listen_fd;      // -1 after the server socket was closed
+    int wakeup_pipe[2];
+    int client_num;
+
+    struct poll_client **clients;
+    int num_clients;
+    struct pollfd *fds;
+};
+
+struct poll_client {
+    struct poll_server *srv;
+    struct mp_log *log;
+    struct mpv_handle *client;
+    struct mp_ipc_conn *conn;
+    int fd;
+    bool dead;
+    bool eof;           // client closed the connection, input still processed
+    bool hup;           // POLLHUP was reported
+    bool stalled;       // output buffer full, not reading events
+
+    atomic_bool wakeup;
+
+    bstr in;            // received, but not yet processed data
+    bstr out;           // data to send, starting at out_pos
+    size_t out_pos;
+
+    // Statistics
+    struct stats_ctx *stats;
+    uint64_t bytes_in, bytes_out;
+    uint64_t commands, events, stalls;
+    size_t out_max;
+};
+
+static struct poll_server *poll_server_create(struct mp_client_api *client_api,
+                                              struct mpv_global *global,
+                                              struct MPOpts *opts)
+{
+    struct poll_server *srv = talloc_ptrtype(NULL, srv);
+    *srv = (struct poll_server){
+        .log = mp_log_new(srv, global->log, "ipc"),
+        .global = global,
+        .client_api = client_api,
+        .output_limit = opts->ipc_output_limit,
+        .overflow = opts->ipc_overflow,
+        .death_fd = -1,
+        .listen_fd = -1,
+    };
+    if (mp_make_wakeup_pipe(srv->wakeup_pipe) < 0) {
+        talloc_free(srv);
+        return NULL;
+    }
+    return srv;
+}
+
+static void poll_server_free(struct poll_server *srv)
+{
+    if (srv->listen_fd >= 0)
+        close(srv->listen_fd);
+    close(srv->wakeup_pipe[0]);
+    close(srv->wakeup_pipe[1]);
+    talloc_free(srv);
+}
+
+static void poll_client_wakeup(void *p)
+{
+    struct poll_client *c = p;
+    atomic_store(&c->wakeup, true);
+    (void)write(c->srv->wakeup_pipe[1], &(char){0}, 1);
+}
+
+static size_t poll_client_pending(struct poll_client *c)
+{
+    return c->out.len - c->out_pos;
+}
+
+// Replies are never dropped, so stop reading commands while the client doesn't
+// read them. This leaves the data in the socket buffer, which eventually blocks
+// the client's writes. The same applies while a command is running, except
+// that some input is buffered.
+static bool poll_client_reading(struct poll_client *c)
+{
+    size_t limit = c->srv->output_limit;
+    return !c->dead && !c->eof && poll_client_pending(c) < limit &&
+           (c->in.len < limit || !mp_ipc_conn_busy(c->conn));
+}
+
+static void poll_client_update_stats(struct poll_client *c)
+{
+    stats_size_value(c->stats, "bytes-in", c->bytes_in);
+    stats_size_value(c->stats, "bytes-out", c->bytes_out);
+    stats_size_value(c->stats, "buffered-out", poll_client_pending(c));
+    stats_size_value(c->stats, "buffered-out-max", c->out_max);
+    stats_value(c->stats, "commands", c->commands);
+    stats_value(c->stats, "events", c->events);
+    stats_value(c->stats, "stalls", c->stalls);
+    stats_value(c->stats, "pending-requests", mp_ipc_conn_pending(c->conn));
+}
+
+static void poll_client_flush(struct poll_client *c)
+{
+    while (!c->dead && poll_client_pending(c)) {
+        ssize_t rc = send(c->fd, c->out.start + c->out_pos,
+                          poll_client_pending(c), MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(c, "Write error (%s)\n", mp_strerror(errno));
+            c->dead = true;
+            return;
+        }
+        c->out_pos += rc;
+        c->bytes_out += rc;
+    }
+
+    if (c->out_pos == c->out.len) {
+        c->out.len = c->out_pos = 0;
+    } else if (c->out_pos > c->out.len / 2) {
+        c->out.len -= c->out_pos;
+        memmove(c->out.start, c->out.start + c->out_pos, c->out.len);
+        c->out_pos = 0;
+    }
+
+    if (c->stalled && poll_client_pending(c) < c->srv->output_limit) {
+        MP_VERBOSE(c, "Output buffer drained, reading events again.\n");
+        c->stalled = false;
+        // Pick up whatever the client API queued in the meantime.
+        poll_client_wakeup(c);
+    }
+}
+
+static void poll_client_write(struct poll_client *c, bstr msg)
+{
+    bstr_xappend(c, &c->out, msg);
+    c->out_max = MPMAX(c->out_max, poll_client_pending(c));
+}
+
+static bool poll_client_overflow(struct poll_client *c)
+{
+    if (poll_client_pending(c) < c->srv->output_limit)
+        return false;
+
+    // Maybe the client is reading, and we just didn't send anything yet.
+    poll_client_flush(c);
+    if (c->dead || poll_client_pending(c) < c->srv->output_limit)
+        return c->dead;
+
+    if (c->srv->overflow == OVERFLOW_DISCONNECT) {
+        MP_WARN(c, "Output buffer full, disconnecting client.\n");
+        c->dead = true;
+    } else if (!c->stalled) {
+        MP_WARN(c, "Output buffer full, not reading events.\n");
+        c->stalled = true;
+        c->stalls++;
+    }
+    return true;
+}
+
+// Execute all complete messages in c->in, until a command needs to wait for
+// its reply.
+static void poll_client_process(struct poll_client *c)
+{
+    bstr reply_msg;
+    while (!c->dead &&
+           mp_ipc_consume_next_message(c->client, NULL, c->conn, &c->in,
+                                       &reply_msg))
+    {
+        talloc_steal(c, c->in.start);
+        c->commands++;
+
+        if (reply_msg.len) {
+            // Replies are never dropped.
+            if (c->srv->overflow != OVERFLOW_DISCONNECT ||
+                !poll_client_overflow(c))
+                poll_client_write(c, reply_msg);
+        }
+
+        talloc_free(reply_msg.start);
+    }
+
+    if (c->eof && !mp_ipc_conn_busy(c->conn))
+        c->dead = true;
+}
+
+static void poll_client_events(struct poll_client *c)
+{
+    // With a full buffer, leave the events to the client API: it coalesces
+    // property changes (so the client gets the latest value once it catches
+    // up), and drops other events with a MPV_EVENT_QUEUE_OVERFLOW notification.
+    while (!c->dead && !poll_client_overflow(c)) {
+        mpv_event *event = mpv_wait_event(c->client, 0);
+
+        if (event->event_id == MPV_EVENT_NONE)
+            break;
+
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            c->dead = true;
+            break;
+        }
+
+        bstr event_msg;
+        if (!mp_ipc_conn_encode_event(c->conn, NULL, event, &event_msg)) {
+            MP_ERR(c, "Encoding error\n");
+            c->dead = true;
+            break;
+        }
+
+        poll_client_write(c, event_msg);
+        talloc_free(event_msg.start);
+        c->events++;
+    }
+
+    // Continue with the input that waited for a reply.
+    poll_client_process(c);
+
+    poll_client_flush(c);
+    poll_client_update_stats(c);
+}
+
+static void poll_client_read(struct poll_client *c)
+{
+    while (poll_client_reading(c)) {
+        char buf[4096];
+        ssize_t bytes = read(c->fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(c, "Read error (%s)\n", mp_strerror(errno));
+            c->dead = true;
+            break;
+        }
+
+        if (bytes == 0) {
+            // Commands sent before closing the connection are still run.
+            MP_VERBOSE(c, "Client disconnected\n");
+            c->eof = true;
+        } else {
+            c->bytes_in += bytes;
+            bstr_xappend(c, &c->in, (bstr){buf, bytes});
+        }
+
+        poll_client_process(c);
+    }
+
+    poll_client_flush(c);
+    poll_client_update_stats(c);
+}
+
+static void poll_add_client(struct poll_server *srv, int fd)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "ipc-%d", srv->client_num++);
+
+    struct mpv_handle *h = mp_new_client(srv->client_api, name);
+    if (!h) {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct poll_client *c = talloc_ptrtype(srv, c);
+    *c = (struct poll_client){
+        .srv = srv,
+        .log = mp_client_get_log(h),
+        .client = h,
+        .fd = fd,
+    };
+    c->conn = mp_ipc_conn_create(c, true);
+    c->stats = stats_ctx_create(c, srv->global, mp_tprintf(80, "ipc/%s", name));
+    atomic_init(&c->wakeup, false);
+    MP_TARRAY_APPEND(srv, srv->clients, srv->num_clients, c);
+
+    MP_VERBOSE(c, "Client connected\n");
+
+    // Also triggers the first wakeup.
+    mpv_set_wakeup_callback(h, poll_client_wakeup, c);
+}
+
+static void *poll_destroy_thread(void *p)
+{
+    mpthread_set_name("ipc destroy");
+    mpv_destroy(p);
+    return NULL;
+}
+
+static void poll_destroy_client(struct poll_client *c)
+{
+    if (c->in.len > 0)
+        MP_WARN(c, "Ignoring unterminated command on disconnect.\n");
+    MP_VERBOSE(c, "Received %"PRIu64" bytes, %"PRIu64" commands. Sent %"PRIu64
+               " bytes, %"PRIu64" events. Output buffer was full %"PRIu64
+               " times, maximum buffered output: %zu bytes.\n", c->bytes_in,
+               c->commands, c->bytes_out, c->events, c->stalls, c->out_max);
+
+    // No more wakeup callbacks after this.
+    mpv_set_wakeup_callback(c->client, NULL, NULL);
+    // mpv_destroy() waits for the replies to all async requests, which must not
+    // hold up the other clients.
+    pthread_t thr;
+    if (mp_ipc_conn_pending(c->conn) &&
+        !pthread_create(&thr, NULL, poll_destroy_thread, c->client))
+    {
+        pthread_detach(thr);
+    } else {
+        mpv_destroy(c->client);
+    }
+    close(c->fd);
+    talloc_free(c);
+}
+
+static void poll_accept(struct poll_server *srv)
+{
+    while (1) {
+        int client_fd = accept(srv->listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                MP_ERR(srv, "Could not accept IPC client\n");
+            break;
+        }
+        poll_add_client(srv, client_fd);
+    }
+}
+
+static void *poll_server_thread(void *p)
+{
+    struct poll_server *srv = p;
+
+    mpthread_set_name("ipc server");
+
+    // See client_thread().
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    while (srv->listen_fd >= 0 || srv->num_clients) {
+        // Fixed entries, followed by one entry per client.
+        int num_clients = srv->num_clients;
+        MP_TARRAY_GROW(srv, srv->fds, 3 + num_clients);
+        struct pollfd *fds = srv->fds;
+        fds[0] = (struct pollfd){ .events = POLLIN, .fd = srv->death_fd };
+        fds[1] = (struct pollfd){ .events = POLLIN, .fd = srv->wakeup_pipe[0] };
+        fds[2] = (struct pollfd){ .events = POLLIN, .fd = srv->listen_fd };
+        for (int n = 0; n < num_clients; n++) {
+            struct poll_client *c = srv->clients[n];
+            bool reading = poll_client_reading(c);
+            bool writing = poll_client_pending(c);
+            fds[3 + n] = (struct pollfd){
+                .events = (reading ? POLLIN : 0) | (writing ? POLLOUT : 0),
+                // POLLHUP can't be masked, so ignore the socket until there's
+                // something to do, instead of waking up continuously.
+                .fd = reading || writing || !c->hup ? c->fd : -1,
+            };
+        }
+
+        if (poll(fds, 3 + num_clients, -1) < 0) {
+            if (errno != EINTR)
+                MP_ERR(srv, "Poll error\n");
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            close(srv->listen_fd);
+            srv->listen_fd = srv->death_fd = -1;
+            // Existing clients stay connected until they disconnect, or
+            // until the player shuts down, like in the threaded mode. Keep
+            // serving them on a detached thread, because the caller of
+            // mp_uninit_ipc() might be the core thread, which must be
+            // running for mpv_destroy() to return.
+            if (srv->num_clients) {
+                pthread_t thr;
+                if (!pthread_create(&thr, NULL, poll_server_thread, srv)) {
+                    pthread_detach(thr);
+                    return NULL;
+                }
+            }
+            for (int n = 0; n < srv->num_clients; n++)
+                srv->clients[n]->dead = true;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            mp_flush_wakeup_pipe(srv->wakeup_pipe[0]);
+            for (int n = 0; n < srv->num_clients; n++) {
+                struct poll_client *c = srv->clients[n];
+                if (atomic_exchange(&c->wakeup, false))
+                    poll_client_events(c);
+            }
+        }
+
+        if (fds[2].revents & POLLIN)
+            poll_accept(srv);
+
+        for (int n = 0; n < num_clients; n++) {
+            struct poll_client *c = srv->clients[n];
+            int revents = fds[3 + n].revents;
+            if (revents & (POLLHUP | POLLERR))
+                c->hup = true;
+            if (revents & POLLOUT)
+                poll_client_flush(c);
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                poll_client_read(c);
+        }
+
+        for (int n = srv->num_clients - 1; n >= 0; n--) {
+            struct poll_client *c = srv->clients[n];
+            if (c->dead) {
+                MP_TARRAY_REMOVE_AT(srv->clients, srv->num_clients, n);
+                poll_destroy_client(c);
+            }
+        }
+    }
+
+    poll_server_free(srv);
+    return NULL;
+}
+
 static void *ipc_thread(void *p)
 {
     int rc;
@@ -337,6 +788,16 @@ static void *ipc_thread(void *p)
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
 
+    if (arg->poll_server) {
+        struct poll_server *srv = arg->poll_server;
+        arg->poll_server = NULL;
+        fcntl(ipc_fd, F_SETFL, fcntl(ipc_fd, F_GETFL, 0) | O_NONBLOCK);
+        srv->listen_fd = ipc_fd;
+        srv->death_fd = arg->death_pipe[0];
+        // Owns srv and ipc_fd now.
+        return poll_server_thread(srv);
+    }
+
     int client_num = 0;
 
     struct pollfd fds[2] = {
@@ -369,6 +830,11 @@ done:
     if (ipc_fd >= 0)
         close(ipc_fd);
 
+    if (arg->poll_server) {
+        poll_server_free(arg->poll_server);
+        arg->poll_server = NULL;
+    }
+
     return NULL;
 }
 
@@ -400,6 +866,12 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         }
     }
 
+    if (arg->path && arg->path[0] && opts->ipc_server_mode == 1) {
+        arg->poll_server = poll_server_create(client_api, global, opts);
+        if (!arg->poll_server)
+            MP_ERR(arg, "Could not create IPC server, using threads.\n");
+    }
+
     talloc_free(opts);
 
     if (!arg->path || !arg->path[0])
@@ -414,6 +886,8 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
+    if (arg->poll_server)
+        poll_server_free(arg->poll_server);
     if (arg->death_pipe[0] >= 0) {
         close(arg->death_pipe[0]);
         close(arg->death_pipe[1]);
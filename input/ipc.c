@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "misc/node.h"
 #include "options/m_option.h"
 #include "options/options.h"
@@ -89,58 +90,231 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+static bstr encode_node(void *ta_parent, mpv_node *node, int encoding)
+{
+    bstr output = {0};
+    if (encoding == MP_IPC_MSGPACK) {
+        if (msgpack_write(ta_parent, &output, node) < 0) {
+            talloc_free(output.start);
+            output = (bstr){0};
+        }
+    } else {
+        char *str = talloc_strdup(ta_parent, "");
+        json_write(&str, node);
+        output = bstr0(ta_talloc_strdup_append(str, "\n"));
+    }
+    return output;
+}
+
+bstr mp_ipc_encode_event(void *ta_parent, mpv_event *event, int encoding)
 {
-    void *ta_parent = talloc_new(NULL);
+    void *tmp = talloc_new(NULL);
 
     struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
         event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        mpv_format_command_reply(tmp, event, &event_node);
     } else {
         mpv_event_to_node(&event_node, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(tmp, node_get_alloc(&event_node));
     }
 
-    char *output = talloc_strdup(NULL, "");
-    json_write(&output, &event_node);
-    output = ta_talloc_strdup_append(output, "\n");
+    bstr output = encode_node(ta_parent, &event_node, encoding);
 
-    talloc_free(ta_parent);
+    talloc_free(tmp);
 
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+char *mp_json_encode_event(mpv_event *event)
+{
+    return mp_ipc_encode_event(NULL, event, MP_IPC_JSON).start;
+}
+
+// Requests made through the async client API, whose replies are formatted
+// when the client API returns them (see mp_ipc_conn_encode_event()).
+enum {
+    REQ_COMMAND,
+    REQ_TEXT_COMMAND,           // no reply is sent
+    REQ_GET_PROPERTY,           // also get_properties
+    REQ_GET_PROPERTY_STRING,
+    REQ_SET_PROPERTY,           // also set_properties
+};
+
+struct ipc_request {
+    uint64_t id;                // reply_userdata
+    int type;                   // REQ_*
+    bool blocking;              // no further input is processed until done
+    mpv_node reqid;             // "request_id" field, or MPV_FORMAT_NONE
+};
+
+struct mp_ipc_conn {
+    int encoding;               // MP_IPC_*
+    struct msgpack_scan scan;
+    bool defer;
+    uint64_t next_id;
+    struct ipc_request **requests;
+    int num_requests;
+};
+
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent, bool defer)
+{
+    struct mp_ipc_conn *conn = talloc_ptrtype(ta_parent, conn);
+    *conn = (struct mp_ipc_conn){
+        .encoding = MP_IPC_JSON,
+        .defer = defer,
+    };
+    return conn;
+}
+
+bool mp_ipc_conn_busy(struct mp_ipc_conn *conn)
+{
+    for (int n = 0; n < conn->num_requests; n++) {
+        if (conn->requests[n]->blocking)
+            return true;
+    }
+    return false;
+}
+
+int mp_ipc_conn_pending(struct mp_ipc_conn *conn)
+{
+    return conn->num_requests;
+}
+
+// Call after an async client API call with conn->next_id as reply_userdata,
+// which returned rc. Returns whether the reply is deferred to the event.
+static bool defer_request(struct mp_ipc_conn *conn, int rc, int type,
+                          mpv_node *reqid_node, bool blocking)
+{
+    if (rc < 0)
+        return false;
+
+    struct ipc_request *req = talloc_ptrtype(conn, req);
+    *req = (struct ipc_request){
+        .id = conn->next_id++,
+        .type = type,
+        .blocking = blocking,
+        .reqid = {.format = MPV_FORMAT_NONE},
+    };
+    if (reqid_node) {
+        static const struct m_option type_node = { .type = CONF_TYPE_NODE };
+        m_option_get_node(&type_node, req, &req->reqid, reqid_node);
+    }
+    MP_TARRAY_APPEND(conn, conn->requests, conn->num_requests, req);
+    return true;
+}
+
+static void add_reply_status(void *ta_parent, mpv_node *reply_node,
+                             mpv_node *reqid_node, int rc)
+{
+    /* If the request contains a "request_id", copy it back into the response.
+     * This makes it easier on the requester to match up the IPC results with
+     * the original requests.
+     */
+    if (reqid_node) {
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
+    } else {
+        mpv_node_map_add_int64(ta_parent, reply_node, "request_id", 0);
+    }
+
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+static struct ipc_request *remove_request(struct mp_ipc_conn *conn,
+                                          mpv_event *event)
+{
+    if (event->event_id != MPV_EVENT_COMMAND_REPLY &&
+        event->event_id != MPV_EVENT_GET_PROPERTY_REPLY &&
+        event->event_id != MPV_EVENT_SET_PROPERTY_REPLY)
+        return NULL;
+
+    for (int n = 0; n < conn->num_requests; n++) {
+        struct ipc_request *req = conn->requests[n];
+        if (req->id == event->reply_userdata) {
+            MP_TARRAY_REMOVE_AT(conn->requests, conn->num_requests, n);
+            return req;
+        }
+    }
+    return NULL;
+}
+
+bool mp_ipc_conn_encode_event(struct mp_ipc_conn *conn, void *ta_parent,
+                              mpv_event *event, bstr *out)
+{
+    struct ipc_request *req = remove_request(conn, event);
+    if (!req) {
+        *out = mp_ipc_encode_event(ta_parent, event, conn->encoding);
+        return out->start;
+    }
+
+    *out = (bstr){0};
+    if (req->type == REQ_TEXT_COMMAND) {
+        talloc_free(req);
+        return true;
+    }
+
+    void *tmp = talloc_new(NULL);
+
+    // Same as the replies in execute_command().
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    int rc = event->error;
+    if (req->type == REQ_COMMAND) {
+        mpv_event_command *cmd = event->data;
+        // Async commands always had a "data" field.
+        if (rc >= 0 || !req->blocking)
+            mpv_node_map_add(tmp, &reply_node, "data", &cmd->result);
+    } else if (req->type == REQ_GET_PROPERTY) {
+        mpv_event_property *prop = event->data;
+        if (rc >= 0 && prop->format == MPV_FORMAT_NODE)
+            mpv_node_map_add(tmp, &reply_node, "data", prop->data);
+    } else if (req->type == REQ_GET_PROPERTY_STRING) {
+        mpv_event_property *prop = event->data;
+        if (rc >= 0 && prop->format == MPV_FORMAT_STRING) {
+            mpv_node_map_add_string(tmp, &reply_node, "data",
+                                    *(char **)prop->data);
+        } else {
+            mpv_node_map_add_null(tmp, &reply_node, "data");
+        }
+    }
+    add_reply_status(tmp, &reply_node,
+                     req->reqid.format != MPV_FORMAT_NONE ? &req->reqid : NULL,
+                     rc);
+
+    *out = encode_node(ta_parent, &reply_node, conn->encoding);
+
+    talloc_free(tmp);
+    talloc_free(req);
+    return out->start;
+}
+
+// Execute the request in msg_node (NULL if it couldn't be parsed), and set
+// *reply_node to the reply. Returns false if no reply is to be sent (yet).
+// conn is NULL if the caller supports neither "set_encoding" nor deferred
+// replies.
+static bool execute_command(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg_node, struct mp_ipc_conn *conn,
+                            mpv_node *reply_node)
 {
     int rc;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
+    bool defer = conn && conn->defer;
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
     mpv_node *async_node = NULL;
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
+    *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    async_node = node_map_get(&msg_node, "async");
+    async_node = node_map_get(msg_node, "async");
     if (async_node) {
         if (async_node->format != MPV_FORMAT_FLAG) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -149,7 +323,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         async = async_node->u.flag;
     }
 
-    reqid_node = node_map_get(&msg_node, "request_id");
+    reqid_node = node_map_get(msg_node, "request_id");
     if (reqid_node) {
         if (reqid_node->format == MPV_FORMAT_INT64) {
             reqid = reqid_node->u.int64;
@@ -163,7 +337,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         }
     }
 
-    mpv_node *cmd_node = node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = node_map_get(msg_node, "command");
     if (!cmd_node) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
@@ -181,15 +355,15 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (cmd && !strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -204,11 +378,18 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
-                              MPV_FORMAT_NODE, &result_node);
-        if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
-            mpv_free_node_contents(&result_node);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (defer) {
+            rc = mpv_get_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_NODE);
+            send_reply = !defer_request(conn, rc, REQ_GET_PROPERTY,
+                                        reqid_node, true);
+        } else {
+            rc = mpv_get_property(client, name, MPV_FORMAT_NODE, &result_node);
+            if (rc >= 0) {
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+                mpv_free_node_contents(&result_node);
+            }
         }
     } else if (cmd && !strcmp("get_property_string", cmd)) {
         if (cmd_node->u.list->num != 2) {
@@ -221,13 +402,20 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        char *result = mpv_get_property_string(client,
-                                        cmd_node->u.list->values[1].u.string);
-        if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
-            mpv_free(result);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (defer) {
+            rc = mpv_get_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_STRING);
+            send_reply = !defer_request(conn, rc, REQ_GET_PROPERTY_STRING,
+                                        reqid_node, true);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            char *result = mpv_get_property_string(client, name);
+            if (result) {
+                mpv_node_map_add_string(ta_parent, reply_node, "data", result);
+                mpv_free(result);
+            } else {
+                mpv_node_map_add_null(ta_parent, reply_node, "data");
+            }
         }
     } else if (cmd && (!strcmp("set_property", cmd) ||
                        !strcmp("set_property_string", cmd)))
@@ -242,8 +430,60 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_set_property(client, cmd_node->u.list->values[1].u.string,
-                              MPV_FORMAT_NODE, &cmd_node->u.list->values[2]);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        mpv_node *value = &cmd_node->u.list->values[2];
+        if (defer) {
+            rc = mpv_set_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_NODE, value);
+            send_reply = !defer_request(conn, rc, REQ_SET_PROPERTY,
+                                        reqid_node, true);
+        } else {
+            rc = mpv_set_property(client, name, MPV_FORMAT_NODE, value);
+        }
+    } else if (cmd && !strcmp("get_properties", cmd)) {
+        mpv_node result_node;
+        struct mpv_node_list *args = cmd_node->u.list;
+
+        const char **names = talloc_zero_array(ta_parent, const char *,
+                                               args->num);
+        for (int n = 1; n < args->num; n++) {
+            if (args->values[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n - 1] = args->values[n].u.string;
+        }
+
+        if (defer) {
+            rc = mpv_get_properties_async(client, conn->next_id, names);
+            send_reply = !defer_request(conn, rc, REQ_GET_PROPERTY,
+                                        reqid_node, true);
+        } else {
+            rc = mpv_get_properties(client, names, &result_node);
+            if (rc >= 0) {
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+                mpv_free_node_contents(&result_node);
+            }
+        }
+    } else if (cmd && !strcmp("set_properties", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_NODE_MAP) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        mpv_node *props = &cmd_node->u.list->values[1];
+        if (defer) {
+            rc = mpv_set_properties_async(client, conn->next_id, props);
+            send_reply = !defer_request(conn, rc, REQ_SET_PROPERTY,
+                                        reqid_node, true);
+        } else {
+            rc = mpv_set_properties(client, props);
+        }
     } else if (cmd && !strcmp("observe_property", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -343,38 +583,79 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             }
             rc = mpv_request_event(client, event, enable);
         }
+    } else if (cmd && !strcmp("set_encoding", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (!conn) {
+            rc = MPV_ERROR_NOT_IMPLEMENTED;
+            goto error;
+        }
+
+        char *name = cmd_node->u.list->values[1].u.string;
+        if (strcmp(name, "json") == 0) {
+            conn->encoding = MP_IPC_JSON;
+        } else if (strcmp(name, "msgpack") == 0) {
+            conn->encoding = MP_IPC_MSGPACK;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+        // The reply is still sent with the old encoding.
+        rc = MPV_ERROR_SUCCESS;
     } else {
         mpv_node result_node = {0};
 
-        if (async) {
+        if (defer) {
+            // Non-async commands still block the rest of the input, so that
+            // the client sees the same ordering as with a thread per client.
+            rc = mpv_command_node_async(client, conn->next_id, cmd_node);
+            send_reply = !defer_request(conn, rc, REQ_COMMAND, reqid_node,
+                                        !async);
+        } else if (async) {
             rc = mpv_command_node_async(client, reqid, cmd_node);
             if (rc >= 0)
                 send_reply = false;
         } else {
             rc = mpv_command_node(client, cmd_node, &result_node);
             if (rc >= 0)
-                mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
         }
 
         mpv_free_node_contents(&result_node);
     }
 
 error:
-    /* If the request contains a "request_id", copy it back into the response.
-     * This makes it easier on the requester to match up the IPC results with
-     * the original requests.
-     */
-    if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
-    } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
-    }
+    if (send_reply)
+        add_reply_status(ta_parent, reply_node, reqid_node, rc);
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    return send_reply;
+}
+
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                  char *src, struct mp_ipc_conn *conn)
+{
+    mpv_node msg_node;
+    bool ok = json_parse(ta_parent, &msg_node, &src, 50) >= 0;
+    if (!ok) {
+        mp_err(mp_client_get_log(client), "malformed JSON received: '%s'\n",
+               src);
+    }
 
     char *output = talloc_strdup(ta_parent, "");
 
-    if (send_reply) {
+    mpv_node reply_node;
+    if (execute_command(client, ta_parent, ok ? &msg_node : NULL, conn,
+                        &reply_node))
+    {
         json_write(&output, &reply_node);
         output = ta_talloc_strdup_append(output, "\n");
     }
@@ -382,15 +663,63 @@ error:
     return output;
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static char *text_execute_command(struct mpv_handle *client, void *tmp,
+                                  char *src, struct mp_ipc_conn *conn)
 {
-    mpv_command_string(client, src);
+    if (conn && conn->defer) {
+        int rc = mp_client_command_string_async(client, conn->next_id, src);
+        defer_request(conn, rc, REQ_TEXT_COMMAND, NULL, true);
+    } else {
+        mpv_command_string(client, src);
+    }
 
     return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+bool mp_ipc_consume_next_message(struct mpv_handle *client, void *ta_parent,
+                                 struct mp_ipc_conn *conn, bstr *buf,
+                                 bstr *reply)
 {
+    *reply = (bstr){0};
+
+    if (conn && mp_ipc_conn_busy(conn))
+        return false;
+
+    if (conn && conn->encoding == MP_IPC_MSGPACK) {
+        // Parsing an incomplete message again on every read would be
+        // quadratic, so only continue checking whether it's complete.
+        int r = msgpack_scan(&conn->scan, *buf, 50);
+        if (r == 0)
+            return false;
+        conn->scan = (struct msgpack_scan){0};
+
+        void *tmp = talloc_new(NULL);
+
+        mpv_node msg_node;
+        bstr rest = *buf;
+        if (r > 0)
+            r = msgpack_parse(tmp, &msg_node, &rest, 50);
+        if (r <= 0) {
+            // There's no way to find the start of the next message.
+            mp_err(mp_client_get_log(client), "malformed MessagePack "
+                   "received, discarding %zu bytes\n", buf->len);
+            rest = (bstr){0};
+        }
+        talloc_steal(tmp, buf->start);
+        *buf = bstrdup(NULL, rest);
+
+        mpv_node reply_node;
+        if (execute_command(client, tmp, r > 0 ? &msg_node : NULL, conn,
+                            &reply_node))
+            msgpack_write(ta_parent, reply, &reply_node);
+
+        talloc_free(tmp);
+        return true;
+    }
+
+    if (bstrchr(*buf, '\n') < 0)
+        return false;
+
     void *tmp = talloc_new(NULL);
 
     bstr rest;
@@ -405,12 +734,20 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
     } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+        reply_msg = json_execute_command(client, tmp, line0, conn);
     } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+        reply_msg = text_execute_command(client, tmp, line0, conn);
     }
 
-    talloc_steal(ctx, reply_msg);
+    *reply = bstr0(talloc_steal(ta_parent, reply_msg));
     talloc_free(tmp);
-    return reply_msg;
+    return true;
+}
+
+char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+{
+    bstr reply = {0};
+    if (!mp_ipc_consume_next_message(client, ctx, NULL, buf, &reply))
+        return NULL;
+    return reply.start;
 }
@@ -232,7 +232,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 108)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 110)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1153,6 +1153,35 @@ int mpv_set_property_string(mpv_handle *ctx, const char *name, const char *data)
 int mpv_set_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                            const char *name, mpv_format format, void *data);
 
+/**
+ * Set multiple properties at once. This is like calling mpv_set_property()
+ * with MPV_FORMAT_NODE for each entry of the map, except that the core is
+ * locked only once for the whole batch, instead of once per property.
+ *
+ * All entries are applied in order, even if some of them fail. The first
+ * error encountered is returned.
+ *
+ * @param[in] props A MPV_FORMAT_NODE_MAP, which maps property names to the
+ *                  new values.
+ * @return error code
+ */
+int mpv_set_properties(mpv_handle *ctx, mpv_node *props);
+
+/**
+ * Set multiple properties asynchronously. You will receive a single
+ * MPV_EVENT_SET_PROPERTY_REPLY event for the whole batch. Otherwise, this
+ * function is similar to mpv_set_properties().
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param reply_userdata see section about asynchronous calls
+ * @param[in] props A MPV_FORMAT_NODE_MAP. The value will be copied by the
+ *                  function. It will never be modified by the client API.
+ * @return error code if sending the request failed
+ */
+int mpv_set_properties_async(mpv_handle *ctx, uint64_t reply_userdata,
+                             mpv_node *props);
+
 /**
  * Read the value of the given property.
  *
@@ -1213,6 +1242,39 @@ char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                            const char *name, mpv_format format);
 
+/**
+ * Read multiple properties at once. This is like calling mpv_get_property()
+ * with MPV_FORMAT_NODE for each name, except that the core is locked only once
+ * for the whole batch, so all values are from the same point in time, and
+ * the playback thread is interrupted only once.
+ *
+ * Properties which can't be read (for example because they don't exist, or
+ * are unavailable) are left out of the result.
+ *
+ * @param[in] names NULL-terminated list of property names.
+ * @param[out] result On success, set to a MPV_FORMAT_NODE_MAP, which maps the
+ *                    property names to their values. Free it with
+ *                    mpv_free_node_contents().
+ * @return error code
+ */
+int mpv_get_properties(mpv_handle *ctx, const char **names, mpv_node *result);
+
+/**
+ * Read multiple properties asynchronously. You will receive the result as a
+ * single MPV_EVENT_GET_PROPERTY_REPLY event. Its mpv_event_property has an
+ * empty name, MPV_FORMAT_NODE as format, and the data is a
+ * MPV_FORMAT_NODE_MAP as described in mpv_get_properties().
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param reply_userdata see section about asynchronous calls
+ * @param[in] names NULL-terminated list of property names. The list will be
+ *                  copied by the function.
+ * @return error code if sending the request failed
+ */
+int mpv_get_properties_async(mpv_handle *ctx, uint64_t reply_userdata,
+                             const char **names);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -1300,12 +1362,14 @@ typedef enum mpv_event_id {
      */
     MPV_EVENT_LOG_MESSAGE       = 2,
     /**
-     * Reply to a mpv_get_property_async() request.
+     * Reply to a mpv_get_property_async() or mpv_get_properties_async()
+     * request.
      * See also mpv_event and mpv_event_property.
      */
     MPV_EVENT_GET_PROPERTY_REPLY = 3,
     /**
-     * Reply to a mpv_set_property_async() request.
+     * Reply to a mpv_set_property_async() or mpv_set_properties_async()
+     * request.
      * (Unlike MPV_EVENT_GET_PROPERTY, mpv_event_property is not used.)
      */
     MPV_EVENT_SET_PROPERTY_REPLY = 4,
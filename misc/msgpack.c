@@ -0,0 +1,407 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack (https://msgpack.org/) mapped to mpv_node:
+ *
+ *  MPV_FORMAT_NONE         nil
+ *  MPV_FORMAT_FLAG         bool
+ *  MPV_FORMAT_INT64        int (smallest encoding)
+ *  MPV_FORMAT_DOUBLE       float 64 (float 32 is accepted by the parser)
+ *  MPV_FORMAT_STRING       str
+ *  MPV_FORMAT_BYTE_ARRAY   bin
+ *  MPV_FORMAT_NODE_ARRAY   array
+ *  MPV_FORMAT_NODE_MAP     map (the parser accepts only str keys)
+ *
+ * Unsigned integers above INT64_MAX are parsed as doubles. The ext types are
+ * not supported.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "common/common.h"
+
+#include "msgpack.h"
+
+static void put_be(void *ta_parent, bstr *dst, uint8_t tag, uint64_t v,
+                   int size)
+{
+    uint8_t b[9] = {tag};
+    for (int n = 0; n < size; n++)
+        b[1 + n] = v >> (8 * (size - 1 - n));
+    bstr_xappend(ta_parent, dst, (bstr){b, 1 + size});
+}
+
+// Write a length for str/bin/array/map. fix_max is the largest length which
+// fits into the fix tag (-1 if there is none), tag8 the 8 bit length tag (0
+// if there is none). The 16 and 32 bit tags follow the 8 bit one.
+static int put_len(void *ta_parent, bstr *dst, uint8_t fix, int fix_max,
+                   uint8_t tag8, uint8_t tag16, size_t len)
+{
+    if (fix_max >= 0 && len <= fix_max) {
+        put_be(ta_parent, dst, fix | len, 0, 0);
+    } else if (tag8 && len <= UINT8_MAX) {
+        put_be(ta_parent, dst, tag8, len, 1);
+    } else if (len <= UINT16_MAX) {
+        put_be(ta_parent, dst, tag16, len, 2);
+    } else if (len <= UINT32_MAX) {
+        put_be(ta_parent, dst, tag16 + 1, len, 4);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static void put_int(void *ta_parent, bstr *dst, int64_t v)
+{
+    if (v >= 0) {
+        if (v <= 0x7F) {
+            put_be(ta_parent, dst, v, 0, 0);
+        } else if (v <= UINT8_MAX) {
+            put_be(ta_parent, dst, 0xcc, v, 1);
+        } else if (v <= UINT16_MAX) {
+            put_be(ta_parent, dst, 0xcd, v, 2);
+        } else if (v <= UINT32_MAX) {
+            put_be(ta_parent, dst, 0xce, v, 4);
+        } else {
+            put_be(ta_parent, dst, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= -32) {
+            put_be(ta_parent, dst, (uint8_t)v, 0, 0);
+        } else if (v >= INT8_MIN) {
+            put_be(ta_parent, dst, 0xd0, (uint8_t)v, 1);
+        } else if (v >= INT16_MIN) {
+            put_be(ta_parent, dst, 0xd1, (uint16_t)v, 2);
+        } else if (v >= INT32_MIN) {
+            put_be(ta_parent, dst, 0xd2, (uint32_t)v, 4);
+        } else {
+            put_be(ta_parent, dst, 0xd3, v, 8);
+        }
+    }
+}
+
+int msgpack_write(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        put_be(ta_parent, dst, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        put_be(ta_parent, dst, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64:
+        put_int(ta_parent, dst, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        put_be(ta_parent, dst, 0xcb, v, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING: {
+        size_t len = strlen(src->u.string);
+        if (put_len(ta_parent, dst, 0xa0, 31, 0xd9, 0xda, len) < 0)
+            return -1;
+        bstr_xappend(ta_parent, dst, (bstr){src->u.string, len});
+        return 0;
+    }
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        if (put_len(ta_parent, dst, 0, -1, 0xc4, 0xc5, ba->size) < 0)
+            return -1;
+        bstr_xappend(ta_parent, dst, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        int r = is_map ? put_len(ta_parent, dst, 0x80, 15, 0, 0xde, list->num)
+                       : put_len(ta_parent, dst, 0x90, 15, 0, 0xdc, list->num);
+        if (r < 0)
+            return -1;
+        for (int n = 0; n < list->num; n++) {
+            if (is_map) {
+                struct mpv_node key = {
+                    .format = MPV_FORMAT_STRING,
+                    .u.string = list->keys[n],
+                };
+                if (msgpack_write(ta_parent, dst, &key) < 0)
+                    return -1;
+            }
+            if (msgpack_write(ta_parent, dst, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1;
+}
+
+// Read a big endian number of the given size. Returns 0 if src is too short.
+static int read_be(bstr *src, int size, uint64_t *v)
+{
+    if (src->len < size)
+        return 0;
+    *v = 0;
+    for (int n = 0; n < size; n++)
+        *v = (*v << 8) | src->start[n];
+    *src = bstr_cut(*src, size);
+    return 1;
+}
+
+static int parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                 int max_depth);
+
+static int parse_list(void *ta_parent, struct mpv_node *dst, bstr *src,
+                      int max_depth, bool is_map, uint64_t num)
+{
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_map) {
+            struct mpv_node key;
+            int r = parse(ta_parent, &key, src, max_depth);
+            if (r <= 0)
+                return r;
+            if (key.format != MPV_FORMAT_STRING)
+                return -1;
+            MP_TARRAY_GROW(list, list->keys, list->num);
+            list->keys[list->num] = key.u.string;
+        }
+        MP_TARRAY_GROW(list, list->values, list->num);
+        int r = parse(ta_parent, &list->values[list->num], src, max_depth);
+        if (r <= 0)
+            return r;
+        list->num++;
+    }
+    return 1;
+}
+
+static int parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                 int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    if (!src->len)
+        return 0;
+    uint8_t tag = src->start[0];
+    *src = bstr_cut(*src, 1);
+
+    uint64_t v = 0;
+    if (tag <= 0x7f || tag >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)tag;
+        return 1;
+    } else if ((tag & 0xf0) == 0x80) {
+        return parse_list(ta_parent, dst, src, max_depth, true, tag & 0x0f);
+    } else if ((tag & 0xf0) == 0x90) {
+        return parse_list(ta_parent, dst, src, max_depth, false, tag & 0x0f);
+    } else if ((tag & 0xe0) == 0xa0) {
+        v = tag & 0x1f;
+        goto str;
+    }
+
+    switch (tag) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 1;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = tag == 0xc3;
+        return 1;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (!read_be(src, 1 << (tag - 0xcc), &v))
+            return 0;
+        if (v > INT64_MAX) {
+            dst->format = MPV_FORMAT_DOUBLE;
+            dst->u.double_ = v;
+        } else {
+            dst->format = MPV_FORMAT_INT64;
+            dst->u.int64 = v;
+        }
+        return 1;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int size = 1 << (tag - 0xd0);
+        if (!read_be(src, size, &v))
+            return 0;
+        // Sign-extend.
+        int shift = 64 - size * 8;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = shift ? (int64_t)(v << shift) >> shift : (int64_t)v;
+        return 1;
+    }
+    case 0xca: {
+        if (!read_be(src, 4, &v))
+            return 0;
+        uint32_t v32 = v;
+        float f;
+        memcpy(&f, &v32, sizeof(f));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = f;
+        return 1;
+    }
+    case 0xcb:
+        if (!read_be(src, 8, &v))
+            return 0;
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &v, sizeof(v));
+        return 1;
+    case 0xd9: case 0xda: case 0xdb:
+        if (!read_be(src, 1 << (tag - 0xd9), &v))
+            return 0;
+        goto str;
+    case 0xc4: case 0xc5: case 0xc6: {
+        if (!read_be(src, 1 << (tag - 0xc4), &v))
+            return 0;
+        if (src->len < v)
+            return 0;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ta_parent, src->start, v);
+        ba->size = v;
+        *src = bstr_cut(*src, v);
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 1;
+    }
+    case 0xdc: case 0xdd:
+        if (!read_be(src, 2 << (tag - 0xdc), &v))
+            return 0;
+        return parse_list(ta_parent, dst, src, max_depth, false, v);
+    case 0xde: case 0xdf:
+        if (!read_be(src, 2 << (tag - 0xde), &v))
+            return 0;
+        return parse_list(ta_parent, dst, src, max_depth, true, v);
+    }
+    return -1;
+
+str:
+    if (src->len < v)
+        return 0;
+    dst->format = MPV_FORMAT_STRING;
+    dst->u.string = bstrto0(ta_parent, (bstr){src->start, v});
+    *src = bstr_cut(*src, v);
+    return 1;
+}
+
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    bstr s = *src;
+    int r = parse(ta_parent, dst, &s, max_depth);
+    if (r > 0)
+        *src = s;
+    return r;
+}
+
+// Return the size of the header following the tag, or -1 for unsupported tags.
+// Set *payload to the number of data bytes after the header, and *items to
+// the number of elements that follow (map keys and values count separately).
+// hdr is the data after the tag; if it's shorter than the header, the lengths
+// are not read.
+static int scan_tag(uint8_t tag, bstr hdr, uint64_t *payload, uint64_t *items)
+{
+    *payload = 0;
+    *items = 0;
+    if (tag <= 0x7f || tag >= 0xe0)
+        return 0;
+    if ((tag & 0xf0) == 0x80) {
+        *items = (tag & 0x0f) * 2;
+        return 0;
+    }
+    if ((tag & 0xf0) == 0x90) {
+        *items = tag & 0x0f;
+        return 0;
+    }
+    if ((tag & 0xe0) == 0xa0) {
+        *payload = tag & 0x1f;
+        return 0;
+    }
+
+    int size;
+    uint64_t v;
+    switch (tag) {
+    case 0xc0: case 0xc2: case 0xc3:
+        return 0;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        return 1 << (tag - 0xcc);
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+        return 1 << (tag - 0xd0);
+    case 0xca:
+        return 4;
+    case 0xcb:
+        return 8;
+    case 0xd9: case 0xda: case 0xdb:
+        size = 1 << (tag - 0xd9);
+        if (read_be(&hdr, size, &v))
+            *payload = v;
+        return size;
+    case 0xc4: case 0xc5: case 0xc6:
+        size = 1 << (tag - 0xc4);
+        if (read_be(&hdr, size, &v))
+            *payload = v;
+        return size;
+    case 0xdc: case 0xdd:
+        size = 2 << (tag - 0xdc);
+        if (read_be(&hdr, size, &v))
+            *items = v;
+        return size;
+    case 0xde: case 0xdf:
+        size = 2 << (tag - 0xde);
+        if (read_be(&hdr, size, &v))
+            *items = v * 2;
+        return size;
+    }
+    return -1;
+}
+
+int msgpack_scan(struct msgpack_scan *s, bstr src, int max_depth)
+{
+    assert(max_depth <= MSGPACK_SCAN_MAX_DEPTH);
+
+    while (s->pos < src.len) {
+        if (s->depth + 1 > max_depth)
+            return -1;
+
+        bstr cur = bstr_cut(src, s->pos);
+        uint64_t payload, items;
+        int hdr = scan_tag(cur.start[0], bstr_cut(cur, 1), &payload, &items);
+        if (hdr < 0)
+            return -1;
+        if (cur.len - 1 < hdr || cur.len - 1 - hdr < payload)
+            return 0;
+        s->pos += 1 + hdr + payload;
+
+        if (items) {
+            s->left[s->depth++] = items;
+            continue;
+        }
+
+        // The element is complete, and so is every container it finishes.
+        while (s->depth > 0 && --s->left[s->depth - 1] == 0)
+            s->depth--;
+        if (s->depth == 0)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef MP_MSGPACK_H
+#define MP_MSGPACK_H
+
+// We reuse mpv_node.
+#include <stdint.h>
+
+#include "libmpv/client.h"
+#include "misc/bstr.h"
+
+// Parse the first MessagePack object in *src, and advance *src past it.
+// Returns 1 on success, 0 if *src ends before the object is complete (*src is
+// left unchanged in this case), or -1 on invalid or unsupported data, or if the
+// nesting is deeper than max_depth. Everything is allocated with ta_parent.
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth);
+
+#define MSGPACK_SCAN_MAX_DEPTH 64
+
+// State for msgpack_scan(). Zero-initialize it before the first call, and
+// again after the object was consumed.
+struct msgpack_scan {
+    size_t pos;     // bytes of the object checked so far
+    int depth;      // number of unfinished arrays/maps
+    uint64_t left[MSGPACK_SCAN_MAX_DEPTH]; // items still expected in each
+};
+
+// Check whether src starts with a complete MessagePack object, without
+// parsing it. src must start with the same data as on the previous calls with
+// the same state, possibly with more data appended; each byte is looked at
+// only once. Returns 1 if the object is complete (msgpack_parse() can be used
+// on it, though it still rejects non-string map keys), 0 if more data is
+// needed, or -1 on invalid or unsupported data, or if the nesting is deeper
+// than max_depth (at most MSGPACK_SCAN_MAX_DEPTH).
+int msgpack_scan(struct msgpack_scan *s, bstr src, int max_depth);
+
+// Append the MessagePack encoding of src to *dst (allocated with ta_parent).
+// Returns -1 on error (sizes which can't be encoded), 0 otherwise.
+int msgpack_write(void *ta_parent, bstr *dst, struct mpv_node *src);
+
+#endif
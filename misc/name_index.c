@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "name_index.h"
+
+struct entry {
+    const char *name;       // NULL if free
+    uint32_t hash;
+    void *val;
+};
+
+struct mp_name_index {
+    struct entry *entries;  // open addressing, linear probing
+    uint32_t mask;          // number of entries - 1 (power of 2)
+    int num;
+};
+
+// FNV-1a
+static uint32_t hash_name(bstr name)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
+
+static struct entry *find_slot(struct mp_name_index *ix, bstr name,
+                               uint32_t hash)
+{
+    for (uint32_t i = hash & ix->mask; ; i = (i + 1) & ix->mask) {
+        struct entry *e = &ix->entries[i];
+        if (!e->name || (e->hash == hash && bstr_equals0(name, e->name)))
+            return e;
+    }
+}
+
+static void resize(struct mp_name_index *ix, uint32_t size)
+{
+    struct entry *old = ix->entries;
+    uint32_t old_size = old ? ix->mask + 1 : 0;
+
+    ix->entries = talloc_zero_array(ix, struct entry, size);
+    ix->mask = size - 1;
+
+    for (uint32_t n = 0; n < old_size; n++) {
+        if (old[n].name)
+            *find_slot(ix, bstr0(old[n].name), old[n].hash) = old[n];
+    }
+    talloc_free(old);
+}
+
+struct mp_name_index *mp_name_index_create(void *ta_parent)
+{
+    struct mp_name_index *ix = talloc_zero(ta_parent, struct mp_name_index);
+    resize(ix, 64);
+    return ix;
+}
+
+bool mp_name_index_add(struct mp_name_index *ix, const char *name, void *val)
+{
+    // Keep the load factor below 1/2, so probe sequences stay short.
+    if ((ix->num + 1) * 2 > ix->mask + 1)
+        resize(ix, (ix->mask + 1) * 2);
+
+    bstr bname = bstr0(name);
+    uint32_t hash = hash_name(bname);
+    struct entry *e = find_slot(ix, bname, hash);
+    if (e->name)
+        return false;
+    *e = (struct entry){ .name = name, .hash = hash, .val = val };
+    ix->num++;
+    return true;
+}
+
+void *mp_name_index_get(struct mp_name_index *ix, bstr name)
+{
+    return find_slot(ix, name, hash_name(name))->val;
+}
@@ -0,0 +1,23 @@
+#ifndef MP_MISC_NAME_INDEX_H_
+#define MP_MISC_NAME_INDEX_H_
+
+#include <stdbool.h>
+
+#include "misc/bstr.h"
+
+// Hash table mapping names to pointers, meant for speeding up lookups in
+// static or rarely changing tables (properties, commands). Entries can't be
+// removed. The names are not copied, and must stay valid while the index is
+// used. Not thread-safe, but concurrent lookups are fine if nothing is added.
+struct mp_name_index;
+
+struct mp_name_index *mp_name_index_create(void *ta_parent);
+
+// Add an entry. If there is already an entry with the same name, it's kept,
+// and false is returned.
+bool mp_name_index_add(struct mp_name_index *ix, const char *name, void *val);
+
+// Return the value added with the given name, or NULL if none.
+void *mp_name_index_get(struct mp_name_index *ix, bstr name);
+
+#endif
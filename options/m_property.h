@@ -24,6 +24,7 @@
 #include "m_option.h"
 
 struct mp_log;
+struct mp_name_index;
 
 enum mp_property_action {
     // Get the property type. This defines the fundamental data type read from
@@ -138,11 +139,19 @@ struct m_property {
 struct m_property *m_property_list_find(const struct m_property *list,
                                         const char *name);
 
+// Create an index mapping the names of all properties in list (terminated
+// with a {0} item) to the struct m_property pointers. This is what the
+// functions below use to look up properties. The list is not copied. With
+// duplicate names, the first entry wins, like with m_property_list_find().
+struct mp_name_index *m_property_index_create(void *ta_parent,
+                                              const struct m_property *list);
+
 // Access a property.
+// props: property lookup index, see m_property_index_create()
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, struct mp_name_index *props,
                   const char* property_name, int action, void* arg, void *ctx);
 
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
@@ -167,7 +176,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(struct mp_name_index *props,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
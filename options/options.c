@@ -60,6 +60,7 @@ extern const struct m_sub_options tv_params_conf;
 extern const struct m_sub_options stream_cdda_conf;
 extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
+extern const struct m_sub_options stream_file_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options zimg_conf;
 extern const struct m_sub_options drm_conf;
@@ -504,6 +505,9 @@ static const m_option_t mp_opts[] = {
     {"demuxer-termination-timeout", OPT_DOUBLE(demux_termination_timeout)},
     {"demuxer-cache-wait", OPT_FLAG(demuxer_cache_wait)},
     {"prefetch-playlist", OPT_FLAG(prefetch_open)},
+    {"prefetch-playlist-depth", OPT_INT(prefetch_depth), M_RANGE(1, 16)},
+    {"image-pool-budget", OPT_BYTE_SIZE(image_pool_budget),
+        M_RANGE(0, M_MAX_MEM_BYTES)},
     {"cache-pause", OPT_FLAG(cache_pause)},
     {"cache-pause-initial", OPT_FLAG(cache_pause_initial)},
     {"cache-pause-wait", OPT_FLOAT(cache_pause_wait), M_RANGE(0, DBL_MAX)},
@@ -514,6 +518,7 @@ static const m_option_t mp_opts[] = {
     {"dvbin", OPT_SUBSTRUCT(stream_dvb_opts, stream_dvb_conf)},
 #endif
     {"", OPT_SUBSTRUCT(stream_lavf_opts, stream_lavf_conf)},
+    {"", OPT_SUBSTRUCT(stream_file_opts, stream_file_conf)},
 
 // ------------------------- a-v sync options --------------------
 
@@ -722,6 +727,12 @@ static const m_option_t mp_opts[] = {
     {"input-ipc-server", OPT_STRING(ipc_path), .flags = M_OPT_FILE},
 #if HAVE_POSIX
     {"input-ipc-client", OPT_STRING(ipc_client)},
+    {"input-ipc-server-mode", OPT_CHOICE(ipc_server_mode,
+        {"threads", 0}, {"poll", 1})},
+    {"input-ipc-output-limit", OPT_BYTE_SIZE(ipc_output_limit),
+        M_RANGE(4096, M_MAX_MEM_BYTES)},
+    {"input-ipc-overflow", OPT_CHOICE(ipc_overflow,
+        {"drop", 0}, {"disconnect", 1})},
 #endif
 
     {"screenshot", OPT_SUBSTRUCT(screenshot_image_opts, screenshot_conf)},
@@ -955,6 +966,7 @@ static const struct MPOpts mp_default_opts = {
     .position_resume = 1,
     .autoload_files = 1,
     .demuxer_thread = 1,
+    .prefetch_depth = 1,
     .demux_termination_timeout = 0.1,
     .hls_bitrate = INT_MAX,
     .cache_pause = 1,
@@ -968,6 +980,7 @@ static const struct MPOpts mp_default_opts = {
     .term_osd = 2,
     .term_osd_bar_chars = "[-+-]",
     .consolecontrols = 1,
+    .ipc_output_limit = 1024 * 1024,
     .playlist_pos = -1,
     .play_frames = -1,
     .rebase_start_time = 1,
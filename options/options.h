@@ -257,6 +257,8 @@ typedef struct MPOpts {
     double demux_termination_timeout;
     int demuxer_cache_wait;
     int prefetch_open;
+    int prefetch_depth;
+    int64_t image_pool_budget;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -293,6 +295,7 @@ typedef struct MPOpts {
     struct cdda_params *stream_cdda_opts;
     struct dvb_params *stream_dvb_opts;
     struct stream_lavf_params *stream_lavf_opts;
+    struct stream_file_opts *stream_file_opts;
 
     char *cdrom_device;
     char *bluray_device;
@@ -320,6 +323,9 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *ipc_client;
+    int ipc_server_mode;
+    int64_t ipc_output_limit;
+    int ipc_overflow;
 
     int wingl_dwm_flush;
 
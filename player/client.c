@@ -77,6 +77,8 @@ struct mp_client_api {
     // used to safely unlock mp_client_api.lock while iterating the list of
     // clients.
     uint64_t clients_list_change_ts;
+    // Incremented whenever a client observes or unobserves a property.
+    uint64_t observers_change_ts;
     int64_t id_alloc;
 
     struct mp_custom_protocol *custom_protocols;
@@ -484,6 +486,7 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             clients->clients_list_change_ts += 1;
+            clients->observers_change_ts += 1;
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
             while (ctx->num_events) {
                 talloc_free(ctx->events[ctx->first_event].data);
@@ -1275,6 +1278,13 @@ int mpv_command_node_async(mpv_handle *ctx, uint64_t ud, mpv_node *args)
     return run_async_cmd(ctx, ud, mp_input_parse_cmd_node(ctx->log, args));
 }
 
+int mp_client_command_string_async(mpv_handle *ctx, uint64_t ud,
+                                   const char *args)
+{
+    return run_async_cmd(ctx, ud,
+        mp_input_parse_cmd(ctx->mpctx->input, bstr0((char*)args), ctx->name));
+}
+
 void mpv_abort_async_command(mpv_handle *ctx, uint64_t reply_userdata)
 {
     abort_async(ctx->mpctx, ctx, MPV_EVENT_COMMAND_REPLY, reply_userdata);
@@ -1542,6 +1552,181 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+struct properties_request {
+    struct MPContext *mpctx;
+    char **names;               // get: NULL-terminated list of names
+    struct mpv_node props;      // set: MPV_FORMAT_NODE_MAP
+    struct mpv_node res;        // get: MPV_FORMAT_NODE_MAP
+    int status;
+    struct mpv_handle *reply_ctx;
+    uint64_t userdata;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct properties_request *req = arg;
+
+    // Properties that can't be read are left out of the result map.
+    node_init(&req->res, MPV_FORMAT_NODE_MAP, NULL);
+    for (int n = 0; req->names[n]; n++) {
+        struct mpv_node val;
+        struct getproperty_request r = {
+            .mpctx = req->mpctx,
+            .name = req->names[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &val,
+        };
+        getproperty_fn(&r);
+        if (r.status < 0)
+            continue;
+        talloc_steal(req->res.u.list, node_get_alloc(&val));
+        *node_map_add(&req->res, req->names[n], MPV_FORMAT_NONE) = val;
+    }
+
+    req->status = 0;
+
+    if (req->reply_ctx) {
+        struct mpv_event_property *prop = talloc_ptrtype(NULL, prop);
+        *prop = (struct mpv_event_property){
+            .name = "",
+            .format = MPV_FORMAT_NODE,
+            .data = talloc_size(prop, sizeof(struct mpv_node)),
+        };
+        // move data
+        memcpy(prop->data, &req->res, sizeof(struct mpv_node));
+        req->res = (struct mpv_node){0};
+        talloc_set_destructor(prop, free_prop_data);
+        struct mpv_event reply = {
+            .event_id = MPV_EVENT_GET_PROPERTY_REPLY,
+            .data = prop,
+            .error = req->status,
+        };
+        send_reply(req->reply_ctx, req->userdata, &reply);
+        talloc_free(req);
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, const char **names,
+                       mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names || !result)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct properties_request req = {
+        .mpctx = ctx->mpctx,
+        .names = (char **)names,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    *result = req.res;
+    return req.status;
+}
+
+int mpv_get_properties_async(mpv_handle *ctx, uint64_t ud, const char **names)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct properties_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct properties_request){
+        .mpctx = ctx->mpctx,
+        .reply_ctx = ctx,
+        .userdata = ud,
+    };
+    int num_names = 0;
+    for (int n = 0; names[n]; n++) {
+        MP_TARRAY_APPEND(req, req->names, num_names,
+                         talloc_strdup(req, names[n]));
+    }
+    MP_TARRAY_APPEND(req, req->names, num_names, NULL);
+    return run_async(ctx, getproperties_fn, req);
+}
+
+static void setproperties_fn(void *arg)
+{
+    struct properties_request *req = arg;
+    struct mpv_node_list *list = req->props.u.list;
+
+    // Set all properties, even if some of them fail, and report the first
+    // error.
+    req->status = 0;
+    for (int n = 0; n < list->num; n++) {
+        struct setproperty_request r = {
+            .mpctx = req->mpctx,
+            .name = list->keys[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &list->values[n],
+        };
+        setproperty_fn(&r);
+        if (r.status < 0 && req->status >= 0)
+            req->status = r.status;
+    }
+
+    if (req->reply_ctx) {
+        struct mpv_event reply = {
+            .event_id = MPV_EVENT_SET_PROPERTY_REPLY,
+            .error = req->status,
+        };
+        send_reply(req->reply_ctx, req->userdata, &reply);
+        talloc_free(req);
+    }
+}
+
+int mpv_set_properties(mpv_handle *ctx, mpv_node *props)
+{
+    if (!props || props->format != MPV_FORMAT_NODE_MAP || !props->u.list)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    if (!ctx->mpctx->initialized) {
+        // Goes through the options; there is no core lock to save.
+        struct mpv_node_list *list = props->u.list;
+        int status = 0;
+        for (int n = 0; n < list->num; n++) {
+            int r = mpv_set_property(ctx, list->keys[n], MPV_FORMAT_NODE,
+                                     &list->values[n]);
+            if (r < 0 && status >= 0)
+                status = r;
+        }
+        return status;
+    }
+
+    struct properties_request req = {
+        .mpctx = ctx->mpctx,
+        .props = *props,
+    };
+    run_locked(ctx, setproperties_fn, &req);
+    return req.status;
+}
+
+static void free_props_set_req(void *ptr)
+{
+    struct properties_request *req = ptr;
+    m_option_free(get_mp_type(MPV_FORMAT_NODE), &req->props);
+}
+
+int mpv_set_properties_async(mpv_handle *ctx, uint64_t ud, mpv_node *props)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!props || props->format != MPV_FORMAT_NODE_MAP || !props->u.list)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct properties_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct properties_request){
+        .mpctx = ctx->mpctx,
+        .reply_ctx = ctx,
+        .userdata = ud,
+    };
+
+    m_option_copy(get_mp_type(MPV_FORMAT_NODE), &req->props, props);
+    talloc_set_destructor(req, free_props_set_req);
+
+    return run_async(ctx, setproperties_fn, req);
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1554,6 +1739,13 @@ static void property_free(void *p)
     }
 }
 
+static void observers_changed(struct mp_client_api *clients)
+{
+    pthread_mutex_lock(&clients->lock);
+    clients->observers_change_ts += 1;
+    pthread_mutex_unlock(&clients->lock);
+}
+
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
                          const char *name, mpv_format format)
 {
@@ -1586,6 +1778,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     ctx->cur_property_index = 0;
     ctx->has_pending_properties = true;
     pthread_mutex_unlock(&ctx->lock);
+    observers_changed(ctx->clients);
     mp_wakeup_core(ctx->mpctx);
     return 0;
 }
@@ -1607,14 +1800,50 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
         }
     }
     pthread_mutex_unlock(&ctx->lock);
+    if (count)
+        observers_changed(ctx->clients);
     return count;
 }
 
+// Return a value that changes whenever the set of observed properties changes.
+uint64_t mp_client_observers_change_ts(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    pthread_mutex_lock(&clients->lock);
+    uint64_t ts = clients->observers_change_ts;
+    pthread_mutex_unlock(&clients->lock);
+    return ts;
+}
+
+// Whether any client observes the property with the given mp_get_property_id().
+bool mp_client_property_is_observed(struct MPContext *mpctx, int id)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    bool found = false;
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients && !found; n++) {
+        struct mpv_handle *client = clients->clients[n];
+        pthread_mutex_lock(&client->lock);
+        for (int i = 0; i < client->num_properties; i++)
+            found |= client->properties[i]->id == id;
+        pthread_mutex_unlock(&client->lock);
+    }
+    pthread_mutex_unlock(&clients->lock);
+    return found;
+}
+
 // Broadcast that a property has changed.
 void mp_client_property_change(struct MPContext *mpctx, const char *name)
+{
+    mp_client_property_change_id(mpctx, mp_get_property_id(mpctx, name));
+}
+
+// Like mp_client_property_change(), but with an ID from mp_get_property_id().
+void mp_client_property_change_id(struct MPContext *mpctx, int id)
 {
     struct mp_client_api *clients = mpctx->clients;
-    int id = mp_get_property_id(mpctx, name);
     bool any_pending = false;
 
     pthread_mutex_lock(&clients->lock);
@@ -30,6 +30,9 @@ int mp_client_send_event(struct MPContext *mpctx, const char *client_name,
 int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+void mp_client_property_change_id(struct MPContext *mpctx, int id);
+uint64_t mp_client_observers_change_ts(struct MPContext *mpctx);
+bool mp_client_property_is_observed(struct MPContext *mpctx, int id);
 void mp_client_send_property_changes(struct MPContext *mpctx);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
@@ -37,6 +40,11 @@ void mp_client_set_weak(struct mpv_handle *ctx);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
 struct mpv_global *mp_client_get_global(struct mpv_handle *ctx);
 
+// Like mpv_command_string(), but replies with MPV_EVENT_COMMAND_REPLY like
+// mpv_command_node_async().
+int mp_client_command_string_async(struct mpv_handle *ctx, uint64_t ud,
+                                   const char *args);
+
 void mp_client_broadcast_event_external(struct mp_client_api *api, int event,
                                         void *data);
 
@@ -57,6 +57,7 @@
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/mp_image_pool.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
@@ -64,6 +65,7 @@
 #include "options/path.h"
 #include "screenshot.h"
 #include "misc/dispatch.h"
+#include "misc/name_index.h"
 #include "misc/node.h"
 #include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
@@ -80,6 +82,8 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // Maps names to entries in properties.
+    struct mp_name_index *property_index;
 
     double last_seek_time;
     double last_seek_pts;
@@ -107,6 +111,24 @@ struct command_ctx {
     char **script_props;
 
     double cached_window_scale;
+
+    struct tick_property *tick_props;
+    int num_tick_props;
+    uint64_t tick_observers_ts;
+};
+
+// Cached value of a property which can change on every MPV_EVENT_TICK. See
+// update_tick_properties().
+struct tick_property {
+    int id;                     // index into command_ctx.properties
+    // 0: type not known yet, 1: compare values (type is set), -1: can't
+    // compare (always notify, like other event based property changes)
+    int compare;
+    struct m_option type;
+    bool observed;              // by any client
+    bool known;                 // value/valid are set
+    bool valid;                 // property was available
+    union m_option_value value;
 };
 
 static const struct m_option script_props_type = {
@@ -1481,6 +1503,12 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
         struct mpv_node *sub = node_array_add(ranges, MPV_FORMAT_NODE_MAP);
         node_map_add_double(sub, "start", range->start);
         node_map_add_double(sub, "end", range->end);
+        if (range->uncompressed_bytes) {
+            node_map_add_int64(sub, "compressed-bytes",
+                               range->compressed_bytes);
+            node_map_add_int64(sub, "uncompressed-bytes",
+                               range->uncompressed_bytes);
+        }
     }
 
     return M_PROPERTY_OK;
@@ -2475,6 +2503,7 @@ static int mp_property_perf_info(void *ctx, struct m_property *p, int action,
         *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
         return M_PROPERTY_OK;
     case M_PROPERTY_GET: {
+        mp_image_pool_report_global_stats(mpctx->stats);
         stats_global_query(mpctx->global, (struct mpv_node *)arg);
         return M_PROPERTY_OK;
     }
@@ -3560,14 +3589,6 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_CHANGE_ALL, "*"),
     E(MPV_EVENT_TRACKS_CHANGED, "track-list"),
     E(MPV_EVENT_IDLE, "*"),
-    E(MPV_EVENT_TICK, "time-pos", "audio-pts", "stream-pos", "avsync",
-      "percent-pos", "time-remaining", "playtime-remaining", "playback-time",
-      "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
-      "total-avsync-change", "audio-speed-correction", "video-speed-correction",
-      "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
-      "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
-      "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
-      "frame-drop-count", "video-frame-info", "vf-metadata", "af-metadata"),
     E(MP_EVENT_DURATION_UPDATE, "duration"),
     E(MPV_EVENT_VIDEO_RECONFIG, "video-out-params", "video-params",
       "video-format", "video-codec", "video-bitrate", "dwidth", "dheight",
@@ -3597,6 +3618,25 @@ static const char *const *const mp_event_property_change[] = {
 };
 #undef E
 
+// Properties which can change on every MPV_EVENT_TICK. Instead of making each
+// client re-read and compare them on every tick, update_tick_properties() reads
+// the observed ones once, and notifies only the ones that actually changed.
+// This saves work only for values that stay the same (most of them while
+// paused, the counters and bitrates most of the time). A value that changes
+// on every tick (like time-pos during playback) costs one additional read per
+// tick. The "tick-property-changed" and "tick-property-unchanged" stats count
+// how many notifications were sent and how many were skipped.
+static const char *const tick_property_names[] = {
+    "time-pos", "audio-pts", "stream-pos", "avsync",
+    "percent-pos", "time-remaining", "playtime-remaining", "playback-time",
+    "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
+    "total-avsync-change", "audio-speed-correction", "video-speed-correction",
+    "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
+    "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
+    "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
+    "frame-drop-count", "video-frame-info", "vf-metadata", "af-metadata",
+};
+
 // If there is no prefix, return length+1 (avoids matching full name as prefix).
 static int prefix_len(const char *p)
 {
@@ -3635,14 +3675,16 @@ uint64_t mp_get_property_event_mask(const char *name)
 
 // Return an ID for the property. It might not be unique, but is good enough
 // for property change handling. Return -1 if property unknown.
+// Property names never contain '/', so only the part before it is looked up.
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    if (strncmp(name, "options/", 8) == 0)
+        name += 8;
+    const char *sep = strchr(name, '/');
+    bstr base = sep ? (bstr){(char *)name, sep - name} : bstr0(name);
+    struct m_property *prop = mp_name_index_get(ctx->property_index, base);
+    return prop ? prop - ctx->properties : -1;
 }
 
 static bool is_property_set(int action, void *val)
@@ -3667,7 +3709,7 @@ int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->property_index, name, action, val, ctx);
 
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
@@ -3692,7 +3734,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->property_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -6090,6 +6132,12 @@ void command_uninit(struct MPContext *mpctx)
 
     m_option_free(&script_props_type, &ctx->script_props);
 
+    for (int n = 0; n < ctx->num_tick_props; n++) {
+        struct tick_property *t = &ctx->tick_props[n];
+        if (t->compare > 0)
+            m_option_free(&t->type, &t->value);
+    }
+
     talloc_free(mpctx->command_ctx);
     mpctx->command_ctx = NULL;
 }
@@ -6107,6 +6155,7 @@ void command_init(struct MPContext *mpctx)
     ctx->properties =
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
+    ctx->property_index = m_property_index_create(ctx, ctx->properties);
 
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
@@ -6141,11 +6190,94 @@ void command_init(struct MPContext *mpctx)
         }
 
         // The option might be covered by a manual property already.
-        if (m_property_list_find(ctx->properties, prop.name))
+        if (!mp_name_index_add(ctx->property_index, prop.name,
+                               &ctx->properties[count]))
             continue;
 
         ctx->properties[count++] = prop;
     }
+
+    for (int n = 0; n < MP_ARRAY_SIZE(tick_property_names); n++) {
+        int id = mp_get_property_id(mpctx, tick_property_names[n]);
+        if (id < 0)
+            continue;
+        struct tick_property t = {.id = id};
+        MP_TARRAY_APPEND(ctx, ctx->tick_props, ctx->num_tick_props, t);
+    }
+}
+
+// Forget the cached values, so the next tick notifies all of them again.
+static void invalidate_tick_properties(struct MPContext *mpctx, int id)
+{
+    struct command_ctx *ctx = mpctx->command_ctx;
+
+    for (int n = 0; n < ctx->num_tick_props; n++) {
+        if (id < 0 || ctx->tick_props[n].id == id)
+            ctx->tick_props[n].known = false;
+    }
+}
+
+static void update_tick_properties(struct MPContext *mpctx)
+{
+    struct command_ctx *ctx = mpctx->command_ctx;
+
+    uint64_t ts = mp_client_observers_change_ts(mpctx);
+    if (ts != ctx->tick_observers_ts) {
+        ctx->tick_observers_ts = ts;
+        for (int n = 0; n < ctx->num_tick_props; n++) {
+            struct tick_property *t = &ctx->tick_props[n];
+            t->observed = mp_client_property_is_observed(mpctx, t->id);
+            t->known &= t->observed;
+        }
+    }
+
+    for (int n = 0; n < ctx->num_tick_props; n++) {
+        struct tick_property *t = &ctx->tick_props[n];
+        if (!t->observed)
+            continue;
+
+        struct m_property *prop = &ctx->properties[t->id];
+
+        // Some properties can tell their type only while they're available.
+        if (!t->compare) {
+            int r = prop->call(mpctx, prop, M_PROPERTY_GET_TYPE, &t->type);
+            if (r == M_PROPERTY_OK) {
+                t->compare = t->type.type && t->type.type->equal ? 1 : -1;
+            } else if (r == M_PROPERTY_NOT_IMPLEMENTED) {
+                t->compare = -1;
+            }
+        }
+
+        if (t->compare <= 0) {
+            mp_client_property_change_id(mpctx, t->id);
+            continue;
+        }
+
+        union m_option_value val = {0};
+        int r = prop->call(mpctx, prop, M_PROPERTY_GET, &val);
+        if (r == M_PROPERTY_NOT_IMPLEMENTED) {
+            // Only sub-properties can be read.
+            m_option_free(&t->type, &t->value);
+            t->compare = -1;
+            mp_client_property_change_id(mpctx, t->id);
+            continue;
+        }
+        bool valid = r == M_PROPERTY_OK;
+
+        bool changed = !t->known || t->valid != valid ||
+                       (valid && !m_option_equal(&t->type, &t->value, &val));
+        if (changed) {
+            m_option_free(&t->type, &t->value);
+            memcpy(&t->value, &val, t->type.type->size);
+            t->known = true;
+            t->valid = valid;
+            mp_client_property_change_id(mpctx, t->id);
+            stats_event(mpctx->stats, "tick-property-changed");
+        } else {
+            m_option_free(&t->type, &val);
+            stats_event(mpctx->stats, "tick-property-unchanged");
+        }
+    }
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -6166,6 +6298,18 @@ static void command_event(struct MPContext *mpctx, int event, void *arg)
     }
     if (event == MP_EVENT_WIN_STATE2)
         ctx->cached_window_scale = 0;
+
+    // These events make clients re-read all properties.
+    if (event == MPV_EVENT_START_FILE || event == MPV_EVENT_END_FILE ||
+        event == MPV_EVENT_FILE_LOADED || event == MP_EVENT_CHANGE_ALL ||
+        event == MPV_EVENT_IDLE)
+        invalidate_tick_properties(mpctx, -1);
+
+    if (event == MPV_EVENT_TICK) {
+        stats_time_start(mpctx->stats, "tick-properties");
+        update_tick_properties(mpctx);
+        stats_time_end(mpctx->stats, "tick-properties");
+    }
 }
 
 void handle_command_updates(struct MPContext *mpctx)
@@ -6247,11 +6391,16 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (flags & UPDATE_INPUT)
         mp_input_update_opts(mpctx->input);
 
-    if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client) {
+    if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client ||
+        opt_ptr == &opts->ipc_server_mode)
+    {
         mp_uninit_ipc(mpctx->ipc_ctx);
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
     }
 
+    if (init || opt_ptr == &opts->image_pool_budget)
+        mp_image_pool_set_global_budget(mpctx, opts->image_pool_budget);
+
     if (flags & UPDATE_AUDIO)
         reload_audio_output(mpctx);
 
@@ -6372,5 +6521,7 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
 {
-    mp_client_property_change(mpctx, property);
+    int id = mp_get_property_id(mpctx, property);
+    invalidate_tick_properties(mpctx, id);
+    mp_client_property_change_id(mpctx, id);
 }
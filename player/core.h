@@ -456,22 +456,36 @@ typedef struct MPContext {
     bool abort_all; // during final termination
 
     // --- Owned by MPContext
-    pthread_t open_thread;
-    bool open_active; // open_thread is a valid thread handle, all setup
-    atomic_bool open_done;
-    // --- All fields below are immutable while open_active is true.
-    //     Otherwise, they're owned by MPContext.
-    struct mp_cancel *open_cancel;
-    char *open_url;
-    char *open_format;
-    int open_url_flags;
-    bool open_for_prefetch;
-    // --- All fields below are owned by open_thread, unless open_done was set
-    //     to true.
-    struct demuxer *open_res_demuxer;
-    int open_res_error;
+    // Asynchronous opening of the current file, and prefetching of the next
+    // playlist entries (at most one per URL).
+    struct mp_opener **openers;
+    int num_openers;
+    // Result of the external file scan done by the opener, if any, and the
+    // options snapshot it was done with.
+    char *external_files_url;
+    struct subfn *external_files;
+    struct MPOpts *external_files_opts;
 } MPContext;
 
+// Opens a playlist entry on a separate thread (see loadfile.c).
+struct mp_opener {
+    pthread_t thread;
+    atomic_bool done;
+    // --- All fields below are immutable while the thread is running.
+    struct MPContext *mpctx;
+    struct mp_cancel *cancel;
+    char *url;
+    char *format;
+    int url_flags;
+    bool for_prefetch;
+    // --- All fields below are owned by the thread, unless done was set to
+    //     true.
+    struct demuxer *res_demuxer;
+    int res_error;
+    struct subfn *res_external_files;
+    struct MPOpts *res_external_files_opts;
+};
+
 // Contains information about an asynchronous work item, how it can be aborted,
 // and when. All fields are protected by MPContext.abort_lock.
 struct mp_abort_entry {
@@ -310,3 +310,18 @@ struct subfn *find_external_files(struct mpv_global *global, const char *fname,
 
     return slist;
 }
+
+// Whether find_external_files() with the given options finds the same files
+// (assuming the directories did not change).
+bool find_external_files_same_opts(struct MPOpts *a, struct MPOpts *b)
+{
+    const m_option_t list = {.type = &m_option_type_string_list};
+    return a->sub_auto == b->sub_auto &&
+           a->audiofile_auto == b->audiofile_auto &&
+           m_option_equal(&list, &a->sub_paths, &b->sub_paths) &&
+           m_option_equal(&list, &a->audiofile_paths, &b->audiofile_paths) &&
+           m_option_equal(&list, &a->stream_lang[STREAM_SUB],
+                          &b->stream_lang[STREAM_SUB]) &&
+           m_option_equal(&list, &a->stream_lang[STREAM_AUDIO],
+                          &b->stream_lang[STREAM_AUDIO]);
+}
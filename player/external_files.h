@@ -31,6 +31,7 @@ struct mpv_global;
 struct MPOpts;
 struct subfn *find_external_files(struct mpv_global *global, const char *fname,
                                   struct MPOpts *opts);
+bool find_external_files_same_opts(struct MPOpts *a, struct MPOpts *b);
 
 bool mp_might_be_subtitle_file(const char *filename);
 
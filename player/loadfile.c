@@ -738,44 +738,75 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
     return true;
 }
 
-// Add the given file as additional track. The filter argument controls how or
-// if tracks are auto-selected at any point.
-// To be run on a worker thread, locked (temporarily unlocks core).
-// cancel will generally be used to abort the loading process, but on success
-// the demuxer is changed to be slaved to mpctx->playback_abort instead.
-int mp_add_external_file(struct MPContext *mpctx, char *filename,
-                         enum stream_type filter, struct mp_cancel *cancel)
+// An external file being opened by open_external_file().
+struct external_file {
+    char *filename;
+    enum stream_type filter;
+    struct demuxer_params params;
+    struct mp_cancel *cancel;
+    struct mpv_global *global;
+    struct demuxer *demuxer;    // result
+    int64_t open_time;          // time needed to open it (in us)
+    struct mp_waiter waiter;    // if opened on a worker thread
+};
+
+// To be run locked.
+static void init_external_file(struct MPContext *mpctx, struct external_file *f,
+                               char *filename, enum stream_type filter,
+                               struct mp_cancel *cancel)
 {
     struct MPOpts *opts = mpctx->opts;
-    if (!filename || mp_cancel_test(cancel))
-        return -1;
-
-    char *disp_filename = filename;
-    if (strncmp(disp_filename, "memory://", 9) == 0)
-        disp_filename = "memory://"; // avoid noise
 
-    struct demuxer_params params = {
-        .is_top_level = true,
-        .stream_flags = STREAM_ORIGIN_DIRECT,
+    *f = (struct external_file){
+        .filename = filename,
+        .filter = filter,
+        .params = {
+            .is_top_level = true,
+            .stream_flags = STREAM_ORIGIN_DIRECT,
+        },
+        .cancel = cancel,
+        .global = mpctx->global,
+        .waiter = MP_WAITER_INITIALIZER,
     };
 
     switch (filter) {
     case STREAM_SUB:
-        params.force_format = opts->sub_demuxer_name;
+        f->params.force_format = opts->sub_demuxer_name;
         break;
     case STREAM_AUDIO:
-        params.force_format = opts->audio_demuxer_name;
+        f->params.force_format = opts->audio_demuxer_name;
         break;
     }
+}
 
-    mp_core_unlock(mpctx);
+// Can be run unlocked, and on any thread.
+static void open_external_file(struct external_file *f)
+{
+    int64_t start = mp_time_us();
+    f->demuxer = demux_open_url(f->filename, &f->params, f->cancel, f->global);
+    f->open_time = mp_time_us() - start;
+}
+
+static void open_external_file_thread(void *p)
+{
+    struct external_file *f = p;
+    open_external_file(f);
+    mp_waiter_wakeup(&f->waiter, 0);
+}
 
-    struct demuxer *demuxer =
-        demux_open_url(filename, &params, cancel, mpctx->global);
-    if (demuxer)
-        enable_demux_thread(mpctx, demuxer);
+// Add the tracks of an opened external file. Takes over f->demuxer. Returns
+// the index of the first added track, or -1. To be run locked.
+static int add_external_file(struct MPContext *mpctx, struct external_file *f)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct demuxer *demuxer = f->demuxer;
+    enum stream_type filter = f->filter;
 
-    mp_core_lock(mpctx);
+    f->demuxer = NULL;
+
+    char *disp_filename = f->filename;
+    if (strncmp(disp_filename, "memory://", 9) == 0)
+        disp_filename = "memory://"; // avoid noise
 
     // The command could have overlapped with playback exiting. (We don't care
     // if playback has started again meanwhile - weird, but not a problem.)
@@ -785,6 +816,10 @@ int mp_add_external_file(struct MPContext *mpctx, char *filename,
     if (!demuxer)
         goto err_out;
 
+    MP_VERBOSE(mpctx, "Opening external file %s took %.3f ms.\n",
+               disp_filename, f->open_time / 1e3);
+    stats_histogram_us(mpctx->stats, "open-external", f->open_time);
+
     if (filter != STREAM_SUB && opts->rebase_start_time)
         demux_set_ts_offset(demuxer, -demuxer->start_time);
 
@@ -815,7 +850,7 @@ int mp_add_external_file(struct MPContext *mpctx, char *filename,
         } else {
             t->title = talloc_strdup(t, mp_basename(disp_filename));
         }
-        t->external_filename = talloc_strdup(t, filename);
+        t->external_filename = talloc_strdup(t, f->filename);
         t->no_default = sh->type != filter;
         t->no_auto_select = t->no_default;
         if (first_num < 0 && (filter == STREAM_TYPE_COUNT || sh->type == filter))
@@ -828,21 +863,95 @@ int mp_add_external_file(struct MPContext *mpctx, char *filename,
 
 err_out:
     demux_cancel_and_free(demuxer);
-    if (!mp_cancel_test(cancel))
+    if (!mp_cancel_test(f->cancel))
         MP_ERR(mpctx, "Can not open external file %s.\n", disp_filename);
     return -1;
 }
 
+// Open all files concurrently, and add them in order. Sets first[n] to the
+// first track index for files[n] (or -1 on failure).
+// To be run on a worker thread, locked (temporarily unlocks core).
+static void add_external_files(struct MPContext *mpctx,
+                               struct external_file *files, int num_files,
+                               int *first)
+{
+    bool *threaded = talloc_zero_array(NULL, bool, num_files);
+
+    mp_core_unlock(mpctx);
+
+    // Use a worker per file if possible; open the rest on this thread. (The
+    // thread pool has a maximum size, and this is running on it already.)
+    for (int n = 0; n < num_files; n++) {
+        threaded[n] = num_files > 1 &&
+            mp_thread_pool_run(mpctx->thread_pool, open_external_file_thread,
+                               &files[n]);
+    }
+    for (int n = 0; n < num_files; n++) {
+        if (!threaded[n] && !mp_cancel_test(files[n].cancel))
+            open_external_file(&files[n]);
+    }
+    for (int n = 0; n < num_files; n++) {
+        if (threaded[n])
+            mp_waiter_wait(&files[n].waiter);
+        if (files[n].demuxer)
+            enable_demux_thread(mpctx, files[n].demuxer);
+    }
+
+    mp_core_lock(mpctx);
+
+    for (int n = 0; n < num_files; n++)
+        first[n] = add_external_file(mpctx, &files[n]);
+
+    talloc_free(threaded);
+}
+
+// Add the given file as additional track. The filter argument controls how or
+// if tracks are auto-selected at any point.
+// To be run on a worker thread, locked (temporarily unlocks core).
+// cancel will generally be used to abort the loading process, but on success
+// the demuxer is changed to be slaved to mpctx->playback_abort instead.
+int mp_add_external_file(struct MPContext *mpctx, char *filename,
+                         enum stream_type filter, struct mp_cancel *cancel)
+{
+    if (!filename || mp_cancel_test(cancel))
+        return -1;
+
+    struct external_file f;
+    init_external_file(mpctx, &f, filename, filter, cancel);
+
+    int first;
+    add_external_files(mpctx, &f, 1, &first);
+    return first;
+}
+
 // to be run on a worker thread, locked (temporarily unlocks core)
-static void open_external_files(struct MPContext *mpctx, char **files,
-                                enum stream_type filter)
+static void open_external_files(struct MPContext *mpctx)
 {
+    struct MPOpts *opts = mpctx->opts;
+
     // Need a copy, because the option value could be mutated during iteration.
     void *tmp = talloc_new(NULL);
-    files = mp_dup_str_array(tmp, files);
+    struct {
+        char **files;
+        enum stream_type filter;
+    } lists[] = {
+        {mp_dup_str_array(tmp, opts->audio_files), STREAM_AUDIO},
+        {mp_dup_str_array(tmp, opts->sub_name), STREAM_SUB},
+        {mp_dup_str_array(tmp, opts->external_files), STREAM_TYPE_COUNT},
+    };
 
-    for (int n = 0; files && files[n]; n++)
-        mp_add_external_file(mpctx, files[n], filter, mpctx->playback_abort);
+    struct external_file *files = NULL;
+    int num_files = 0;
+    for (int i = 0; i < MP_ARRAY_SIZE(lists); i++) {
+        for (int n = 0; lists[i].files && lists[i].files[n]; n++) {
+            MP_TARRAY_GROW(tmp, files, num_files);
+            init_external_file(mpctx, &files[num_files++], lists[i].files[n],
+                               lists[i].filter, mpctx->playback_abort);
+        }
+    }
+
+    int *first = talloc_array(tmp, int, num_files);
+    add_external_files(mpctx, files, num_files, first);
 
     talloc_free(tmp);
 }
@@ -854,10 +963,26 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
         return;
     if (!mpctx->opts->autoload_files || strcmp(mpctx->filename, "-") == 0)
         return;
+    if (mp_cancel_test(cancel))
+        return;
 
     void *tmp = talloc_new(NULL);
-    struct subfn *list = find_external_files(mpctx->global, mpctx->filename,
-                                             mpctx->opts);
+    struct subfn *list = NULL;
+    if (mpctx->external_files_url &&
+        strcmp(mpctx->external_files_url, mpctx->filename) == 0 &&
+        find_external_files_same_opts(mpctx->external_files_opts, mpctx->opts))
+    {
+        // Already scanned by the prefetcher, and per-file options or profiles
+        // did not change the result.
+        list = mpctx->external_files;
+        mpctx->external_files = NULL;
+    } else {
+        list = find_external_files(mpctx->global, mpctx->filename,
+                                   mpctx->opts);
+    }
+    TA_FREEP(&mpctx->external_files);
+    TA_FREEP(&mpctx->external_files_opts);
+    TA_FREEP(&mpctx->external_files_url);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -866,9 +991,11 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
             sc[mpctx->tracks[n]->type]++;
     }
 
+    struct external_file *files = NULL;
+    char **langs = NULL;
+    int num_files = 0;
     for (int i = 0; list && list[i].fname; i++) {
         char *filename = list[i].fname;
-        char *lang = list[i].lang;
         for (int n = 0; n < mpctx->num_tracks; n++) {
             struct track *t = mpctx->tracks[n];
             if (t->demuxer && strcmp(t->demuxer->filename, filename) == 0)
@@ -878,17 +1005,34 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
             goto skip;
         if (list[i].type == STREAM_AUDIO && !sc[STREAM_VIDEO])
             goto skip;
-        int first = mp_add_external_file(mpctx, filename, list[i].type, cancel);
-        if (first < 0)
-            goto skip;
+        MP_TARRAY_GROW(tmp, files, num_files);
+        MP_TARRAY_GROW(tmp, langs, num_files);
+        init_external_file(mpctx, &files[num_files], filename, list[i].type,
+                           cancel);
+        langs[num_files++] = list[i].lang;
+    skip:;
+    }
+
+    int *first = talloc_array(tmp, int, num_files);
+    add_external_files(mpctx, files, num_files, first);
 
-        for (int n = first; n < mpctx->num_tracks; n++) {
+    for (int i = 0; i < num_files; i++) {
+        if (first[i] < 0)
+            continue;
+        // (Tracks of later files were added after this one's.)
+        int end = mpctx->num_tracks;
+        for (int j = i + 1; j < num_files; j++) {
+            if (first[j] >= 0) {
+                end = first[j];
+                break;
+            }
+        }
+        for (int n = first[i]; n < end; n++) {
             struct track *t = mpctx->tracks[n];
             t->auto_loaded = true;
             if (!t->lang)
-                t->lang = talloc_strdup(t, lang);
+                t->lang = talloc_strdup(t, langs[i]);
         }
-    skip:;
     }
 
     talloc_free(tmp);
@@ -999,26 +1143,30 @@ static void load_per_file_options(m_config_t *conf,
     }
 }
 
+// Limit for --prefetch-playlist-depth.
+#define MAX_PREFETCH_DEPTH 16
+
 static void *open_demux_thread(void *ctx)
 {
-    struct MPContext *mpctx = ctx;
+    struct mp_opener *o = ctx;
+    struct MPContext *mpctx = o->mpctx;
 
     mpthread_set_name("opener");
 
     struct demuxer_params p = {
-        .force_format = mpctx->open_format,
-        .stream_flags = mpctx->open_url_flags,
+        .force_format = o->format,
+        .stream_flags = o->url_flags,
         .stream_record = true,
         .is_top_level = true,
     };
     struct demuxer *demux =
-        demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
-    mpctx->open_res_demuxer = demux;
+        demux_open_url(o->url, &p, o->cancel, mpctx->global);
+    o->res_demuxer = demux;
 
     if (demux) {
-        MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
+        MP_VERBOSE(mpctx, "Opening done: %s\n", o->url);
 
-        if (mpctx->open_for_prefetch && !demux->fully_read) {
+        if (o->for_prefetch && !demux->fully_read) {
             int num_streams = demux_get_num_stream(demux);
             for (int n = 0; n < num_streams; n++) {
                 struct sh_stream *sh = demux_get_stream(demux, n);
@@ -1029,112 +1177,198 @@ static void *open_demux_thread(void *ctx)
             demux_start_thread(demux);
             demux_start_prefetch(demux);
         }
+
+        // Scanning the directory for external files can be slow (e.g. on
+        // network filesystems), so do it here. Uses a snapshot of the options,
+        // which is compared to the options the file is actually played with.
+        if (o->for_prefetch && !mp_cancel_test(o->cancel)) {
+            struct MPOpts *opts =
+                mp_get_config_group(NULL, mpctx->global, &mp_opt_root);
+            if ((opts->sub_auto >= 0 || opts->audiofile_auto >= 0) &&
+                opts->autoload_files && strcmp(o->url, "-") != 0)
+            {
+                o->res_external_files =
+                    find_external_files(mpctx->global, o->url, opts);
+                o->res_external_files_opts = opts;
+            } else {
+                talloc_free(opts);
+            }
+        }
     } else {
-        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", mpctx->open_url);
+        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", o->url);
 
         if (p.demuxer_failed) {
-            mpctx->open_res_error = MPV_ERROR_UNKNOWN_FORMAT;
+            o->res_error = MPV_ERROR_UNKNOWN_FORMAT;
         } else {
-            mpctx->open_res_error = MPV_ERROR_LOADING_FAILED;
+            o->res_error = MPV_ERROR_LOADING_FAILED;
         }
     }
 
-    atomic_store(&mpctx->open_done, true);
+    atomic_store(&o->done, true);
     mp_wakeup_core(mpctx);
     return NULL;
 }
 
-static void cancel_open(struct MPContext *mpctx)
+static void cancel_open(struct MPContext *mpctx, struct mp_opener *o)
 {
-    if (mpctx->open_cancel)
-        mp_cancel_trigger(mpctx->open_cancel);
+    for (int n = 0; n < mpctx->num_openers; n++) {
+        if (mpctx->openers[n] == o) {
+            MP_TARRAY_REMOVE_AT(mpctx->openers, mpctx->num_openers, n);
+            break;
+        }
+    }
 
-    if (mpctx->open_active)
-        pthread_join(mpctx->open_thread, NULL);
-    mpctx->open_active = false;
+    mp_cancel_trigger(o->cancel);
+    pthread_join(o->thread, NULL);
 
-    if (mpctx->open_res_demuxer)
-        demux_cancel_and_free(mpctx->open_res_demuxer);
-    mpctx->open_res_demuxer = NULL;
+    if (o->res_demuxer)
+        demux_cancel_and_free(o->res_demuxer);
+    talloc_free(o->res_external_files);
+    talloc_free(o->res_external_files_opts);
 
-    TA_FREEP(&mpctx->open_cancel);
-    TA_FREEP(&mpctx->open_url);
-    TA_FREEP(&mpctx->open_format);
+    talloc_free(o);
+}
 
-    atomic_store(&mpctx->open_done, false);
+static void cancel_all_opens(struct MPContext *mpctx)
+{
+    while (mpctx->num_openers)
+        cancel_open(mpctx, mpctx->openers[mpctx->num_openers - 1]);
 }
 
-// Setup all the field to open this url, and make sure a thread is running.
-static void start_open(struct MPContext *mpctx, char *url, int url_flags,
-                       bool for_prefetch)
+static struct mp_opener *find_open(struct MPContext *mpctx, const char *url)
 {
-    cancel_open(mpctx);
+    for (int n = 0; n < mpctx->num_openers; n++) {
+        if (strcmp(mpctx->openers[n]->url, url) == 0)
+            return mpctx->openers[n];
+    }
+    return NULL;
+}
 
-    assert(!mpctx->open_active);
-    assert(!mpctx->open_cancel);
-    assert(!mpctx->open_res_demuxer);
-    assert(!atomic_load(&mpctx->open_done));
+// Start a thread to open this url.
+static struct mp_opener *start_open(struct MPContext *mpctx, char *url,
+                                    int url_flags, bool for_prefetch)
+{
+    struct mp_opener *o = talloc_zero(NULL, struct mp_opener);
+    o->mpctx = mpctx;
+    o->cancel = talloc_steal(o, mp_cancel_new(NULL));
+    o->url = talloc_strdup(o, url);
+    o->format = talloc_strdup(o, mpctx->opts->demuxer_name);
+    o->url_flags = url_flags;
+    o->for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+    atomic_init(&o->done, false);
+
+    if (pthread_create(&o->thread, NULL, open_demux_thread, o)) {
+        talloc_free(o);
+        return NULL;
+    }
 
-    mpctx->open_cancel = mp_cancel_new(NULL);
-    mpctx->open_url = talloc_strdup(NULL, url);
-    mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
-    mpctx->open_url_flags = url_flags;
-    mpctx->open_for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+    MP_TARRAY_APPEND(mpctx, mpctx->openers, mpctx->num_openers, o);
+    return o;
+}
 
-    if (pthread_create(&mpctx->open_thread, NULL, open_demux_thread, mpctx)) {
-        cancel_open(mpctx);
-        return;
+// Return the URLs of the next playlist entries that should be prefetched. The
+// returned entries are unique, and at most --prefetch-playlist-depth of them.
+static int get_prefetch_entries(struct MPContext *mpctx,
+                                struct playlist_entry **entries, int max)
+{
+    int num = 0;
+    struct playlist_entry *e = mp_next_file(mpctx, +1, false, false);
+    for (; e && num < max && num < mpctx->opts->prefetch_depth;
+         e = playlist_entry_get_rel(e, 1))
+    {
+        if (!e->filename || e == mpctx->playing)
+            continue;
+        for (int n = 0; n < num; n++) {
+            if (strcmp(entries[n]->filename, e->filename) == 0)
+                goto skip;
+        }
+        entries[num++] = e;
+    skip:;
     }
+    return num;
+}
 
-    mpctx->open_active = true;
+// Abort prefetches that are not wanted anymore, e.g. because the playlist was
+// edited or the user skipped entries. keep is never aborted.
+static void drop_stale_opens(struct MPContext *mpctx, struct mp_opener *keep,
+                             struct playlist_entry **entries, int num_entries)
+{
+    for (int n = mpctx->num_openers - 1; n >= 0; n--) {
+        struct mp_opener *o = mpctx->openers[n];
+        if (o == keep)
+            continue;
+        bool wanted = false;
+        for (int i = 0; i < num_entries; i++)
+            wanted |= strcmp(entries[i]->filename, o->url) == 0;
+        if (!wanted) {
+            MP_VERBOSE(mpctx, "Dropping prefetch of %s.\n", o->url);
+            cancel_open(mpctx, o);
+        }
+    }
 }
 
 static void open_demux_reentrant(struct MPContext *mpctx)
 {
     char *url = mpctx->stream_open_filename;
 
-    if (mpctx->open_active) {
-        bool done = atomic_load(&mpctx->open_done);
-        bool failed = done && !mpctx->open_res_demuxer;
-        bool correct_url = strcmp(mpctx->open_url, url) == 0;
-
-        if (correct_url && !failed) {
-            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
-        } else if (correct_url && failed) {
+    struct mp_opener *o = find_open(mpctx, url);
+    if (o) {
+        bool failed = atomic_load(&o->done) && !o->res_demuxer;
+        if (failed) {
             MP_VERBOSE(mpctx, "Prefetched URL failed, retrying.\n");
-            cancel_open(mpctx);
+            cancel_open(mpctx, o);
+            o = NULL;
         } else {
-            if (done) {
-                MP_VERBOSE(mpctx, "Dropping finished prefetch of wrong URL.\n");
-            } else {
-                MP_VERBOSE(mpctx, "Aborting ongoing prefetch of wrong URL.\n");
-            }
-            cancel_open(mpctx);
+            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
         }
     }
 
-    if (!mpctx->open_active)
-        start_open(mpctx, url, mpctx->playing->stream_flags, false);
+    if (mpctx->opts->prefetch_open) {
+        struct playlist_entry *entries[MAX_PREFETCH_DEPTH];
+        int num_entries =
+            get_prefetch_entries(mpctx, entries, MAX_PREFETCH_DEPTH);
+        drop_stale_opens(mpctx, o, entries, num_entries);
+    } else {
+        drop_stale_opens(mpctx, o, NULL, 0);
+    }
+
+    if (!o)
+        o = start_open(mpctx, url, mpctx->playing->stream_flags, false);
+    if (!o) {
+        mpctx->error_playing = MPV_ERROR_LOADING_FAILED;
+        return;
+    }
 
     // User abort should cancel the opener now.
-    mp_cancel_set_parent(mpctx->open_cancel, mpctx->playback_abort);
+    mp_cancel_set_parent(o->cancel, mpctx->playback_abort);
 
-    while (!atomic_load(&mpctx->open_done)) {
+    while (!atomic_load(&o->done)) {
         mp_idle(mpctx);
 
         if (mpctx->stop_play)
             mp_abort_playback_async(mpctx);
     }
 
-    if (mpctx->open_res_demuxer) {
-        mpctx->demuxer = mpctx->open_res_demuxer;
-        mpctx->open_res_demuxer = NULL;
+    if (o->res_demuxer) {
+        mpctx->demuxer = o->res_demuxer;
+        o->res_demuxer = NULL;
         mp_cancel_set_parent(mpctx->demuxer->cancel, mpctx->playback_abort);
+        if (o->res_external_files) {
+            talloc_free(mpctx->external_files);
+            mpctx->external_files = talloc_steal(mpctx, o->res_external_files);
+            o->res_external_files = NULL;
+            talloc_free(mpctx->external_files_opts);
+            mpctx->external_files_opts =
+                talloc_steal(mpctx, o->res_external_files_opts);
+            o->res_external_files_opts = NULL;
+            talloc_free(mpctx->external_files_url);
+            mpctx->external_files_url = talloc_strdup(mpctx, o->url);
+        }
     } else {
-        mpctx->error_playing = mpctx->open_res_error;
+        mpctx->error_playing = o->res_error;
     }
 
-    cancel_open(mpctx); // cleanup
+    cancel_open(mpctx, o); // cleanup
 }
 
 void prefetch_next(struct MPContext *mpctx)
@@ -1142,10 +1376,17 @@ void prefetch_next(struct MPContext *mpctx)
     if (!mpctx->opts->prefetch_open)
         return;
 
-    struct playlist_entry *new_entry = mp_next_file(mpctx, +1, false, false);
-    if (new_entry && !mpctx->open_active && new_entry->filename) {
-        MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
-        start_open(mpctx, new_entry->filename, new_entry->stream_flags, true);
+    struct playlist_entry *entries[MAX_PREFETCH_DEPTH];
+    int num_entries = get_prefetch_entries(mpctx, entries, MAX_PREFETCH_DEPTH);
+
+    drop_stale_opens(mpctx, NULL, entries, num_entries);
+
+    for (int n = 0; n < num_entries; n++) {
+        struct playlist_entry *e = entries[n];
+        if (!find_open(mpctx, e->filename)) {
+            MP_VERBOSE(mpctx, "Prefetching: %s\n", e->filename);
+            start_open(mpctx, e->filename, e->stream_flags, true);
+        }
     }
 }
 
@@ -1353,9 +1594,7 @@ static void load_external_opts_thread(void *p)
     mp_core_lock(mpctx);
 
     load_chapters(mpctx);
-    open_external_files(mpctx, mpctx->opts->audio_files, STREAM_AUDIO);
-    open_external_files(mpctx, mpctx->opts->sub_name, STREAM_SUB);
-    open_external_files(mpctx, mpctx->opts->external_files, STREAM_TYPE_COUNT);
+    open_external_files(mpctx);
     autoload_external_files(mpctx, mpctx->playback_abort);
 
     mp_waiter_wakeup(waiter, 0);
@@ -1676,6 +1915,9 @@ terminate_playback:
     m_config_restore_backups(mpctx->mconfig);
 
     TA_FREEP(&mpctx->filter_root);
+    TA_FREEP(&mpctx->external_files);
+    TA_FREEP(&mpctx->external_files_opts);
+    TA_FREEP(&mpctx->external_files_url);
     talloc_free(mpctx->filtered_tags);
     mpctx->filtered_tags = NULL;
 
@@ -1836,7 +2078,7 @@ void mp_play_files(struct MPContext *mpctx)
             break;
     }
 
-    cancel_open(mpctx);
+    cancel_all_opens(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         // Make sure all streams get finished.
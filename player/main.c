@@ -58,6 +58,7 @@
 #include "misc/thread_tools.h"
 #include "sub/osd.h"
 #include "test/tests.h"
+#include "video/mp_image_pool.h"
 #include "video/out/vo.h"
 
 #include "core.h"
@@ -167,6 +168,9 @@ void mp_destroy(struct MPContext *mpctx)
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
+    // Drop this instance's share of the process-wide image pool.
+    mp_image_pool_set_global_budget(mpctx, 0);
+
     // If it's still set here, it's an error.
     encode_lavc_free(mpctx->encode_lavc_ctx);
     mpctx->encode_lavc_ctx = NULL;
@@ -56,7 +56,9 @@
 // mp_wait_events() was called.
 void mp_wait_events(struct MPContext *mpctx)
 {
+    stats_time_start(mpctx->stats, "property-changes");
     mp_client_send_property_changes(mpctx);
+    stats_time_end(mpctx->stats, "property-changes");
 
     stats_event(mpctx->stats, "iterations");
 
@@ -22,6 +22,8 @@
 #include <strings.h>
 #include <assert.h>
 
+#include <libavutil/buffer.h>
+
 #include "osdep/io.h"
 
 #include "mpv_talloc.h"
@@ -721,6 +723,29 @@ bool stream_seek(stream_t *s, int64_t pos)
     return stream_seek_unbuffered(s, pos);
 }
 
+// Read len bytes by returning a reference to the stream's own copy of the data,
+// if the stream supports this (e.g. local files with --file-mmap). Otherwise,
+// return NULL without changing the stream position. On success, the data is
+// skipped, but not copied to the stream buffer.
+struct AVBufferRef *stream_read_ref(stream_t *s, int len)
+{
+    if (!s->read_ref || len < 0)
+        return NULL;
+
+    int64_t pos = stream_tell(s);
+    struct AVBufferRef *ref = s->read_ref(s, pos, len);
+    if (!ref)
+        return NULL;
+
+    if (len <= s->buf_end - s->buf_cur) {
+        s->buf_cur += len;
+    } else if (!stream_seek_unbuffered(s, pos + len)) {
+        av_buffer_unref(&ref);
+        stream_seek(s, pos);
+    }
+    return ref;
+}
+
 // Like stream_seek(), but strictly prefer skipping data instead of failing, if
 // it's a forward-seek.
 bool stream_seek_skip(stream_t *s, int64_t pos)
@@ -19,6 +19,7 @@
 #define MPLAYER_STREAM_H
 
 #include "common/msg.h"
+#include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -101,6 +102,7 @@ struct stream_avseek {
 
 struct stream;
 struct stream_open_args;
+struct AVBufferRef;
 typedef struct stream_info_st {
     const char *name;
     // opts is set from ->opts
@@ -128,6 +130,10 @@ typedef struct stream {
     int (*control)(struct stream *s, int cmd, void *arg);
     // Close
     void (*close)(struct stream *s);
+    // Optional. Return a reference to len bytes at pos without copying them,
+    // or NULL. The AV_INPUT_BUFFER_PADDING_SIZE bytes after the data must be
+    // readable and set to 0, as with normal packet buffers.
+    struct AVBufferRef *(*read_ref)(struct stream *s, int64_t pos, int len);
 
     int64_t pos;
     int eof; // valid only after read calls that returned a short result
@@ -197,6 +203,25 @@ inline static int stream_read_char(stream_t *s)
         : stream_read_char_fallback(s);
 }
 
+// Return the data buffered at the current position, and set *len to the number
+// of bytes that are contiguous in memory (possibly less than what is buffered,
+// due to wrap-around). This never reads from the stream. Use
+// stream_skip_buffered() to consume the data.
+inline static uint8_t *stream_peek_buffered(stream_t *s, int *len)
+{
+    unsigned int pos = s->buf_cur & s->buffer_mask;
+    unsigned int avail = s->buf_end - s->buf_cur;
+    unsigned int contiguous = s->buffer_mask + 1 - pos;
+    *len = avail < contiguous ? avail : contiguous;
+    return s->buffer + pos;
+}
+
+inline static void stream_skip_buffered(stream_t *s, int len)
+{
+    assert(len >= 0 && len <= s->buf_end - s->buf_cur);
+    s->buf_cur += len;
+}
+
 int stream_skip_bom(struct stream *s);
 
 inline static int64_t stream_tell(stream_t *s)
@@ -209,6 +234,7 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, void *mem, int total);
 int stream_read_partial(stream_t *s, void *buf, int buf_size);
 int stream_read_peek(stream_t *s, void *buf, int buf_size);
+struct AVBufferRef *stream_read_ref(stream_t *s, int len);
 void stream_drop_buffers(stream_t *s);
 int64_t stream_get_size(stream_t *s);
 
@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,12 +31,23 @@
 #include <poll.h>
 #endif
 
+#if HAVE_POSIX
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+#include <libavutil/buffer.h>
+#include <libavcodec/avcodec.h>
+
 #include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
 #include "misc/thread_tools.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -58,6 +70,39 @@
 #endif
 #endif
 
+// Readahead reads the file in chunks of this size.
+#define RA_CHUNK_SIZE (1024 * 1024)
+// Initial readahead window, in chunks.
+#define RA_MIN_CHUNKS 4
+// Maximum number of reads in flight.
+#define RA_THREADS 4
+// The window covers this many times the data consumed during a single read.
+#define RA_MARGIN 2
+// Smallest packet read via mmap with --file-mmap.
+#define MMAP_MIN_SIZE (64 * 1024)
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+struct stream_file_opts {
+    int readahead;
+    int64_t readahead_max;
+    int mmap;
+};
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const struct m_option[]){
+        {"file-readahead", OPT_CHOICE(readahead,
+            {"no", 0}, {"yes", 1}, {"network", 2})},
+        {"file-readahead-max", OPT_BYTE_SIZE(readahead_max),
+            M_RANGE(RA_CHUNK_SIZE * RA_MIN_CHUNKS, 1024 * 1024 * 1024)},
+        {"file-mmap", OPT_FLAG(mmap)},
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+    .defaults = &(const struct stream_file_opts){
+        .readahead_max = 64 * 1024 * 1024,
+    },
+};
+
 struct priv {
     int fd;
     bool close;
@@ -65,13 +110,366 @@ struct priv {
     bool regular_file;
     bool appending;
     int64_t orig_size;
+    time_t orig_mtime;
     struct mp_cancel *cancel;
+    struct readahead *ra;
+    bool use_mmap;
+    long page_size;
 };
 
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
 #define RETRY_TIMEOUT 0.2
 #define MAX_RETRIES 10
 
+#if HAVE_POSIX
+
+struct ra_chunk {
+    int64_t pos;
+    int len;            // valid data in data[] (only if done)
+    bool done;          // read finished
+    bool discard;       // removed while being read; freed by the reader
+    uint8_t data[RA_CHUNK_SIZE];
+};
+
+// Background reading for high latency filesystems. Several threads read the
+// chunks following the current position with pread(), so that multiple reads
+// are in flight. The window is sized from the measured read latency and the
+// rate at which the consumer reads (see ra_update_window()).
+struct readahead {
+    struct mp_log *log;
+    int fd;
+    pthread_t threads[RA_THREADS];
+    int num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+
+    // Chunks in file order. The first chunk contains pos, or is being read.
+    struct ra_chunk **chunks;
+    int num_chunks;
+    struct ra_chunk **free_chunks;
+    int num_free_chunks;
+    int window;         // current maximum num_chunks
+    int max_window;     // --file-readahead-max
+    int64_t pos;        // current consumer position
+    int64_t next_pos;   // start of the next chunk to read
+    int64_t eof_pos;    // end of file, if a short read was encountered
+
+    // Finished chunk reads, and the time they took in total.
+    int64_t reads;
+    int64_t read_time;
+    // Consumer statistics since the last seek that restarted reading.
+    int64_t start_time;
+    int64_t wait_time;  // time spent waiting in ra_read()
+    int64_t consumed;   // bytes returned by ra_read()
+};
+
+// Like pread(), but retry on short reads. Returns the number of bytes read.
+static int64_t pread_full(int fd, uint8_t *buf, int64_t len, int64_t pos)
+{
+    int64_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(fd, buf + done, len - done, pos + done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+static void *ra_thread(void *arg)
+{
+    struct readahead *ra = arg;
+    mpthread_set_name("file-readahead");
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->terminate) {
+        if (ra->num_chunks >= ra->window || ra->next_pos >= ra->eof_pos) {
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+
+        struct ra_chunk *c = NULL;
+        if (ra->num_free_chunks) {
+            c = ra->free_chunks[--ra->num_free_chunks];
+        } else {
+            c = talloc_ptrtype(NULL, c);
+        }
+        c->pos = ra->next_pos;
+        c->len = 0;
+        c->done = c->discard = false;
+        ra->next_pos += RA_CHUNK_SIZE;
+        MP_TARRAY_APPEND(ra, ra->chunks, ra->num_chunks, c);
+
+        pthread_mutex_unlock(&ra->lock);
+        int64_t start = mp_time_us();
+        int64_t r = pread_full(ra->fd, c->data, RA_CHUNK_SIZE, c->pos);
+        int64_t time = mp_time_us() - start;
+        pthread_mutex_lock(&ra->lock);
+
+        if (c->discard) {
+            MP_TARRAY_APPEND(ra, ra->free_chunks, ra->num_free_chunks, c);
+            continue;
+        }
+
+        c->len = r;
+        c->done = true;
+        if (r < RA_CHUNK_SIZE)
+            ra->eof_pos = MPMIN(ra->eof_pos, c->pos + r);
+        ra->reads++;
+        ra->read_time += time;
+        pthread_cond_broadcast(&ra->wakeup);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static void ra_wakeup(void *arg)
+{
+    struct readahead *ra = arg;
+    pthread_mutex_lock(&ra->lock);
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+static void ra_remove_first_chunk(struct readahead *ra)
+{
+    struct ra_chunk *c = ra->chunks[0];
+    MP_TARRAY_REMOVE_AT(ra->chunks, ra->num_chunks, 0);
+    if (c->done) {
+        MP_TARRAY_APPEND(ra, ra->free_chunks, ra->num_free_chunks, c);
+    } else {
+        c->discard = true;
+    }
+}
+
+// Set the read position. Chunks before it are dropped, and if the position is
+// not in the current window, reading restarts at the new position.
+static void ra_seek(struct readahead *ra, int64_t pos)
+{
+    pthread_mutex_lock(&ra->lock);
+    while (ra->num_chunks) {
+        struct ra_chunk *c = ra->chunks[0];
+        if (pos >= c->pos && pos < c->pos + RA_CHUNK_SIZE)
+            break;
+        ra_remove_first_chunk(ra);
+    }
+    if (!ra->num_chunks) {
+        ra->next_pos = pos;
+        ra->eof_pos = INT64_MAX;
+        // The access pattern after a seek might be different.
+        ra->window = RA_MIN_CHUNKS;
+        ra->start_time = mp_time_us();
+        ra->wait_time = ra->consumed = 0;
+    }
+    ra->pos = pos;
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+// Called when the consumer has to wait. Grow the window so that the chunks
+// ahead of the consumer cover the time a read takes, at the rate the consumer
+// reads data when it doesn't wait.
+static void ra_update_window(struct readahead *ra, int64_t now)
+{
+    double busy = (now - ra->start_time - ra->wait_time) / 1e6;
+    if (!ra->reads || !ra->consumed || busy <= 0)
+        return; // nothing measured yet, e.g. first read after a seek
+
+    double rate = ra->consumed / busy;
+    double latency = ra->read_time / 1e6 / ra->reads;
+    double chunks = ceil(rate * latency * RA_MARGIN / RA_CHUNK_SIZE) + RA_THREADS;
+    int window = MPCLAMP(chunks, RA_MIN_CHUNKS, ra->max_window);
+    if (window <= ra->window)
+        return;
+
+    ra->window = window;
+    MP_VERBOSE(ra, "readahead window: %d MiB (%.1f MiB/s read rate, %.1f ms "
+               "per read)\n", ra->window * RA_CHUNK_SIZE / (1024 * 1024),
+               rate / (1024 * 1024), latency * 1e3);
+    pthread_cond_broadcast(&ra->wakeup);
+}
+
+// Returns the number of bytes read, 0 if there is no readahead data at the
+// current position (EOF or read error; the caller is supposed to retry with a
+// normal read), or -1 if cancelled.
+static int ra_read(struct readahead *ra, struct mp_cancel *cancel,
+                   void *buffer, int max_len)
+{
+    int res = 0;
+    int64_t wait_start = 0;
+
+    pthread_mutex_lock(&ra->lock);
+    while (1) {
+        if (!ra->num_chunks && ra->next_pos >= ra->eof_pos)
+            break; // at EOF
+
+        struct ra_chunk *c = ra->num_chunks ? ra->chunks[0] : NULL;
+        if (!c || !c->done) {
+            if (mp_cancel_test(cancel)) {
+                res = -1;
+                break;
+            }
+            // The window was too small to hide the read latency.
+            if (!wait_start) {
+                wait_start = mp_time_us();
+                ra_update_window(ra, wait_start);
+            }
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+
+        int64_t offset = ra->pos - c->pos;
+        if (offset >= c->len)
+            break; // at EOF, or read error
+
+        res = MPMIN(max_len, c->len - offset);
+        memcpy(buffer, c->data + offset, res);
+        ra->pos += res;
+        ra->consumed += res;
+        if (ra->pos >= c->pos + RA_CHUNK_SIZE) {
+            ra_remove_first_chunk(ra);
+            pthread_cond_broadcast(&ra->wakeup);
+        }
+        break;
+    }
+    if (wait_start)
+        ra->wait_time += mp_time_us() - wait_start;
+    pthread_mutex_unlock(&ra->lock);
+
+    return res;
+}
+
+static void ra_destroy(struct readahead *ra)
+{
+    if (!ra)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->terminate = true;
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+
+    for (int n = 0; n < ra->num_threads; n++)
+        pthread_join(ra->threads[n], NULL);
+
+    for (int n = 0; n < ra->num_chunks; n++)
+        talloc_free(ra->chunks[n]);
+    for (int n = 0; n < ra->num_free_chunks; n++)
+        talloc_free(ra->free_chunks[n]);
+
+    pthread_cond_destroy(&ra->wakeup);
+    pthread_mutex_destroy(&ra->lock);
+    talloc_free(ra);
+}
+
+static struct readahead *ra_create(struct stream *s, int fd, int64_t max_bytes)
+{
+    struct readahead *ra = talloc_zero(NULL, struct readahead);
+    ra->log = s->log;
+    ra->fd = fd;
+    ra->window = RA_MIN_CHUNKS;
+    ra->max_window = MPMAX(max_bytes / RA_CHUNK_SIZE, RA_MIN_CHUNKS);
+    ra->eof_pos = INT64_MAX;
+    ra->start_time = mp_time_us();
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->wakeup, NULL);
+
+    for (int n = 0; n < RA_THREADS; n++) {
+        if (pthread_create(&ra->threads[n], NULL, ra_thread, ra))
+            break;
+        ra->num_threads++;
+    }
+
+    if (!ra->num_threads) {
+        ra_destroy(ra);
+        return NULL;
+    }
+
+    return ra;
+}
+
+// A part of the file mapped for a single packet. Every packet gets its own
+// private mapping, so the padding after the packet data can be cleared without
+// affecting the data of the following packet. Only the last page is copied.
+struct packet_map {
+    void *data;
+    size_t size;
+};
+
+static void unref_map(void *opaque, uint8_t *data)
+{
+    struct packet_map *map = opaque;
+    munmap(map->data, map->size);
+    talloc_free(map);
+}
+
+// Whether the file changed since it was opened. Reading a mapping beyond the
+// end of a truncated file raises SIGBUS, so stop using mmap as soon as this is
+// noticed.
+static bool file_changed(stream_t *s)
+{
+    struct priv *p = s->priv;
+    struct stat st;
+    if (fstat(p->fd, &st) == 0 && st.st_size == p->orig_size &&
+        st.st_mtime == p->orig_mtime)
+        return false;
+    MP_WARN(s, "File changed during playback, disabling --file-mmap.\n");
+    p->use_mmap = false;
+    return true;
+}
+
+static struct AVBufferRef *read_ref(stream_t *s, int64_t pos, int len)
+{
+    struct priv *p = s->priv;
+    int pad = AV_INPUT_BUFFER_PADDING_SIZE;
+    // Copying small packets is cheaper than setting up a mapping.
+    if (!p->use_mmap || len < MMAP_MIN_SIZE || pos < 0 ||
+        pos > p->orig_size - len - pad || file_changed(s))
+        return NULL;
+
+    int64_t offset = pos & ~(int64_t)(p->page_size - 1);
+    size_t skip = pos - offset;
+    size_t size = skip + len + pad;
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, p->fd,
+                      offset);
+    if (data == MAP_FAILED)
+        return NULL;
+    memset((uint8_t *)data + skip + len, 0, pad);
+
+    struct packet_map *map = talloc_ptrtype(NULL, map);
+    *map = (struct packet_map){data, size};
+    AVBufferRef *ref = av_buffer_create((uint8_t *)data + skip, len, unref_map,
+                                        map, AV_BUFFER_FLAG_READONLY);
+    if (!ref)
+        unref_map(map, NULL);
+    return ref;
+}
+
+#else
+
+struct readahead;
+
+static struct AVBufferRef *read_ref(stream_t *s, int64_t pos, int len)
+{
+    return NULL;
+}
+
+static void ra_seek(struct readahead *ra, int64_t pos) {}
+static int ra_read(struct readahead *ra, struct mp_cancel *cancel,
+                   void *buffer, int max_len) { return 0; }
+static void ra_destroy(struct readahead *ra) {}
+static void ra_wakeup(void *arg) {}
+static struct readahead *ra_create(struct stream *s, int fd, int64_t max_bytes)
+{
+    return NULL;
+}
+
+#endif
+
 static int64_t get_size(stream_t *s)
 {
     struct priv *p = s->priv;
@@ -89,6 +487,16 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
 {
     struct priv *p = s->priv;
 
+    if (p->ra) {
+        int r = ra_read(p->ra, p->cancel, buffer, max_len);
+        if (r)
+            return r;
+        // Read synchronously at the end of the file, so appending files are
+        // handled as usual.
+        if (lseek(p->fd, s->pos, SEEK_SET) == (off_t)-1)
+            return 0;
+    }
+
 #ifndef __MINGW32__
     if (p->use_poll) {
         int c = mp_cancel_get_fd(p->cancel);
@@ -104,8 +512,11 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
 
     for (int retries = 0; retries < MAX_RETRIES; retries++) {
         int r = read(p->fd, buffer, max_len);
-        if (r > 0)
+        if (r > 0) {
+            if (p->ra)
+                ra_seek(p->ra, s->pos + r);
             return r;
+        }
 
         // Try to detect and handle files being appended during playback.
         int64_t size = get_size(s);
@@ -134,12 +545,20 @@ static int write_buffer(stream_t *s, void *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
-    return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
+    if (lseek(p->fd, newpos, SEEK_SET) == (off_t)-1)
+        return 0;
+    if (p->ra)
+        ra_seek(p->ra, newpos);
+    return 1;
 }
 
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->ra) {
+        mp_cancel_set_cb(p->cancel, NULL, NULL);
+        ra_destroy(p->ra);
+    }
     if (p->close)
         close(p->fd);
 }
@@ -345,6 +764,30 @@ static int open_f(stream_t *stream)
     if (stream->cancel)
         mp_cancel_set_parent(p->cancel, stream->cancel);
 
+    struct stream_file_opts *opts =
+        mp_get_config_group(stream, stream->global, &stream_file_conf);
+    bool use_ra = opts->readahead == 1 ||
+                  (opts->readahead == 2 && stream->streaming);
+#if HAVE_POSIX
+    if (opts->mmap && !write && p->regular_file && !p->appending &&
+        p->orig_size > 0)
+    {
+        p->use_mmap = true;
+        p->page_size = sysconf(_SC_PAGESIZE);
+        p->orig_mtime = st.st_mtime; // regular_file implies fstat() worked
+        stream->read_ref = read_ref;
+        use_ra = false;
+    }
+#endif
+    if (use_ra && !write && p->regular_file && !p->appending &&
+        stream->seekable)
+    {
+        p->ra = ra_create(stream, p->fd, opts->readahead_max);
+        if (p->ra)
+            mp_cancel_set_cb(p->cancel, ra_wakeup, p->ra);
+    }
+    talloc_free(opts);
+
     return STREAM_OK;
 }
 
@@ -20,11 +20,13 @@
 #include <assert.h>
 #include <math.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include <libswscale/swscale.h>
 
 #include "common/common.h"
 #include "draw_bmp.h"
+#include "draw_bmp_simd.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
@@ -49,11 +51,42 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Number of consecutive calls the bitmaps in a region must stay the same
+// before the region is pre-rendered. Rendering an overlay costs about twice as
+// much as drawing directly, so content that changes on every frame (animated
+// subtitles, karaoke, OSD text) is never cached.
+#define OVERLAY_MIN_FRAMES 3
+
+// Premultiplied overlay for one bounding box. Applying it is equivalent to
+// drawing all bitmaps: dst = c + dst * t / max (max is the component maximum).
+struct overlay_region {
+    struct mp_rect bb;
+    uint64_t hash;          // of the bitmaps within bb (see hash_region())
+    int frames;             // consecutive calls with the same bitmaps
+    struct mp_image *c, *t; // NULL if not rendered (yet)
+};
+
+// The bitmaps of a sub_bitmaps, pre-rendered per region for a specific target
+// image format and size.
+struct overlay {
+    int change_id;
+    int imgfmt, w, h;
+    enum mp_csp colorspace;
+    enum mp_csp_levels levels;
+    bool direct; // c/t are in the target format (else in the 444 format)
+    int num_regions;
+    struct overlay_region *regions;
+};
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
+    struct overlay *overlays[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    // Blend functions (optimized or C), indexed by bytes per component - 1.
+    mp_blend_const_alpha_fn blend_const_alpha[2];
+    mp_blend_src_alpha_fn blend_src_alpha[2];
 };
 
 
@@ -74,22 +107,43 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
         dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025; \
     }
 
+static void blend_const_alpha_8(void *dst, int dst_stride, int srcp,
+                                uint8_t *srca, int srca_stride, uint8_t srcamul,
+                                int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        void *dst_rp = (uint8_t *)dst + dst_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        BLEND_CONST_ALPHA(uint8_t)
+    }
+}
+
+static void blend_const_alpha_16(void *dst, int dst_stride, int srcp,
+                                 uint8_t *srca, int srca_stride, uint8_t srcamul,
+                                 int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        void *dst_rp = (uint8_t *)dst + dst_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        BLEND_CONST_ALPHA(uint16_t)
+    }
+}
+
+mp_blend_const_alpha_fn mp_draw_bmp_c_const_alpha(int bytes)
+{
+    return bytes == 2 ? blend_const_alpha_16 : blend_const_alpha_8;
+}
+
 // dst = srcp * (srca * srcamul) + dst * (1 - (srca * srcamul))
-static void blend_const_alpha(void *dst, int dst_stride, int srcp,
+static void blend_const_alpha(struct mp_draw_sub_cache *cache,
+                              void *dst, int dst_stride, int srcp,
                               uint8_t *srca, int srca_stride, uint8_t srcamul,
                               int w, int h, int bytes)
 {
     if (!srcamul)
         return;
-    for (int y = 0; y < h; y++) {
-        void *dst_rp = (uint8_t *)dst + dst_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
-        if (bytes == 2) {
-            BLEND_CONST_ALPHA(uint16_t)
-        } else if (bytes == 1) {
-            BLEND_CONST_ALPHA(uint8_t)
-        }
-    }
+    cache->blend_const_alpha[bytes - 1](dst, dst_stride, srcp, srca,
+                                        srca_stride, srcamul, w, h);
 }
 
 #define BLEND_SRC_ALPHA(TYPE)                                                   \
@@ -100,44 +154,54 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
     }
 
-// dst = src * srca + dst * (1 - srca)
-static void blend_src_alpha(void *dst, int dst_stride, void *src,
-                            int src_stride, uint8_t *srca, int srca_stride,
-                            int w, int h, int bytes)
+static void blend_src_alpha_8(void *dst, int dst_stride, void *src,
+                              int src_stride, uint8_t *srca, int srca_stride,
+                              int w, int h)
 {
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         void *src_rp = (uint8_t *)src + src_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
-        if (bytes == 2) {
-            BLEND_SRC_ALPHA(uint16_t)
-        } else if (bytes == 1) {
-            BLEND_SRC_ALPHA(uint8_t)
-        }
+        BLEND_SRC_ALPHA(uint8_t)
     }
 }
 
-#define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
-    TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
-        uint16_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
-        dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
+static void blend_src_alpha_16(void *dst, int dst_stride, void *src,
+                               int src_stride, uint8_t *srca, int srca_stride,
+                               int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        void *dst_rp = (uint8_t *)dst + dst_stride * y;
+        void *src_rp = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        BLEND_SRC_ALPHA(uint16_t)
     }
+}
+
+mp_blend_src_alpha_fn mp_draw_bmp_c_src_alpha(int bytes)
+{
+    return bytes == 2 ? blend_src_alpha_16 : blend_src_alpha_8;
+}
+
+// dst = src * srca + dst * (1 - srca)
+static void blend_src_alpha(struct mp_draw_sub_cache *cache,
+                            void *dst, int dst_stride, void *src,
+                            int src_stride, uint8_t *srca, int srca_stride,
+                            int w, int h, int bytes)
+{
+    cache->blend_src_alpha[bytes - 1](dst, dst_stride, src, src_stride,
+                                      srca, srca_stride, w, h);
+}
 
 // dst = src * srcmul + dst * (1 - src * srcmul)
-static void blend_src_dst_mul(void *dst, int dst_stride,
+static void blend_src_dst_mul(struct mp_draw_sub_cache *cache,
+                              void *dst, int dst_stride,
                               uint8_t *src, int src_stride, uint8_t srcmul,
                               int w, int h, int dst_bytes)
 {
-    for (int y = 0; y < h; y++) {
-        void *dst_rp = (uint8_t *)dst + dst_stride * y;
-        uint8_t *src_r = (uint8_t *)src + src_stride * y;
-        if (dst_bytes == 2) {
-            BLEND_SRC_DST_MUL(uint16_t, 65025)
-        } else if (dst_bytes == 1) {
-            BLEND_SRC_DST_MUL(uint8_t, 255)
-        }
-    }
+    // This is the same as blending a constant color of the maximum value.
+    blend_const_alpha(cache, dst, dst_stride, dst_bytes == 2 ? 65025 : 255,
+                      src, src_stride, srcmul, w, h, dst_bytes);
 }
 
 static void unpremultiply_and_split_BGR32(struct mp_image *img,
@@ -232,11 +296,12 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         uint8_t *alpha_p = sba->planes[0] + src_y * sba->stride[0] + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
             void *src = sbi->planes[p] + src_y * sbi->stride[p] + src_x * bytes;
-            blend_src_alpha(dst.planes[p], dst.stride[p], src, sbi->stride[p],
-                            alpha_p, sba->stride[0], dst.w, dst.h, bytes);
+            blend_src_alpha(cache, dst.planes[p], dst.stride[p], src,
+                            sbi->stride[p], alpha_p, sba->stride[0],
+                            dst.w, dst.h, bytes);
         }
         if (temp->num_planes >= 4) {
-            blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
+            blend_src_dst_mul(cache, dst.planes[3], dst.stride[3], alpha_p,
                               sba->stride[0], 255, dst.w, dst.h, bytes);
         }
 
@@ -287,11 +352,12 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
-            blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
-                              alpha_p, sb->stride, a, dst.w, dst.h, bytes);
+            blend_const_alpha(cache, dst.planes[p], dst.stride[p],
+                              color_yuv[p], alpha_p, sb->stride, a,
+                              dst.w, dst.h, bytes);
         }
         if (temp->num_planes >= 4) {
-            blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
+            blend_src_dst_mul(cache, dst.planes[3], dst.stride[3], alpha_p,
                               sb->stride, a, dst.w, dst.h, bytes);
         }
     }
@@ -494,20 +560,21 @@ static void chroma_down(struct mp_image *old_src, struct mp_image *temp)
     }
 }
 
-static void draw_sbs(struct mp_draw_sub_cache **cache, struct mp_image *dst,
-                     struct sub_bitmaps *sbs)
+static void draw_bitmaps(struct mp_draw_sub_cache *cache, struct mp_rect bb,
+                         struct mp_image *temp, int bits,
+                         struct sub_bitmaps *sbs)
 {
-    assert(mp_draw_sub_formats[sbs->format]);
-    if (!mp_sws_supported_format(dst->imgfmt))
-        return;
-
-    struct mp_draw_sub_cache *cache_ = cache ? *cache : NULL;
-    if (!cache_)
-        cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
-
-    int format, bits;
-    get_closest_y444_format(dst->imgfmt, &format, &bits);
+    if (sbs->format == SUBBITMAP_RGBA) {
+        draw_rgba(cache, bb, temp, bits, sbs);
+    } else if (sbs->format == SUBBITMAP_LIBASS) {
+        draw_ass(cache, bb, temp, bits, sbs);
+    }
+}
 
+// Draw directly on dst (converting each bounding box to a 444 format and back).
+static void draw_regions(struct mp_draw_sub_cache *cache, struct mp_image *dst,
+                         struct sub_bitmaps *sbs, int format, int bits)
+{
     struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
     int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
 
@@ -519,18 +586,352 @@ static void draw_sbs(struct mp_draw_sub_cache **cache, struct mp_image *dst,
 
         struct mp_image dst_region = *dst;
         mp_image_crop_rc(&dst_region, bb);
-        struct mp_image *temp = chroma_up(cache_, format, &dst_region);
+        struct mp_image *temp = chroma_up(cache, format, &dst_region);
         if (!temp)
             continue; // on OOM, skip region
 
-        if (sbs->format == SUBBITMAP_RGBA) {
-            draw_rgba(cache_, bb, temp, bits, sbs);
-        } else if (sbs->format == SUBBITMAP_LIBASS) {
-            draw_ass(cache_, bb, temp, bits, sbs);
+        draw_bitmaps(cache, bb, temp, bits, sbs);
+
+        chroma_down(&dst_region, temp);
+    }
+}
+
+static void fill_image(struct mp_image *img, int value)
+{
+    for (int p = 0; p < img->num_planes; p++) {
+        int w = mp_image_plane_w(img, p);
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + img->stride[p] * y;
+            if (img->fmt.bpp[p] == 16) {
+                for (int x = 0; x < w; x++)
+                    ((uint16_t *)line)[x] = value;
+            } else {
+                memset(line, value, w);
+            }
+        }
+    }
+}
+
+#define OVERLAY_TRANSMITTANCE(TYPE)                                             \
+    TYPE *c_r = c_rp, *t_r = t_rp;                                              \
+    for (int x = 0; x < w; x++)                                                 \
+        t_r[x] = t_r[x] > c_r[x] ? t_r[x] - c_r[x] : 0;
+
+// c is the result of drawing on black, t the result of drawing on white (the
+// maximum value). Drawing is affine in the destination, so t - c is the
+// scaled transmittance. Overwrites t with it.
+static void get_transmittance(struct mp_image *c, struct mp_image *t)
+{
+    for (int p = 0; p < c->num_planes; p++) {
+        int w = mp_image_plane_w(c, p);
+        for (int y = 0; y < mp_image_plane_h(c, p); y++) {
+            void *c_rp = c->planes[p] + c->stride[p] * y;
+            void *t_rp = t->planes[p] + t->stride[p] * y;
+            if (c->fmt.bpp[p] == 16) {
+                OVERLAY_TRANSMITTANCE(uint16_t)
+            } else {
+                OVERLAY_TRANSMITTANCE(uint8_t)
+            }
+        }
+    }
+}
+
+#define OVERLAY_DOWNSAMPLE(TYPE)                                                \
+    for (int x = 0; x < w; x++) {                                               \
+        uint32_t sum = 0;                                                       \
+        for (int sy = 0; sy < (1 << ys); sy++) {                                \
+            TYPE *s_r = (TYPE *)(src->planes[p] + src->stride[p] *              \
+                                 ((y << ys) + sy));                             \
+            for (int sx = 0; sx < (1 << xs); sx++)                              \
+                sum += s_r[(x << xs) + sx];                                     \
+        }                                                                       \
+        ((TYPE *)d_rp)[x] = (sum + (1 << (xs + ys)) / 2) >> (xs + ys);          \
+    }
+
+// Convert src (444) to the plane layout of dst by averaging. This is the same
+// as what chroma_up() and chroma_down() do with the blended pixels.
+static void downsample_overlay(struct mp_image *dst, struct mp_image *src)
+{
+    for (int p = 0; p < dst->num_planes; p++) {
+        int xs = dst->fmt.xs[p], ys = dst->fmt.ys[p];
+        int w = mp_image_plane_w(dst, p);
+        for (int y = 0; y < mp_image_plane_h(dst, p); y++) {
+            void *d_rp = dst->planes[p] + dst->stride[p] * y;
+            if (dst->fmt.bpp[p] == 16) {
+                OVERLAY_DOWNSAMPLE(uint16_t)
+            } else {
+                OVERLAY_DOWNSAMPLE(uint8_t)
+            }
+        }
+    }
+}
+
+// Whether the 444 format has the same planes as dst, minus subsampling. Then
+// the overlay can be applied on dst directly, without chroma_up/chroma_down.
+static bool overlay_can_be_direct(struct mp_image *dst, int format)
+{
+    struct mp_imgfmt_desc d = dst->fmt;
+    struct mp_imgfmt_desc f = mp_imgfmt_get_desc(format);
+    int planar = MP_IMGFLAG_YUV_P | MP_IMGFLAG_RGB_P;
+    if (!(d.flags & planar) || (d.flags & planar) != (f.flags & planar) ||
+        !(d.flags & MP_IMGFLAG_NE) || d.num_planes != f.num_planes ||
+        d.component_bits != f.component_bits)
+        return false;
+    for (int p = 0; p < d.num_planes; p++) {
+        if (d.bpp[p] != f.bpp[p])
+            return false;
+    }
+    return true;
+}
+
+static void render_region(struct mp_draw_sub_cache *cache,
+                          struct overlay *ov, struct overlay_region *r,
+                          struct mp_image *dst, struct sub_bitmaps *sbs,
+                          int format, int bits)
+{
+    int w = r->bb.x1 - r->bb.x0, h = r->bb.y1 - r->bb.y0;
+    struct mp_image *c = mp_image_alloc(format, w, h);
+    struct mp_image *t = mp_image_alloc(format, w, h);
+    if (!c || !t) {
+        talloc_free(c);
+        talloc_free(t);
+        return;
+    }
+
+    // (Same as chroma_up().)
+    if (dst->fmt.flags & MP_IMGFLAG_YUV)
+        c->params.color = t->params.color = dst->params.color;
+
+    fill_image(c, 0);
+    fill_image(t, (1 << bits) - 1);
+
+    draw_bitmaps(cache, r->bb, c, bits, sbs);
+    draw_bitmaps(cache, r->bb, t, bits, sbs);
+
+    get_transmittance(c, t);
+
+    if (ov->direct && dst->imgfmt != format) {
+        struct mp_image *dc = mp_image_alloc(dst->imgfmt, w, h);
+        struct mp_image *dt = mp_image_alloc(dst->imgfmt, w, h);
+        if (dc && dt) {
+            downsample_overlay(dc, c);
+            downsample_overlay(dt, t);
+        }
+        talloc_free(c);
+        talloc_free(t);
+        c = dc;
+        t = dt;
+        if (!c || !t) {
+            talloc_free(c);
+            talloc_free(t);
+            return;
         }
+    }
+
+    r->c = talloc_steal(ov, c);
+    r->t = talloc_steal(ov, t);
+}
+
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    return (h ^ v) * 0x9E3779B97F4A7C15ULL;
+}
 
+// Hash everything that affects what draw_bitmaps() draws within bb.
+static uint64_t hash_region(struct sub_bitmaps *sbs, struct mp_rect bb)
+{
+    int bpp = sbs->format == SUBBITMAP_RGBA ? 4 : 1;
+    uint64_t h = sbs->format;
+    for (int n = 0; n < sbs->num_parts; n++) {
+        struct sub_bitmap *sb = &sbs->parts[n];
+        struct mp_rect rc = {sb->x, sb->y, sb->x + sb->dw, sb->y + sb->dh};
+        if (!mp_rect_intersection(&rc, &bb))
+            continue;
+        h = hash_mix(h, (uint64_t)(uint32_t)sb->x << 32 | (uint32_t)sb->y);
+        h = hash_mix(h, (uint64_t)(uint32_t)sb->w << 32 | (uint32_t)sb->h);
+        h = hash_mix(h, (uint64_t)(uint32_t)sb->dw << 32 | (uint32_t)sb->dh);
+        h = hash_mix(h, sb->libass.color);
+        for (int y = 0; y < sb->h; y++) {
+            uint8_t *line = (uint8_t *)sb->bitmap + sb->stride * (ptrdiff_t)y;
+            size_t len = sb->w * (size_t)bpp, x = 0;
+            for (; x + 8 <= len; x += 8) {
+                uint64_t v;
+                memcpy(&v, line + x, 8);
+                h = hash_mix(h, v);
+            }
+            uint64_t v = 0;
+            memcpy(&v, line + x, len - x);
+            h = hash_mix(h, v);
+        }
+    }
+    return h;
+}
+
+// Recompute the region list for a new change_id. Regions whose bitmaps did not
+// change keep their overlay.
+static void update_regions(struct overlay *ov, struct sub_bitmaps *sbs,
+                           struct mp_image *dst)
+{
+    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
+    int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+
+    struct overlay_region *regions = NULL;
+    int num_regions = 0;
+    for (int n = 0; n < num_rc; n++) {
+        struct overlay_region r = {.bb = rc_list[n], .frames = 1};
+        if (!align_bbox_for_swscale(dst, &r.bb))
+            break;
+        r.hash = hash_region(sbs, r.bb);
+        for (int i = 0; i < ov->num_regions; i++) {
+            struct overlay_region *old = &ov->regions[i];
+            if (old->frames && old->hash == r.hash &&
+                mp_rect_equals(&old->bb, &r.bb))
+            {
+                r = *old;
+                r.frames = MPMIN(r.frames + 1, OVERLAY_MIN_FRAMES);
+                *old = (struct overlay_region){0};
+                break;
+            }
+        }
+        MP_TARRAY_APPEND(ov, regions, num_regions, r);
+    }
+
+    for (int i = 0; i < ov->num_regions; i++) {
+        talloc_free(ov->regions[i].c);
+        talloc_free(ov->regions[i].t);
+    }
+    talloc_free(ov->regions);
+    ov->regions = regions;
+    ov->num_regions = num_regions;
+}
+
+// Return the overlay for sbs. Regions are pre-rendered once their bitmaps have
+// been the same for OVERLAY_MIN_FRAMES calls.
+static struct overlay *get_overlay(struct mp_draw_sub_cache *cache,
+                                   struct sub_bitmaps *sbs,
+                                   struct mp_image *dst, int format, int bits)
+{
+    struct overlay *ov = cache->overlays[sbs->render_index];
+    if (!ov || ov->imgfmt != dst->imgfmt || ov->w != dst->w ||
+        ov->h != dst->h || ov->colorspace != dst->params.color.space ||
+        ov->levels != dst->params.color.levels)
+    {
+        talloc_free(ov);
+        ov = talloc_ptrtype(cache, ov);
+        *ov = (struct overlay){
+            .change_id = sbs->change_id,
+            .imgfmt = dst->imgfmt,
+            .w = dst->w,
+            .h = dst->h,
+            .colorspace = dst->params.color.space,
+            .levels = dst->params.color.levels,
+            .direct = overlay_can_be_direct(dst, format),
+        };
+        cache->overlays[sbs->render_index] = ov;
+        update_regions(ov, sbs, dst);
+    } else if (ov->change_id != sbs->change_id) {
+        ov->change_id = sbs->change_id;
+        update_regions(ov, sbs, dst);
+    } else {
+        for (int n = 0; n < ov->num_regions; n++) {
+            struct overlay_region *r = &ov->regions[n];
+            r->frames = MPMIN(r->frames + 1, OVERLAY_MIN_FRAMES);
+        }
+    }
+
+    for (int n = 0; n < ov->num_regions; n++) {
+        struct overlay_region *r = &ov->regions[n];
+        if (!r->c && r->frames >= OVERLAY_MIN_FRAMES)
+            render_region(cache, ov, r, dst, sbs, format, bits);
+    }
+
+    return ov;
+}
+
+#define BLEND_OVERLAY(TYPE, MAX)                                                \
+    TYPE *dst_r = dst_rp, *c_r = c_rp, *t_r = t_rp;                             \
+    for (int x = 0; x < w; x++) {                                               \
+        uint32_t v = c_r[x] + (dst_r[x] * (uint32_t)t_r[x] + (MAX) / 2) / (MAX);\
+        dst_r[x] = MPMIN(v, MAX);                                               \
+    }
+
+static void blend_overlay(struct mp_image *dst, struct mp_image *c,
+                          struct mp_image *t)
+{
+    for (int p = 0; p < dst->num_planes; p++) {
+        int w = mp_image_plane_w(dst, p);
+        int bits = dst->fmt.component_bits;
+        for (int y = 0; y < mp_image_plane_h(dst, p); y++) {
+            void *dst_rp = dst->planes[p] + dst->stride[p] * y;
+            void *c_rp = c->planes[p] + c->stride[p] * y;
+            void *t_rp = t->planes[p] + t->stride[p] * y;
+            if (dst->fmt.bpp[p] == 16) {
+                BLEND_OVERLAY(uint16_t, (1u << bits) - 1)
+            } else {
+                BLEND_OVERLAY(uint8_t, 255u)
+            }
+        }
+    }
+}
+
+// Apply the pre-rendered regions, and draw the others directly (like
+// draw_regions()).
+static void apply_overlay(struct mp_draw_sub_cache *cache, struct overlay *ov,
+                          struct mp_image *dst, struct sub_bitmaps *sbs,
+                          int format, int bits)
+{
+    for (int n = 0; n < ov->num_regions; n++) {
+        struct overlay_region *r = &ov->regions[n];
+
+        struct mp_image dst_region = *dst;
+        mp_image_crop_rc(&dst_region, r->bb);
+
+        if (r->c && ov->direct) {
+            blend_overlay(&dst_region, r->c, r->t);
+            continue;
+        }
+
+        struct mp_image *temp = chroma_up(cache, format, &dst_region);
+        if (!temp)
+            continue; // on OOM, skip region
+        if (r->c) {
+            blend_overlay(temp, r->c, r->t);
+        } else {
+            draw_bitmaps(cache, r->bb, temp, bits, sbs);
+        }
         chroma_down(&dst_region, temp);
     }
+}
+
+static void draw_sbs(struct mp_draw_sub_cache **cache, struct mp_image *dst,
+                     struct sub_bitmaps *sbs)
+{
+    assert(mp_draw_sub_formats[sbs->format]);
+    if (!mp_sws_supported_format(dst->imgfmt))
+        return;
+
+    struct mp_draw_sub_cache *cache_ = cache ? *cache : NULL;
+    if (!cache_) {
+        cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
+        for (int n = 0; n < 2; n++) {
+            cache_->blend_const_alpha[n] = mp_draw_bmp_simd_const_alpha(n + 1);
+            if (!cache_->blend_const_alpha[n])
+                cache_->blend_const_alpha[n] = mp_draw_bmp_c_const_alpha(n + 1);
+            cache_->blend_src_alpha[n] = mp_draw_bmp_simd_src_alpha(n + 1);
+            if (!cache_->blend_src_alpha[n])
+                cache_->blend_src_alpha[n] = mp_draw_bmp_c_src_alpha(n + 1);
+        }
+    }
+
+    int format, bits;
+    get_closest_y444_format(dst->imgfmt, &format, &bits);
+
+    if (cache) {
+        struct overlay *ov = get_overlay(cache_, sbs, dst, format, bits);
+        apply_overlay(cache_, ov, dst, sbs, format, bits);
+    } else {
+        draw_regions(cache_, dst, sbs, format, bits);
+    }
 
     if (cache) {
         *cache = cache_;
@@ -540,8 +941,9 @@ static void draw_sbs(struct mp_draw_sub_cache **cache, struct mp_image *dst,
 }
 
 // cache: if not NULL, the function will set *cache to a talloc-allocated cache
-//        containing scaled versions of sbs contents - free the cache with
-//        talloc_free()
+//        containing pre-rendered versions of sbs contents, which are reused
+//        for regions whose bitmaps and the dst format stay the same - free
+//        the cache with talloc_free()
 void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
                          struct sub_bitmap_list *sbs_list)
 {
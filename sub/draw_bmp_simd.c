@@ -0,0 +1,427 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "draw_bmp_simd.h"
+
+// Vectorized versions of the blend functions in draw_bmp.c. They must produce
+// exactly the same output as the C versions (test/draw_bmp.c checks this).
+// The divisions by 255 and 65025 are done with exact multiply-high tricks on
+// 32 bit intermediates, which cover the full value range of both 8 and 16 bit
+// components. The remaining pixels at the end of a line are handled with C.
+// The x86 code is compiled with function specific target attributes, so it
+// does not require special compiler flags, and is selected at runtime.
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HAVE_SIMD_X86 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define HAVE_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define HAVE_SIMD_NEON 0
+#endif
+
+#define INLINE inline __attribute__((always_inline))
+
+// x / 65025 == mulhi32(x, DIV65025_MUL) >> DIV65025_SHIFT for all values
+// (p * a + d * (65025 - a) + 32512) can take with p, d <= 65535.
+#define DIV65025_MUL 0x81018203u
+#define DIV65025_SHIFT 15
+// x / 255 == mulhi32(x, DIV255_MUL) for all x <= 65535 * 255 + 127.
+#define DIV255_MUL 0x1010102u
+
+// Remainders. Same as the C versions, minus the zero alpha check.
+#define DEF_C(TYPE, bits)                                                       \
+    static INLINE void const_alpha##bits##_c(TYPE *d, uint32_t srcp,            \
+                                             const uint8_t *a, uint32_t m,      \
+                                             int x0, int x1)                    \
+    {                                                                           \
+        for (int x = x0; x < x1; x++) {                                         \
+            uint32_t srcap = a[x] * m;                                          \
+            d[x] = (srcp * srcap + d[x] * (65025 - srcap) + 32512) / 65025;     \
+        }                                                                       \
+    }                                                                           \
+    static INLINE void src_alpha##bits##_c(TYPE *d, const TYPE *s,              \
+                                           const uint8_t *a, int x0, int x1)    \
+    {                                                                           \
+        for (int x = x0; x < x1; x++) {                                         \
+            uint32_t srcap = a[x];                                              \
+            d[x] = (s[x] * srcap + d[x] * (255 - srcap) + 127) / 255;           \
+        }                                                                       \
+    }
+
+DEF_C(uint8_t, 8)
+DEF_C(uint16_t, 16)
+
+// Generate the 2D entrypoints from the line functions.
+#define DEF_BLEND_2D(isa)                                                       \
+    static void blend_const_alpha8_##isa(void *dst, int dst_stride, int srcp,   \
+                                         uint8_t *srca, int srca_stride,        \
+                                         uint8_t srcamul, int w, int h)         \
+    {                                                                           \
+        for (int y = 0; y < h; y++) {                                           \
+            const_alpha8_##isa((uint8_t *)dst + dst_stride * y, srcp,           \
+                               srca + srca_stride * y, srcamul, w);             \
+        }                                                                       \
+    }                                                                           \
+    static void blend_const_alpha16_##isa(void *dst, int dst_stride, int srcp,  \
+                                          uint8_t *srca, int srca_stride,       \
+                                          uint8_t srcamul, int w, int h)        \
+    {                                                                           \
+        for (int y = 0; y < h; y++) {                                           \
+            const_alpha16_##isa((uint16_t *)((uint8_t *)dst + dst_stride * y),  \
+                                srcp, srca + srca_stride * y, srcamul, w);      \
+        }                                                                       \
+    }                                                                           \
+    static void blend_src_alpha8_##isa(void *dst, int dst_stride, void *src,    \
+                                       int src_stride, uint8_t *srca,           \
+                                       int srca_stride, int w, int h)           \
+    {                                                                           \
+        for (int y = 0; y < h; y++) {                                           \
+            src_alpha8_##isa((uint8_t *)dst + dst_stride * y,                   \
+                             (uint8_t *)src + src_stride * y,                   \
+                             srca + srca_stride * y, w);                        \
+        }                                                                       \
+    }                                                                           \
+    static void blend_src_alpha16_##isa(void *dst, int dst_stride, void *src,   \
+                                        int src_stride, uint8_t *srca,          \
+                                        int srca_stride, int w, int h)          \
+    {                                                                           \
+        for (int y = 0; y < h; y++) {                                           \
+            src_alpha16_##isa((uint16_t *)((uint8_t *)dst + dst_stride * y),    \
+                              (uint16_t *)((uint8_t *)src + src_stride * y),    \
+                              srca + srca_stride * y, w);                       \
+        }                                                                       \
+    }
+
+#if HAVE_SIMD_X86
+
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+// All functions below are instantiated for SSE2 (128 bit vectors) and AVX2
+// (256 bit vectors). The AVX2 unpack/pack instructions work within 128 bit
+// lanes, but unpacking and packing again restores the original order.
+
+#define DEF_X86(isa, target, V, P, LOADV, STOREV, NPX)                          \
+                                                                                \
+    static INLINE target V mulhi32_##isa(V x, uint32_t m)                       \
+    {                                                                           \
+        V vm = P##_set1_epi32(m);                                               \
+        V even = P##_srli_epi64(P##_mul_epu32(x, vm), 32);                      \
+        V odd = P##_mul_epu32(P##_srli_epi64(x, 32), vm);                       \
+        V mask = P##_set1_epi64x((int64_t)0xFFFFFFFF00000000ULL);               \
+        return P##_or_si##NPX(even, P##_and_si##NPX(odd, mask));                \
+    }                                                                           \
+                                                                                \
+    /* Pack 32 bit values <= 65535 to 16 bit (packus_epi32 is SSE4.1). */       \
+    static INLINE target V pack32_##isa(V lo, V hi)                             \
+    {                                                                           \
+        V bias = P##_set1_epi32(32768);                                         \
+        V r = P##_packs_epi32(P##_sub_epi32(lo, bias), P##_sub_epi32(hi, bias));\
+        return P##_add_epi16(r, P##_set1_epi16(-32768));                        \
+    }                                                                           \
+                                                                                \
+    /* Full 32 bit products of 16 bit values. */                                \
+    static INLINE target void mul16_##isa(V a, V b, V *lo, V *hi)               \
+    {                                                                           \
+        V l = P##_mullo_epi16(a, b), h = P##_mulhi_epu16(a, b);                 \
+        *lo = P##_unpacklo_epi16(l, h);                                         \
+        *hi = P##_unpackhi_epi16(l, h);                                         \
+    }                                                                           \
+                                                                                \
+    /* (p * a + d * (65025 - a) + 32512) / 65025, with a <= 65025 */            \
+    static INLINE target V blend65025_##isa(V p, V a, V d)                      \
+    {                                                                           \
+        V na = P##_sub_epi16(P##_set1_epi16((int16_t)65025), a);                \
+        V pa_lo, pa_hi, dn_lo, dn_hi;                                           \
+        mul16_##isa(p, a, &pa_lo, &pa_hi);                                      \
+        mul16_##isa(d, na, &dn_lo, &dn_hi);                                     \
+        V r = P##_set1_epi32(32512);                                            \
+        V lo = P##_add_epi32(P##_add_epi32(pa_lo, dn_lo), r);                   \
+        V hi = P##_add_epi32(P##_add_epi32(pa_hi, dn_hi), r);                   \
+        lo = P##_srli_epi32(mulhi32_##isa(lo, DIV65025_MUL), DIV65025_SHIFT);   \
+        hi = P##_srli_epi32(mulhi32_##isa(hi, DIV65025_MUL), DIV65025_SHIFT);   \
+        return pack32_##isa(lo, hi);                                            \
+    }                                                                           \
+                                                                                \
+    /* (s * a + d * (255 - a) + 127) / 255, with a <= 255 */                    \
+    static INLINE target V blend255_##isa(V s, V a, V d)                        \
+    {                                                                           \
+        V na = P##_sub_epi16(P##_set1_epi16(255), a);                           \
+        V sa_lo, sa_hi, dn_lo, dn_hi;                                           \
+        mul16_##isa(s, a, &sa_lo, &sa_hi);                                      \
+        mul16_##isa(d, na, &dn_lo, &dn_hi);                                     \
+        V r = P##_set1_epi32(127);                                              \
+        V lo = P##_add_epi32(P##_add_epi32(sa_lo, dn_lo), r);                   \
+        V hi = P##_add_epi32(P##_add_epi32(sa_hi, dn_hi), r);                   \
+        lo = mulhi32_##isa(lo, DIV255_MUL);                                     \
+        hi = mulhi32_##isa(hi, DIV255_MUL);                                     \
+        return pack32_##isa(lo, hi);                                            \
+    }                                                                           \
+                                                                                \
+    static target void const_alpha16_##isa(uint16_t *d, int srcp,               \
+                                           const uint8_t *a, int m, int w)      \
+    {                                                                           \
+        const int step = sizeof(V) / 2;                                         \
+        V vp = P##_set1_epi16((int16_t)srcp);                                   \
+        V vm = P##_set1_epi16(m);                                               \
+        int x = 0;                                                              \
+        for (; x + step <= w; x += step) {                                      \
+            V va = LOAD_U8_16_##isa(a + x);                                     \
+            if (ALL_ZERO_##isa(va))                                             \
+                continue;                                                       \
+            va = P##_mullo_epi16(va, vm);                                       \
+            STOREV(d + x, blend65025_##isa(vp, va, LOADV(d + x)));              \
+        }                                                                       \
+        const_alpha16_c(d, srcp, a, m, x, w);                                   \
+    }                                                                           \
+                                                                                \
+    static target void src_alpha16_##isa(uint16_t *d, const uint16_t *s,        \
+                                         const uint8_t *a, int w)               \
+    {                                                                           \
+        const int step = sizeof(V) / 2;                                         \
+        int x = 0;                                                              \
+        for (; x + step <= w; x += step) {                                      \
+            V va = LOAD_U8_16_##isa(a + x);                                     \
+            if (ALL_ZERO_##isa(va))                                             \
+                continue;                                                       \
+            STOREV(d + x, blend255_##isa(LOADV(s + x), va, LOADV(d + x)));      \
+        }                                                                       \
+        src_alpha16_c(d, s, a, x, w);                                           \
+    }                                                                           \
+                                                                                \
+    static target void const_alpha8_##isa(uint8_t *d, int srcp,                 \
+                                          const uint8_t *a, int m, int w)       \
+    {                                                                           \
+        const int step = sizeof(V) / 2;                                         \
+        V vp = P##_set1_epi16(srcp);                                            \
+        V vm = P##_set1_epi16(m);                                               \
+        int x = 0;                                                              \
+        for (; x + step <= w; x += step) {                                      \
+            V va = LOAD_U8_16_##isa(a + x);                                     \
+            if (ALL_ZERO_##isa(va))                                             \
+                continue;                                                       \
+            va = P##_mullo_epi16(va, vm);                                       \
+            V r = blend65025_##isa(vp, va, LOAD_U8_16_##isa(d + x));            \
+            STORE_U16_8_##isa(d + x, r);                                        \
+        }                                                                       \
+        const_alpha8_c(d, srcp, a, m, x, w);                                    \
+    }                                                                           \
+                                                                                \
+    static target void src_alpha8_##isa(uint8_t *d, const uint8_t *s,           \
+                                        const uint8_t *a, int w)                \
+    {                                                                           \
+        const int step = sizeof(V) / 2;                                         \
+        int x = 0;                                                              \
+        for (; x + step <= w; x += step) {                                      \
+            V va = LOAD_U8_16_##isa(a + x);                                     \
+            if (ALL_ZERO_##isa(va))                                             \
+                continue;                                                       \
+            V r = blend255_##isa(LOAD_U8_16_##isa(s + x), va,                   \
+                                 LOAD_U8_16_##isa(d + x));                      \
+            STORE_U16_8_##isa(d + x, r);                                        \
+        }                                                                       \
+        src_alpha8_c(d, s, a, x, w);                                            \
+    }                                                                           \
+                                                                                \
+    DEF_BLEND_2D(isa)
+
+// Load 8 (SSE2) or 16 (AVX2) bytes zero-extended to 16 bit lanes, and the
+// reverse. Plus a check whether all lanes are 0.
+
+#define LOAD_U8_16_sse2(p) \
+    _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p)), _mm_setzero_si128())
+#define STORE_U16_8_sse2(p, v) \
+    _mm_storel_epi64((__m128i *)(p), _mm_packus_epi16(v, v))
+#define ALL_ZERO_sse2(v) \
+    (_mm_movemask_epi8(_mm_cmpeq_epi16(v, _mm_setzero_si128())) == 0xFFFF)
+
+#define LOAD_U8_16_avx2(p) _mm256_cvtepu8_epi16(LOAD(p))
+#define STORE_U16_8_avx2(p, v)                                                  \
+    STORE(p, _mm_packus_epi16(_mm256_castsi256_si128(v),                        \
+                              _mm256_extracti128_si256(v, 1)))
+#define ALL_ZERO_avx2(v) _mm256_testz_si256(v, v)
+
+DEF_X86(sse2, TARGET_SSE2, __m128i, _mm, LOAD, STORE, 128)
+DEF_X86(avx2, TARGET_AVX2, __m256i, _mm256, LOAD256, STORE256, 256)
+
+#endif /* HAVE_SIMD_X86 */
+
+#if HAVE_SIMD_NEON
+
+static INLINE uint32x4_t mulhi32_neon(uint32x4_t x, uint32_t m)
+{
+    uint32x2_t vm = vdup_n_u32(m);
+    uint64x2_t lo = vmull_u32(vget_low_u32(x), vm);
+    uint64x2_t hi = vmull_u32(vget_high_u32(x), vm);
+    return vcombine_u32(vshrn_n_u64(lo, 32), vshrn_n_u64(hi, 32));
+}
+
+// (p * a + d * (65025 - a) + 32512) / 65025, with a <= 65025
+static INLINE uint16x8_t blend65025_neon(uint16x8_t p, uint16x8_t a,
+                                         uint16x8_t d)
+{
+    uint16x8_t na = vsubq_u16(vdupq_n_u16(65025), a);
+    uint32x4_t r = vdupq_n_u32(32512);
+    uint32x4_t lo = vmlal_u16(r, vget_low_u16(p), vget_low_u16(a));
+    uint32x4_t hi = vmlal_u16(r, vget_high_u16(p), vget_high_u16(a));
+    lo = vmlal_u16(lo, vget_low_u16(d), vget_low_u16(na));
+    hi = vmlal_u16(hi, vget_high_u16(d), vget_high_u16(na));
+    lo = vshrq_n_u32(mulhi32_neon(lo, DIV65025_MUL), DIV65025_SHIFT);
+    hi = vshrq_n_u32(mulhi32_neon(hi, DIV65025_MUL), DIV65025_SHIFT);
+    return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+}
+
+// (s * a + d * (255 - a) + 127) / 255, with a <= 255
+static INLINE uint16x8_t blend255_neon(uint16x8_t s, uint16x8_t a,
+                                       uint16x8_t d)
+{
+    uint16x8_t na = vsubq_u16(vdupq_n_u16(255), a);
+    uint32x4_t r = vdupq_n_u32(127);
+    uint32x4_t lo = vmlal_u16(r, vget_low_u16(s), vget_low_u16(a));
+    uint32x4_t hi = vmlal_u16(r, vget_high_u16(s), vget_high_u16(a));
+    lo = vmlal_u16(lo, vget_low_u16(d), vget_low_u16(na));
+    hi = vmlal_u16(hi, vget_high_u16(d), vget_high_u16(na));
+    lo = mulhi32_neon(lo, DIV255_MUL);
+    hi = mulhi32_neon(hi, DIV255_MUL);
+    return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+}
+
+static INLINE bool all_zero_neon(uint8x8_t v)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(v), 0) == 0;
+}
+
+static void const_alpha16_neon(uint16_t *d, int srcp, const uint8_t *a,
+                               int m, int w)
+{
+    uint16x8_t vp = vdupq_n_u16(srcp);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t va = vld1_u8(a + x);
+        if (all_zero_neon(va))
+            continue;
+        uint16x8_t vam = vmull_u8(va, vdup_n_u8(m));
+        vst1q_u16(d + x, blend65025_neon(vp, vam, vld1q_u16(d + x)));
+    }
+    const_alpha16_c(d, srcp, a, m, x, w);
+}
+
+static void src_alpha16_neon(uint16_t *d, const uint16_t *s, const uint8_t *a,
+                             int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t va = vld1_u8(a + x);
+        if (all_zero_neon(va))
+            continue;
+        uint16x8_t r = blend255_neon(vld1q_u16(s + x), vmovl_u8(va),
+                                     vld1q_u16(d + x));
+        vst1q_u16(d + x, r);
+    }
+    src_alpha16_c(d, s, a, x, w);
+}
+
+static void const_alpha8_neon(uint8_t *d, int srcp, const uint8_t *a,
+                              int m, int w)
+{
+    uint16x8_t vp = vdupq_n_u16(srcp);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t va = vld1_u8(a + x);
+        if (all_zero_neon(va))
+            continue;
+        uint16x8_t vam = vmull_u8(va, vdup_n_u8(m));
+        uint16x8_t r = blend65025_neon(vp, vam, vmovl_u8(vld1_u8(d + x)));
+        vst1_u8(d + x, vmovn_u16(r));
+    }
+    const_alpha8_c(d, srcp, a, m, x, w);
+}
+
+static void src_alpha8_neon(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                            int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t va = vld1_u8(a + x);
+        if (all_zero_neon(va))
+            continue;
+        uint16x8_t r = blend255_neon(vmovl_u8(vld1_u8(s + x)), vmovl_u8(va),
+                                     vmovl_u8(vld1_u8(d + x)));
+        vst1_u8(d + x, vmovn_u16(r));
+    }
+    src_alpha8_c(d, s, a, x, w);
+}
+
+DEF_BLEND_2D(neon)
+
+#endif /* HAVE_SIMD_NEON */
+
+mp_blend_const_alpha_fn mp_draw_bmp_simd_const_alpha(int bytes)
+{
+    int flags = av_get_cpu_flags();
+
+#if HAVE_SIMD_X86
+    if (flags & AV_CPU_FLAG_AVX2)
+        return bytes == 2 ? blend_const_alpha16_avx2 : blend_const_alpha8_avx2;
+    if (flags & AV_CPU_FLAG_SSE2)
+        return bytes == 2 ? blend_const_alpha16_sse2 : blend_const_alpha8_sse2;
+#endif
+#if HAVE_SIMD_NEON
+    if (flags & AV_CPU_FLAG_NEON)
+        return bytes == 2 ? blend_const_alpha16_neon : blend_const_alpha8_neon;
+#endif
+
+    (void)flags;
+    return NULL;
+}
+
+mp_blend_src_alpha_fn mp_draw_bmp_simd_src_alpha(int bytes)
+{
+    int flags = av_get_cpu_flags();
+
+#if HAVE_SIMD_X86
+    if (flags & AV_CPU_FLAG_AVX2)
+        return bytes == 2 ? blend_src_alpha16_avx2 : blend_src_alpha8_avx2;
+    if (flags & AV_CPU_FLAG_SSE2)
+        return bytes == 2 ? blend_src_alpha16_sse2 : blend_src_alpha8_sse2;
+#endif
+#if HAVE_SIMD_NEON
+    if (flags & AV_CPU_FLAG_NEON)
+        return bytes == 2 ? blend_src_alpha16_neon : blend_src_alpha8_neon;
+#endif
+
+    (void)flags;
+    return NULL;
+}
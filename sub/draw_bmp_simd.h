@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// See blend_const_alpha() in draw_bmp.c. bytes is implied by the function.
+typedef void (*mp_blend_const_alpha_fn)(void *dst, int dst_stride, int srcp,
+                                        uint8_t *srca, int srca_stride,
+                                        uint8_t srcamul, int w, int h);
+
+// See blend_src_alpha() in draw_bmp.c.
+typedef void (*mp_blend_src_alpha_fn)(void *dst, int dst_stride, void *src,
+                                      int src_stride, uint8_t *srca,
+                                      int srca_stride, int w, int h);
+
+// Return an optimized blend function for the given component size (1 or 2
+// bytes), or NULL if there is none for this CPU.
+mp_blend_const_alpha_fn mp_draw_bmp_simd_const_alpha(int bytes);
+mp_blend_src_alpha_fn mp_draw_bmp_simd_src_alpha(int bytes);
+
+// Return the C blend function (in draw_bmp.c), which the optimized functions
+// must match exactly.
+mp_blend_const_alpha_fn mp_draw_bmp_c_const_alpha(int bytes);
+mp_blend_src_alpha_fn mp_draw_bmp_c_src_alpha(int bytes);
@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <ass/ass.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "osdep/timer.h"
+#include "sub/ass_mp.h"
+#include "sub/draw_bmp.h"
+#include "sub/draw_bmp_simd.h"
+#include "tests.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+#define W 1920
+#define H 1080
+
+struct bmp {
+    uint8_t *bitmap;
+    int stride, w, h, x, y;
+    uint32_t color;         // libass RGBA
+};
+
+static uint32_t rnd(uint32_t *seed)
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+// Karaoke-style lines: every syllable has its own colors and border/blur
+// settings, so libass returns a long list of small bitmaps (fill, outline and
+// shadow for each).
+static char *make_script(void *ta_parent)
+{
+    char *s = talloc_strdup(ta_parent,
+        "[Script Info]\n"
+        "ScriptType: v4.00+\n"
+        "PlayResX: 1920\n"
+        "PlayResY: 1080\n"
+        "\n"
+        "[V4+ Styles]\n"
+        "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, "
+        "OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, "
+        "ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, "
+        "Alignment, MarginL, MarginR, MarginV, Encoding\n"
+        "Style: Default,sans-serif,56,&H00FFFFFF,&H000000FF,&H00000000,"
+        "&H80000000,0,0,0,0,100,100,0,0,1,3,2,8,10,10,10,1\n"
+        "\n"
+        "[Events]\n"
+        "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, "
+        "Effect, Text\n");
+    uint32_t seed = 1;
+    for (int line = 0; line < 16; line++) {
+        s = talloc_asprintf_append(s,
+            "Dialogue: 0,0:00:00.00,0:00:10.00,Default,,0,0,%d,,",
+            10 + line * 66);
+        for (int n = 0; n < 12; n++) {
+            s = talloc_asprintf_append(s,
+                "{\\k20\\1c&H%06X&\\3c&H%06X&\\bord%d\\blur%d\\fscx%d}kara%d ",
+                (unsigned)(rnd(&seed) & 0xFFFFFF),
+                (unsigned)(rnd(&seed) & 0xFFFFFF),
+                (int)(rnd(&seed) % 5), (int)(rnd(&seed) % 3),
+                90 + (int)(rnd(&seed) % 30), n);
+        }
+        s = talloc_strdup_append(s, "\n");
+    }
+    return s;
+}
+
+// Render the script, and copy the resulting image list.
+static int render_ass(struct test_ctx *ctx, void *ta_parent, struct bmp **out)
+{
+    int num = 0;
+    ASS_Library *lib = mp_ass_init(ctx->global, ctx->log);
+    ASS_Renderer *renderer = ass_renderer_init(lib);
+    if (!renderer)
+        goto done_lib;
+    ass_set_frame_size(renderer, W, H);
+    ass_set_fonts(renderer, NULL, "sans-serif", ASS_FONTPROVIDER_AUTODETECT,
+                  NULL, 1);
+
+    char *script = make_script(ta_parent);
+    ASS_Track *track = ass_read_memory(lib, script, strlen(script), NULL);
+    if (!track)
+        goto done_renderer;
+
+    ASS_Image *imgs = ass_render_frame(renderer, track, 5000, NULL);
+    for (ASS_Image *img = imgs; img; img = img->next) {
+        if (img->w < 1 || img->h < 1)
+            continue;
+        struct bmp b = {
+            .bitmap = talloc_memdup(ta_parent, img->bitmap,
+                                    img->stride * (size_t)img->h),
+            .stride = img->stride,
+            .w = img->w, .h = img->h,
+            .x = img->dst_x, .y = img->dst_y,
+            .color = img->color,
+        };
+        MP_TARRAY_APPEND(ta_parent, *out, num, b);
+    }
+
+    ass_free_track(track);
+done_renderer:
+    ass_renderer_done(renderer);
+done_lib:
+    ass_library_done(lib);
+    return num;
+}
+
+// Fallback if libass can't render anything (e.g. no fonts installed): roughly
+// glyph sized blobs with soft edges.
+static int make_synthetic(void *ta_parent, struct bmp **out)
+{
+    int num = 0;
+    uint32_t seed = 2;
+    for (int n = 0; n < 600; n++) {
+        struct bmp b = {
+            .w = 8 + rnd(&seed) % 60,
+            .h = 8 + rnd(&seed) % 60,
+            .color = rnd(&seed) << 8 | (rnd(&seed) & 0x7F),
+        };
+        b.stride = MP_ALIGN_UP(b.w, 32);
+        b.x = rnd(&seed) % (W - b.w);
+        b.y = rnd(&seed) % (H - b.h);
+        b.bitmap = talloc_zero_size(ta_parent, b.stride * b.h);
+        for (int y = 0; y < b.h; y++) {
+            for (int x = 0; x < b.w; x++) {
+                int dx = abs(2 * x - b.w), dy = abs(2 * y - b.h);
+                int v = 255 - 255 * (dx * dx + dy * dy) / (b.w * b.h / 2 + 1);
+                b.bitmap[y * b.stride + x] = MPCLAMP(v, 0, 255);
+            }
+        }
+        MP_TARRAY_APPEND(ta_parent, *out, num, b);
+    }
+    return num;
+}
+
+static void *alloc_plane(void *ta_parent, int bytes, uint32_t *seed)
+{
+    uint8_t *p = talloc_size(ta_parent, W * H * bytes);
+    for (int n = 0; n < W * H * bytes; n++)
+        p[n] = rnd(seed);
+    return p;
+}
+
+// Blend all bitmaps on a plane, either with the C functions from
+// sub/draw_bmp.c, or with the optimized ones.
+static void blend_all(struct bmp *bmps, int num, void *dst, void *src,
+                      int bytes, bool use_src, bool opt)
+{
+    int stride = W * bytes;
+    mp_blend_const_alpha_fn const_fn = opt ? mp_draw_bmp_simd_const_alpha(bytes)
+                                           : mp_draw_bmp_c_const_alpha(bytes);
+    mp_blend_src_alpha_fn src_fn = opt ? mp_draw_bmp_simd_src_alpha(bytes)
+                                       : mp_draw_bmp_c_src_alpha(bytes);
+    for (int n = 0; n < num; n++) {
+        struct bmp *b = &bmps[n];
+        size_t offset = b->y * (size_t)stride + b->x * bytes;
+        uint8_t *d = (uint8_t *)dst + offset;
+        if (use_src) {
+            uint8_t *s = (uint8_t *)src + offset;
+            src_fn(d, stride, s, stride, b->bitmap, b->stride, b->w, b->h);
+        } else {
+            int color = (b->color >> 24) << (bytes == 2 ? 8 : 0);
+            int a = 255 - (b->color & 0xFF);
+            const_fn(d, stride, color, b->bitmap, b->stride, a, b->w, b->h);
+        }
+    }
+}
+
+// Compare the optimized blend functions with the C ones.
+static void run_blend(struct test_ctx *ctx)
+{
+    int passes = test_passes(ctx, 100);
+
+    if (!mp_draw_bmp_simd_const_alpha(1)) {
+        test_timing(ctx, "No optimized blend functions for this CPU.\n");
+        return;
+    }
+
+    void *ta = talloc_new(NULL);
+
+    struct bmp *bmps = NULL;
+    int num = render_ass(ctx, ta, &bmps);
+    if (!num) {
+        MP_WARN(ctx, "libass rendered nothing, using synthetic bitmaps.\n");
+        num = make_synthetic(ta, &bmps);
+    }
+
+    int64_t pixels = 0;
+    for (int n = 0; n < num; n++)
+        pixels += bmps[n].w * (int64_t)bmps[n].h;
+    test_timing(ctx, "%d bitmaps, %"PRId64" pixels.\n", num, pixels);
+
+    for (int bytes = 1; bytes <= 2; bytes++) {
+        for (int use_src = 0; use_src < 2; use_src++) {
+            uint32_t seed = 1;
+            void *src = alloc_plane(ta, bytes, &seed);
+            void *ref = alloc_plane(ta, bytes, &seed);
+            void *opt = talloc_memdup(ta, ref, W * H * bytes);
+
+            int64_t t[2] = {0};
+            for (int i = 0; i < 2; i++) {
+                int64_t start = mp_time_us();
+                for (int n = 0; n < passes; n++)
+                    blend_all(bmps, num, i ? opt : ref, src, bytes, use_src, i);
+                t[i] = mp_time_us() - start;
+            }
+
+            assert_true(memcmp(ref, opt, W * H * bytes) == 0);
+
+            double mpx = pixels * (double)passes / 1e6;
+            test_timing(ctx, "%-9s %d bit: C %8.1f Mpx/s, SIMD %8.1f Mpx/s\n",
+                        use_src ? "src_alpha" : "const", bytes * 8,
+                        test_rate(mpx, t[0]), test_rate(mpx, t[1]));
+        }
+    }
+
+    talloc_free(ta);
+}
+
+// Rows of soft blobs, each overlapping only its neighbours.
+static struct sub_bitmaps *make_sbs(void *ta_parent, int format, int y0)
+{
+    struct sub_bitmaps *sbs = talloc_zero(ta_parent, struct sub_bitmaps);
+    sbs->render_index = format == SUBBITMAP_RGBA;
+    sbs->format = format;
+    uint32_t seed = 3;
+    for (int n = 0; n < 24; n++) {
+        struct sub_bitmap sb = {
+            .w = 40 + rnd(&seed) % 40,
+            .h = 30 + rnd(&seed) % 20,
+            .x = 20 + (n % 8) * 50,
+            .y = y0 + (n / 8) * 60,
+            .libass.color = rnd(&seed) << 8 | (rnd(&seed) & 0x7F),
+        };
+        sb.dw = sb.w;
+        sb.dh = sb.h;
+        int bpp = format == SUBBITMAP_RGBA ? 4 : 1;
+        sb.stride = MP_ALIGN_UP(sb.w * bpp, 32);
+        uint8_t *data = talloc_zero_size(ta_parent, sb.stride * sb.h);
+        for (int y = 0; y < sb.h; y++) {
+            for (int x = 0; x < sb.w; x++) {
+                int dx = abs(2 * x - sb.w), dy = abs(2 * y - sb.h);
+                int v = 255 - 255 * (dx * dx + dy * dy) / (sb.w * sb.h / 2 + 1);
+                v = MPCLAMP(v, 0, 255);
+                uint8_t *px = data + y * sb.stride + x * bpp;
+                if (bpp == 4) {
+                    // premultiplied BGRA
+                    for (int c = 0; c < 3; c++)
+                        px[c] = rnd(&seed) % (v + 1);
+                    px[3] = v;
+                } else {
+                    px[0] = v;
+                }
+            }
+        }
+        sb.bitmap = data;
+        MP_TARRAY_APPEND(sbs, sbs->parts, sbs->num_parts, sb);
+    }
+    return sbs;
+}
+
+// Largest difference between two images of the same format, in 8 bit units.
+static int max_diff(struct mp_image *a, struct mp_image *b)
+{
+    int diff = 0;
+    for (int p = 0; p < a->num_planes; p++) {
+        int w = mp_image_plane_w(a, p);
+        for (int y = 0; y < mp_image_plane_h(a, p); y++) {
+            void *a_rp = a->planes[p] + a->stride[p] * y;
+            void *b_rp = b->planes[p] + b->stride[p] * y;
+            if (a->fmt.bpp[p] == 16) {
+                uint16_t *a_r = a_rp, *b_r = b_rp;
+                for (int x = 0; x < w; x++)
+                    diff = MPMAX(diff, abs(a_r[x] - b_r[x]));
+            } else {
+                uint8_t *a_r = a_rp, *b_r = b_rp;
+                for (int x = 0; x < w * a->fmt.bpp[p] / 8; x++)
+                    diff = MPMAX(diff, abs(a_r[x] - b_r[x]));
+            }
+        }
+    }
+    int shift = MPMAX(a->fmt.component_bits - 8, 0);
+    return (diff + (1 << shift) - 1) >> shift;
+}
+
+// Blending with a pre-rendered overlay rounds differently from blending each
+// bitmap in sequence. With at most 2 overlapping bitmaps, the difference is at
+// most 2 code values; allow one more for the format conversions.
+#define CACHE_MAX_DIFF 3
+
+// Compare the output of mp_draw_sub_bitmaps() with and without cache. Regions
+// are drawn directly until their bitmaps stayed the same for a few frames, so
+// the first frame must match exactly.
+static void test_cache(struct test_ctx *ctx)
+{
+    // Planar formats are drawn on directly, and the overlay is downsampled
+    // for yuv420p and yuv420p16. bgr0 is converted to gbrp, and yuv420p10 to
+    // yuv444p16, around blending.
+    static const char *const fmts[] = {"yuv444p", "gbrp", "bgr0", "yuv420p",
+                                       "yuv420p10", "yuv420p16"};
+
+    void *ta = talloc_new(NULL);
+
+    struct sub_bitmaps *items[] = {
+        make_sbs(ta, SUBBITMAP_LIBASS, 20),
+        make_sbs(ta, SUBBITMAP_RGBA, 240),
+    };
+    struct sub_bitmap_list list = {items, MP_ARRAY_SIZE(items)};
+
+    for (int f = 0; f < MP_ARRAY_SIZE(fmts); f++) {
+        int imgfmt = mp_imgfmt_from_name(bstr0(fmts[f]));
+        struct mp_image *ref = mp_image_alloc(imgfmt, 480, 480);
+        assert_true(ref);
+        talloc_steal(ta, ref);
+        mp_image_params_guess_csp(&ref->params);
+        uint32_t seed = 1;
+        for (int p = 0; p < ref->num_planes; p++) {
+            int w = mp_image_plane_w(ref, p);
+            for (int y = 0; y < mp_image_plane_h(ref, p); y++) {
+                void *line = ref->planes[p] + ref->stride[p] * y;
+                if (ref->fmt.bpp[p] == 16) {
+                    int mask = (1 << ref->fmt.component_bits) - 1;
+                    for (int x = 0; x < w; x++)
+                        ((uint16_t *)line)[x] = rnd(&seed) & mask;
+                } else {
+                    for (int x = 0; x < w * ref->fmt.bpp[p] / 8; x++)
+                        ((uint8_t *)line)[x] = rnd(&seed);
+                }
+            }
+        }
+
+        struct mp_draw_sub_cache *cache = NULL;
+        for (int frame = 0; frame < 8; frame++) {
+            // Change one bitmap of a region, which must not reuse its old
+            // overlay, while the other regions keep theirs.
+            if (frame == 6) {
+                items[0]->parts[0].libass.color ^= 0xFF000000;
+                items[0]->change_id++;
+            }
+
+            struct mp_image *img = mp_image_new_copy(ref);
+            struct mp_image *exp = mp_image_new_copy(ref);
+            mp_draw_sub_bitmaps(&cache, img, &list);
+            mp_draw_sub_bitmaps(NULL, exp, &list);
+
+            int diff = max_diff(img, exp);
+            MP_VERBOSE(ctx, "%s frame %d: max. difference %d\n",
+                       fmts[f], frame, diff);
+            if (frame == 0) {
+                assert_int_equal(diff, 0);
+            } else {
+                assert_true(diff <= CACHE_MAX_DIFF);
+            }
+
+            talloc_free(img);
+            talloc_free(exp);
+        }
+        talloc_free(cache);
+
+        items[0]->parts[0].libass.color ^= 0xFF000000;
+        items[0]->change_id++;
+    }
+
+    talloc_free(ta);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    test_cache(ctx);
+    run_blend(ctx);
+}
+
+const struct unittest test_draw_bmp = {
+    .name = "draw_bmp",
+    .run = run,
+    .run_bench = run_blend,
+};
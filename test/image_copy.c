@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "osdep/timer.h"
+#include "video/img_format.h"
+#include "video/memcpy_simd.h"
+#include "video/mp_image.h"
+#include "tests.h"
+
+static uint32_t rnd(uint32_t *seed)
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+static void fill_image(struct mp_image *img, uint32_t *seed)
+{
+    for (int p = 0; p < img->num_planes; p++) {
+        int h = mp_image_plane_h(img, p);
+        for (int y = 0; y < h; y++) {
+            uint8_t *line = img->planes[p] + img->stride[p] * (ptrdiff_t)y;
+            for (int x = 0; x < img->stride[p]; x++)
+                line[x] = rnd(seed);
+        }
+    }
+}
+
+// Plain per-line copy, which mp_image_copy() must be equivalent to.
+static void ref_copy(struct mp_image *dst, struct mp_image *src)
+{
+    for (int p = 0; p < dst->num_planes; p++) {
+        int line_bytes = (mp_image_plane_w(dst, p) * dst->fmt.bpp[p] + 7) / 8;
+        int h = mp_image_plane_h(dst, p);
+        for (int y = 0; y < h; y++) {
+            memcpy(dst->planes[p] + dst->stride[p] * (ptrdiff_t)y,
+                   src->planes[p] + src->stride[p] * (ptrdiff_t)y, line_bytes);
+        }
+    }
+}
+
+static bool images_equal(struct mp_image *a, struct mp_image *b)
+{
+    for (int p = 0; p < a->num_planes; p++) {
+        int line_bytes = (mp_image_plane_w(a, p) * a->fmt.bpp[p] + 7) / 8;
+        int h = mp_image_plane_h(a, p);
+        for (int y = 0; y < h; y++) {
+            if (memcmp(a->planes[p] + a->stride[p] * (ptrdiff_t)y,
+                       b->planes[p] + b->stride[p] * (ptrdiff_t)y, line_bytes))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Misaligned and short lines, which exercise the head/tail handling.
+static void test_nt_lines(void)
+{
+    mp_memcpy_pic_fn nt = mp_memcpy_simd_pic_nt();
+    if (!nt)
+        return;
+
+    uint32_t seed = 1;
+    uint8_t src[600], ref[600], dst[600];
+    for (int n = 0; n < sizeof(src); n++)
+        src[n] = rnd(&seed);
+
+    for (int w = 0; w < 150; w++) {
+        for (int offset = 0; offset < 16; offset++) {
+            memset(ref, 0, sizeof(ref));
+            memset(dst, 0, sizeof(dst));
+            memcpy_pic(ref + offset, src + 3, w, 3, 160, 170);
+            nt(dst + offset, src + 3, w, 3, 160, 170);
+            assert_true(memcmp(ref, dst, sizeof(ref)) == 0);
+        }
+    }
+}
+
+static const struct {
+    int imgfmt, w, h;
+} formats[] = {
+    {IMGFMT_420P,  1921, 1081},     // small, plain memcpy
+    {IMGFMT_RGBA,  2049, 1025},     // non-temporal stores
+    {IMGFMT_P010,  3841, 2161},     // threads
+    {IMGFMT_420P,  4097, 4095},
+};
+
+static void run_copy(struct test_ctx *ctx, int w, int h, int imgfmt,
+                     int passes)
+{
+    uint32_t seed = 1;
+    struct mp_image *src = mp_image_alloc(imgfmt, w, h);
+    struct mp_image *ref = mp_image_alloc(imgfmt, w, h);
+    struct mp_image *dst = mp_image_alloc(imgfmt, w, h);
+    assert_true(src && ref && dst);
+    fill_image(src, &seed);
+    fill_image(ref, &seed);
+    fill_image(dst, &seed);
+
+    int64_t t[2] = {0};
+    for (int i = 0; i < 2; i++) {
+        int64_t start = mp_time_us();
+        for (int n = 0; n < passes; n++) {
+            if (i) {
+                mp_image_copy(dst, src);
+            } else {
+                ref_copy(ref, src);
+            }
+        }
+        t[i] = mp_time_us() - start;
+    }
+
+    assert_true(images_equal(ref, src));
+    assert_true(images_equal(dst, src));
+
+    double bytes = 0;
+    for (int p = 0; p < src->num_planes; p++) {
+        bytes += (mp_image_plane_w(src, p) * src->fmt.bpp[p] + 7) / 8 *
+                 (double)mp_image_plane_h(src, p);
+    }
+    double gb = bytes * passes / 1e9;
+    test_timing(ctx, "%-8s %5dx%-5d: memcpy %6.2f GB/s, mp_image_copy %6.2f "
+                "GB/s\n", mp_imgfmt_to_name(imgfmt), w, h,
+                test_rate(gb, t[0]), test_rate(gb, t[1]));
+
+    talloc_free(src);
+    talloc_free(ref);
+    talloc_free(dst);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    test_nt_lines();
+    for (int n = 0; n < MP_ARRAY_SIZE(formats); n++)
+        run_copy(ctx, formats[n].w, formats[n].h, formats[n].imgfmt, 1);
+}
+
+static void run_bench(struct test_ctx *ctx)
+{
+    // 8K 10 bit, about 100 MB per frame.
+    run_copy(ctx, 7680, 4320, IMGFMT_P010, 20);
+    run_copy(ctx, 3840, 2160, IMGFMT_P010, 50);
+    run_copy(ctx, 1920, 1080, IMGFMT_420P, 200);
+}
+
+const struct unittest test_image_copy = {
+    .name = "image_copy",
+    .run = run,
+    .run_bench = run_bench,
+};
@@ -0,0 +1,338 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "input/input.h"
+#include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+// Tests --input-ipc-server-mode=poll. Events are generated with log messages,
+// because the core doesn't run while tests are executed. Requests that need the
+// core are only answered while the test runs it.
+
+#define NUM_MESSAGES 20000
+#define OUTPUT_LIMIT (16 * 1024)
+
+// --input-ipc-overflow choices
+enum {
+    OVERFLOW_DROP,
+    OVERFLOW_DISCONNECT,
+};
+
+struct conn {
+    int fd;
+    bstr buf;
+    bool eof;
+    // If set, run the core while waiting for data.
+    struct mp_dispatch_queue *core;
+};
+
+static struct mp_ipc_ctx *start_server(struct test_ctx *ctx, const char *path,
+                                       int overflow)
+{
+    struct m_config_cache *cache =
+        m_config_cache_alloc(NULL, ctx->global, &mp_opt_root);
+    struct MPOpts *opts = cache->opts;
+
+    char *old_path = opts->ipc_path;
+    int old_mode = opts->ipc_server_mode;
+    int64_t old_limit = opts->ipc_output_limit;
+    int old_overflow = opts->ipc_overflow;
+
+    opts->ipc_path = (char *)path;
+    opts->ipc_server_mode = 1; // poll
+    opts->ipc_output_limit = OUTPUT_LIMIT;
+    opts->ipc_overflow = overflow;
+    m_config_cache_write_opt(cache, &opts->ipc_path);
+    m_config_cache_write_opt(cache, &opts->ipc_server_mode);
+    m_config_cache_write_opt(cache, &opts->ipc_output_limit);
+    m_config_cache_write_opt(cache, &opts->ipc_overflow);
+
+    struct mp_ipc_ctx *ipc = mp_init_ipc(ctx->global->client_api, ctx->global);
+    assert_true(ipc);
+
+    // Restore the user's settings; the server has read its own copy.
+    opts->ipc_path = old_path;
+    opts->ipc_server_mode = old_mode;
+    opts->ipc_output_limit = old_limit;
+    opts->ipc_overflow = old_overflow;
+    m_config_cache_write_opt(cache, &opts->ipc_path);
+    m_config_cache_write_opt(cache, &opts->ipc_server_mode);
+    m_config_cache_write_opt(cache, &opts->ipc_output_limit);
+    m_config_cache_write_opt(cache, &opts->ipc_overflow);
+
+    talloc_free(cache);
+    return ipc;
+}
+
+static void connect_client(struct conn *c, const char *path,
+                           struct mp_dispatch_queue *core)
+{
+    *c = (struct conn){ .fd = socket(AF_UNIX, SOCK_STREAM, 0), .core = core };
+    assert_true(c->fd >= 0);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    // The server binds the socket asynchronously.
+    for (int n = 0; n < 1000; n++) {
+        if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return;
+        assert_true(errno == ENOENT || errno == ECONNREFUSED);
+        mp_sleep_us(1000);
+    }
+    assert_true(false);
+}
+
+static void send_str(struct conn *c, const char *s)
+{
+    size_t len = strlen(s);
+    assert_int_equal(write(c->fd, s, len), len);
+}
+
+// Read the next message, or return false on EOF.
+static bool read_msg(void *ta_parent, struct conn *c, int encoding,
+                     struct mpv_node *node)
+{
+    while (1) {
+        if (encoding == MP_IPC_MSGPACK) {
+            bstr src = c->buf;
+            int r = msgpack_parse(ta_parent, node, &src, 50);
+            assert_true(r >= 0);
+            if (r > 0) {
+                memmove(c->buf.start, src.start, src.len);
+                c->buf.len = src.len;
+                return true;
+            }
+        } else {
+            int nl = bstrchr(c->buf, '\n');
+            if (nl >= 0) {
+                char *s = bstrto0(ta_parent, bstr_splice(c->buf, 0, nl));
+                assert_true(json_parse(ta_parent, node, &s, 50) >= 0);
+                c->buf.len -= nl + 1;
+                memmove(c->buf.start, c->buf.start + nl + 1, c->buf.len);
+                return true;
+            }
+        }
+
+        if (c->eof)
+            return false;
+
+        if (c->core) {
+            struct pollfd fd = { .fd = c->fd, .events = POLLIN };
+            while (poll(&fd, 1, 0) == 0)
+                mp_dispatch_queue_process(c->core, 0.01);
+        }
+
+        char buf[4096];
+        ssize_t r = read(c->fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        assert_true(r >= 0 || errno == ECONNRESET);
+        if (r <= 0) {
+            c->eof = true;
+        } else {
+            bstr_xappend(NULL, &c->buf, (bstr){buf, r});
+        }
+    }
+}
+
+static void close_client(struct conn *c)
+{
+    close(c->fd);
+    talloc_free(c->buf.start);
+}
+
+// Read messages until the reply to request_id, and return the number of log
+// messages received before it.
+static int wait_reply(struct conn *c, int encoding, int64_t request_id,
+                      const char *error)
+{
+    int messages = 0;
+    while (1) {
+        void *tmp = talloc_new(NULL);
+        struct mpv_node node;
+        assert_true(read_msg(tmp, c, encoding, &node));
+        assert_int_equal(node.format, MPV_FORMAT_NODE_MAP);
+
+        struct mpv_node *ev = node_map_get(&node, "event");
+        if (ev) {
+            assert_int_equal(ev->format, MPV_FORMAT_STRING);
+            messages += strcmp(ev->u.string, "log-message") == 0;
+            talloc_free(tmp);
+            continue;
+        }
+
+        struct mpv_node *id = node_map_get(&node, "request_id");
+        struct mpv_node *err = node_map_get(&node, "error");
+        assert_true(id && id->format == MPV_FORMAT_INT64);
+        assert_true(err && err->format == MPV_FORMAT_STRING);
+        assert_int_equal(id->u.int64, request_id);
+        assert_string_equal(err->u.string, error);
+        talloc_free(tmp);
+        return messages;
+    }
+}
+
+static void test_replies(struct test_ctx *ctx, const char *path)
+{
+    struct mp_ipc_ctx *ipc = start_server(ctx, path, OVERFLOW_DROP);
+
+    struct conn c;
+    connect_client(&c, path, NULL);
+
+    // Several requests in a single write, each answered in order.
+    send_str(&c, "{\"command\": [\"client_name\"], \"request_id\": 1}\n"
+                 "{\"request_id\": 2}\n"
+                 "{\"command\": [\"set_encoding\", \"msgpack\"], "
+                 "\"request_id\": 3}\n");
+    assert_int_equal(wait_reply(&c, MP_IPC_JSON, 1, "success"), 0);
+    assert_int_equal(wait_reply(&c, MP_IPC_JSON, 2, "invalid parameter"), 0);
+    assert_int_equal(wait_reply(&c, MP_IPC_JSON, 3, "success"), 0);
+
+    // {"command": ["get_version"], "request_id": 4}
+    send_str(&c, "\x82\xa7" "command" "\x91\xab" "get_version"
+                 "\xaa" "request_id" "\x04");
+    assert_int_equal(wait_reply(&c, MP_IPC_MSGPACK, 4, "success"), 0);
+
+    close_client(&c);
+    mp_uninit_ipc(ipc);
+}
+
+// A slow command of one client must not delay the requests of other clients,
+// but further requests of the same client.
+static void test_slow_command(struct test_ctx *ctx, const char *path)
+{
+    struct mp_ipc_ctx *ipc = start_server(ctx, path, OVERFLOW_DROP);
+
+    // The command blocks until the FIFO is opened for writing.
+    char *fifo = talloc_asprintf(NULL, "%s/ipc.fifo", ctx->out_path);
+    unlink(fifo);
+    assert_int_equal(mkfifo(fifo, 0600), 0);
+
+    struct conn a, b;
+    connect_client(&a, path, ctx->dispatch);
+    connect_client(&b, path, ctx->dispatch);
+
+    // Only replies are sent to a after this.
+    send_str(&a, "{\"command\": [\"disable_event\", \"all\"], "
+                 "\"request_id\": 1}\n");
+    wait_reply(&a, MP_IPC_JSON, 1, "success");
+
+    char *cmd = talloc_asprintf(fifo,
+        "{\"command\": {\"name\": \"subprocess\", \"args\": [\"cat\", \"%s\"], "
+        "\"playback_only\": false}, \"request_id\": 2}\n"
+        "{\"command\": [\"get_property\", \"mpv-version\"], "
+        "\"request_id\": 3}\n", fifo);
+    send_str(&a, cmd);
+
+    send_str(&b, "{\"command\": [\"get_property\", \"mpv-version\"], "
+                 "\"request_id\": 4}\n");
+    wait_reply(&b, MP_IPC_JSON, 4, "success");
+
+    // Wait until the subprocess opened the FIFO, and let it exit.
+    int fd;
+    while ((fd = open(fifo, O_WRONLY | O_NONBLOCK)) < 0) {
+        assert_int_equal(errno, ENXIO);
+        mp_dispatch_queue_process(ctx->dispatch, 0.01);
+    }
+    // a's get_property must have waited for the subprocess.
+    struct pollfd pfd = { .fd = a.fd, .events = POLLIN };
+    assert_int_equal(poll(&pfd, 1, 0), 0);
+    close(fd);
+
+    wait_reply(&a, MP_IPC_JSON, 2, "success");
+    wait_reply(&a, MP_IPC_JSON, 3, "success");
+
+    close_client(&a);
+    close_client(&b);
+    mp_uninit_ipc(ipc);
+    unlink(fifo);
+    talloc_free(fifo);
+}
+
+static void test_overflow(struct test_ctx *ctx, struct mp_log *log,
+                          const char *path, int overflow)
+{
+    struct mp_ipc_ctx *ipc = start_server(ctx, path, overflow);
+
+    struct conn c;
+    connect_client(&c, path, NULL);
+
+    send_str(&c, "{\"command\": [\"request_log_messages\", \"v\"], "
+                 "\"request_id\": 1}\n");
+    wait_reply(&c, MP_IPC_JSON, 1, "success");
+
+    // Far more output than the output limit and the socket buffers can hold,
+    // while the client doesn't read.
+    char text[200];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    for (int n = 0; n < NUM_MESSAGES; n++)
+        mp_verbose(log, "%d %s\n", n, text);
+
+    if (overflow == OVERFLOW_DROP) {
+        // The client stays connected and gets its reply once it reads
+        // its output. The output that piled up in the meantime is bounded.
+        send_str(&c, "{\"command\": [\"client_name\"], \"request_id\": 2}\n");
+        int messages = wait_reply(&c, MP_IPC_JSON, 2, "success");
+        MP_VERBOSE(ctx, "drop: %d of %d messages before reply.\n",
+                   messages, NUM_MESSAGES);
+        assert_true(messages < NUM_MESSAGES);
+
+        send_str(&c, "{\"command\": [\"client_name\"], \"request_id\": 3}\n");
+        wait_reply(&c, MP_IPC_JSON, 3, "success");
+    } else {
+        // The server gives up on the client.
+        int messages = 0;
+        while (1) {
+            void *tmp = talloc_new(NULL);
+            struct mpv_node node;
+            bool ok = read_msg(tmp, &c, MP_IPC_JSON, &node);
+            talloc_free(tmp);
+            if (!ok)
+                break;
+            messages++;
+        }
+        MP_VERBOSE(ctx, "disconnect: %d of %d messages before EOF.\n",
+                   messages, NUM_MESSAGES);
+        assert_true(messages < NUM_MESSAGES);
+    }
+
+    close_client(&c);
+    mp_uninit_ipc(ipc);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    struct mp_log *log = mp_log_new(NULL, ctx->log, "ipc-test");
+    char *path = talloc_asprintf(NULL, "%s/ipc.socket", ctx->out_path);
+
+    test_replies(ctx, path);
+    test_slow_command(ctx, path);
+    test_overflow(ctx, log, path, OVERFLOW_DROP);
+    test_overflow(ctx, log, path, OVERFLOW_DISCONNECT);
+
+    unlink(path);
+    talloc_free(path);
+    talloc_free(log);
+}
+
+const struct unittest test_ipc = {
+    .name = "ipc",
+    .run = run,
+};
@@ -0,0 +1,251 @@
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "input/input.h"
+#include "libmpv/client.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+struct entry {
+    const char *src;    // JSON
+    const char *out;    // expected MessagePack encoding
+    size_t out_len;
+};
+
+#define TEXT(...) #__VA_ARGS__
+#define BYTES(s) s, sizeof(s) - 1
+
+static const struct entry entries[] = {
+    { "null", BYTES("\xc0") },
+    { "true", BYTES("\xc3") },
+    { "false", BYTES("\xc2") },
+    { "0", BYTES("\x00") },
+    { "127", BYTES("\x7f") },
+    { "128", BYTES("\xcc\x80") },
+    { "300", BYTES("\xcd\x01\x2c") },
+    { "70000", BYTES("\xce\x00\x01\x11\x70") },
+    { "5000000000", BYTES("\xcf\x00\x00\x00\x01\x2a\x05\xf2\x00") },
+    { "-1", BYTES("\xff") },
+    { "-32", BYTES("\xe0") },
+    { "-33", BYTES("\xd0\xdf") },
+    { "-200", BYTES("\xd1\xff\x38") },
+    { "-70000", BYTES("\xd2\xff\xfe\xee\x90") },
+    { "1.5", BYTES("\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00") },
+    { TEXT(""), BYTES("\xa0") },
+    { TEXT("abc"), BYTES("\xa3" "abc") },
+    { TEXT("0123456789abcdef0123456789abcdef"),
+        BYTES("\xd9\x20" "0123456789abcdef0123456789abcdef") },
+    { "[]", BYTES("\x90") },
+    { "[1,[2],{}]", BYTES("\x93\x01\x91\x02\x80") },
+    { TEXT({"a":1,"b":"c"}), BYTES("\x82\xa1" "a" "\x01\xa1" "b" "\xa1" "c") },
+    { "[0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15]",
+        BYTES("\xdc\x00\x10\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b"
+              "\x0c\x0d\x0e\x0f") },
+};
+
+// Data the parser must reject.
+static const struct entry invalid[] = {
+    { NULL, BYTES("\xc1") },                    // never used
+    { NULL, BYTES("\xd4\x00\x00") },            // fixext 1
+    { NULL, BYTES("\x81\x01\x02") },            // non-string key
+    { NULL, BYTES("\x91\x91\x91\x91\xc0") },    // too deep
+};
+
+#define MAX_DEPTH 3
+
+static void test_entries(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
+        const struct entry *e = &entries[n];
+        void *tmp = talloc_new(NULL);
+
+        char *s = talloc_strdup(tmp, e->src);
+        struct mpv_node node;
+        assert_true(json_parse(tmp, &node, &s, MAX_DEPTH) >= 0);
+
+        bstr out = {0};
+        assert_true(msgpack_write(tmp, &out, &node) >= 0);
+        assert_int_equal(out.len, e->out_len);
+        assert_true(memcmp(out.start, e->out, out.len) == 0);
+
+        // Every prefix is incomplete, and must not be consumed.
+        for (size_t len = 0; len < out.len; len++) {
+            struct mpv_node res;
+            bstr src = {out.start, len};
+            assert_int_equal(msgpack_parse(tmp, &res, &src, MAX_DEPTH), 0);
+            assert_int_equal(src.len, len);
+        }
+
+        // Same when scanning incrementally, one more byte each time.
+        struct msgpack_scan scan = {0};
+        for (size_t len = 0; len < out.len; len++) {
+            bstr src = {out.start, len};
+            assert_int_equal(msgpack_scan(&scan, src, MAX_DEPTH), 0);
+        }
+        assert_int_equal(msgpack_scan(&scan, out, MAX_DEPTH), 1);
+
+        // Trailing data is left for the next message.
+        bstr_xappend(tmp, &out, bstr0("x"));
+        struct mpv_node res;
+        bstr src = out;
+        assert_int_equal(msgpack_parse(tmp, &res, &src, MAX_DEPTH), 1);
+        assert_true(bstr_equals0(src, "x"));
+        assert_true(equal_mpv_node(&node, &res));
+
+        talloc_free(tmp);
+    }
+
+    for (int n = 0; n < MP_ARRAY_SIZE(invalid); n++) {
+        const struct entry *e = &invalid[n];
+        void *tmp = talloc_new(NULL);
+        struct mpv_node res;
+        bstr src = {(unsigned char *)e->out, e->out_len};
+        assert_int_equal(msgpack_parse(tmp, &res, &src, MAX_DEPTH), -1);
+        // msgpack_scan() doesn't check the types of map keys.
+        struct msgpack_scan scan = {0};
+        assert_int_equal(msgpack_scan(&scan, src, MAX_DEPTH),
+                         e->out[0] == '\x81' ? 1 : -1);
+        talloc_free(tmp);
+    }
+}
+
+// A typical IPC event stream: playback position updates with the occasional
+// state change, a log message, and one big property (the playlist).
+static int make_events(void *ta_parent, struct mpv_event **out)
+{
+    static double time_pos, fps = 23.976;
+    static int flag = 1;
+    static mpv_event_property props[] = {
+        {"time-pos", MPV_FORMAT_DOUBLE, &time_pos},
+        {"estimated-vf-fps", MPV_FORMAT_DOUBLE, &fps},
+        {"pause", MPV_FORMAT_FLAG, &flag},
+    };
+    static mpv_event_log_message log = {
+        .prefix = "cplayer",
+        .level = "info",
+        .text = "AO: [pulse] 48000Hz stereo 2ch float\n",
+        .log_level = MPV_LOG_LEVEL_INFO,
+    };
+
+    int num = 0;
+    for (int n = 0; n < 60; n++) {
+        mpv_event ev = {
+            .event_id = MPV_EVENT_PROPERTY_CHANGE,
+            .reply_userdata = 1 + n % 2,
+            .data = &props[n % 2],
+        };
+        MP_TARRAY_APPEND(ta_parent, *out, num, ev);
+    }
+    MP_TARRAY_APPEND(ta_parent, *out, num, (mpv_event){
+        .event_id = MPV_EVENT_PROPERTY_CHANGE,
+        .reply_userdata = 3,
+        .data = &props[2],
+    });
+    MP_TARRAY_APPEND(ta_parent, *out, num, (mpv_event){
+        .event_id = MPV_EVENT_LOG_MESSAGE,
+        .data = &log,
+    });
+
+    struct mpv_node *playlist = talloc_zero(ta_parent, struct mpv_node);
+    node_init(playlist, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(ta_parent, playlist->u.list);
+    for (int n = 0; n < 20; n++) {
+        struct mpv_node *e = node_array_add(playlist, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "filename",
+            talloc_asprintf(ta_parent, "/media/videos/episode-%02d.mkv", n));
+        node_map_add_int64(e, "id", n + 1);
+        if (n == 3) {
+            node_map_add_flag(e, "current", true);
+            node_map_add_flag(e, "playing", true);
+        }
+    }
+    mpv_event_property *pl = talloc_ptrtype(ta_parent, pl);
+    *pl = (mpv_event_property){"playlist", MPV_FORMAT_NODE, playlist};
+    MP_TARRAY_APPEND(ta_parent, *out, num, (mpv_event){
+        .event_id = MPV_EVENT_PROPERTY_CHANGE,
+        .reply_userdata = 4,
+        .data = pl,
+    });
+
+    return num;
+}
+
+static void decode(void *ta_parent, bstr data, int encoding)
+{
+    struct mpv_node node;
+    if (encoding == MP_IPC_MSGPACK) {
+        assert_int_equal(msgpack_parse(ta_parent, &node, &data, 50), 1);
+        assert_int_equal(data.len, 0);
+    } else {
+        char *s = bstrto0(ta_parent, data);
+        assert_true(json_parse(ta_parent, &node, &s, 50) >= 0);
+    }
+    assert_int_equal(node.format, MPV_FORMAT_NODE_MAP);
+}
+
+static void run_encoding(struct test_ctx *ctx)
+{
+    int passes = test_passes(ctx, 2000);
+    static const char *const names[] = {
+        [MP_IPC_JSON] = "JSON",
+        [MP_IPC_MSGPACK] = "MessagePack",
+    };
+
+    void *ta = talloc_new(NULL);
+
+    struct mpv_event *events = NULL;
+    int num = make_events(ta, &events);
+
+    for (int encoding = MP_IPC_JSON; encoding <= MP_IPC_MSGPACK; encoding++) {
+        int64_t bytes = 0, t_enc = 0, t_dec = 0;
+        for (int pass = 0; pass < passes; pass++) {
+            void *tmp = talloc_new(NULL);
+            bstr *data = talloc_array(tmp, bstr, num);
+
+            for (int n = 0; n < num; n++) {
+                if (events[n].event_id == MPV_EVENT_PROPERTY_CHANGE) {
+                    mpv_event_property *prop = events[n].data;
+                    if (prop->format == MPV_FORMAT_DOUBLE)
+                        *(double *)prop->data += 1 / 24.0;
+                }
+            }
+
+            int64_t start = mp_time_us();
+            for (int n = 0; n < num; n++)
+                data[n] = mp_ipc_encode_event(tmp, &events[n], encoding);
+            int64_t mid = mp_time_us();
+            for (int n = 0; n < num; n++)
+                decode(tmp, data[n], encoding);
+            t_dec += mp_time_us() - mid;
+            t_enc += mid - start;
+
+            for (int n = 0; n < num; n++)
+                bytes += data[n].len;
+            talloc_free(tmp);
+        }
+
+        int64_t total = num * (int64_t)passes;
+        test_timing(ctx, "%-11s %6.1f bytes/event, encode %7.1f ns/event, "
+                    "decode %7.1f ns/event\n", names[encoding],
+                    bytes / (double)total, t_enc * 1e3 / total,
+                    t_dec * 1e3 / total);
+    }
+
+    talloc_free(ta);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    test_entries();
+    run_encoding(ctx);
+}
+
+const struct unittest test_msgpack = {
+    .name = "msgpack",
+    .run = run,
+    .run_bench = run_encoding,
+};
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "input/cmd.h"
+#include "misc/name_index.h"
+#include "options/m_config_frontend.h"
+#include "options/m_property.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+static int dummy_property(void *ctx, struct m_property *prop, int action,
+                          void *arg)
+{
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+// A property list of about the same size as the player's: one property for
+// each option.
+static struct m_property *make_list(struct test_ctx *ctx, void *ta_parent,
+                                    int *num)
+{
+    struct m_config *config = m_config_new(ta_parent, ctx->log, &mp_opt_root);
+    int num_opts = m_config_get_co_count(config);
+    struct m_property *list =
+        talloc_zero_array(ta_parent, struct m_property, num_opts + 1);
+    for (int n = 0; n < num_opts; n++) {
+        struct m_config_option *co = m_config_get_co_index(config, n);
+        list[n] = (struct m_property){
+            .name = co->name,
+            .call = dummy_property,
+        };
+    }
+    *num = num_opts;
+    return list;
+}
+
+static const struct mp_cmd_def *find_cmd_linear(const char *name)
+{
+    for (int n = 0; mp_cmds[n].name; n++) {
+        if (strcmp(mp_cmds[n].name, name) == 0)
+            return &mp_cmds[n];
+    }
+    return NULL;
+}
+
+static void run_lookup(struct test_ctx *ctx)
+{
+    int passes = test_passes(ctx, 1000);
+    void *ta = talloc_new(NULL);
+
+    int num_props;
+    struct m_property *list = make_list(ctx, ta, &num_props);
+    struct mp_name_index *props = m_property_index_create(ta, list);
+
+    int num_cmds = 0;
+    while (mp_cmds[num_cmds].name)
+        num_cmds++;
+
+    // Both must find the same entries (with duplicates, the first one).
+    for (int n = 0; n < num_props; n++) {
+        assert_true(mp_name_index_get(props, bstr0(list[n].name)) ==
+                    m_property_list_find(list, list[n].name));
+    }
+    for (int n = 0; n < num_cmds; n++) {
+        assert_true(mp_find_cmd_def(bstr0(mp_cmds[n].name)) ==
+                    find_cmd_linear(mp_cmds[n].name));
+    }
+    assert_true(!mp_name_index_get(props, bstr0("does-not-exist")));
+    assert_true(!mp_name_index_get(props, bstr0("")));
+    assert_true(!mp_find_cmd_def(bstr0("does-not-exist")));
+    assert_true(mp_find_cmd_def(bstr0("playlist_next")) ==
+                find_cmd_linear("playlist-next"));
+
+    // Sub-property syntax is resolved with the base name.
+    struct m_option opt = {0};
+    assert_int_equal(m_property_do(NULL, props, "does-not-exist/foo",
+                                   M_PROPERTY_GET_TYPE, &opt, NULL),
+                     M_PROPERTY_UNKNOWN);
+
+    int64_t t[2] = {0};
+    volatile uintptr_t sink = 0;
+    for (int i = 0; i < 2; i++) {
+        int64_t start = mp_time_us();
+        for (int p = 0; p < passes; p++) {
+            for (int n = 0; n < num_props; n++) {
+                const char *name = list[n].name;
+                if (i) {
+                    sink += (uintptr_t)mp_name_index_get(props, bstr0(name));
+                } else {
+                    sink += (uintptr_t)m_property_list_find(list, name);
+                }
+            }
+        }
+        t[i] = mp_time_us() - start;
+    }
+    double lookups = num_props * (double)passes;
+    test_timing(ctx, "%4d properties: linear %7.1f ns, hashed %5.1f ns\n",
+                num_props, t[0] * 1e3 / lookups, t[1] * 1e3 / lookups);
+
+    for (int i = 0; i < 2; i++) {
+        int64_t start = mp_time_us();
+        for (int p = 0; p < passes; p++) {
+            for (int n = 0; n < num_cmds; n++) {
+                const char *name = mp_cmds[n].name;
+                if (i) {
+                    sink += (uintptr_t)mp_find_cmd_def(bstr0(name));
+                } else {
+                    sink += (uintptr_t)find_cmd_linear(name);
+                }
+            }
+        }
+        t[i] = mp_time_us() - start;
+    }
+    lookups = num_cmds * (double)passes;
+    test_timing(ctx, "%4d commands:   linear %7.1f ns, hashed %5.1f ns\n",
+                num_cmds, t[0] * 1e3 / lookups, t[1] * 1e3 / lookups);
+
+    talloc_free(ta);
+}
+
+const struct unittest test_property_lookup = {
+    .name = "property_lookup",
+    .run = run_lookup,
+    .run_bench = run_lookup,
+};
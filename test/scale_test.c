@@ -1,5 +1,6 @@
 #include <libavcodec/avcodec.h>
 
+#include "osdep/timer.h"
 #include "scale_test.h"
 #include "video/image_writer.h"
 #include "video/sws_utils.h"
@@ -186,3 +187,157 @@ void repack_test_run(struct scale_test *stest)
     assert_text_files_equal(stest->ctx, logname, logname,
                             "This can fail if FFmpeg adds or removes pixfmts.");
 }
+
+static void fill_random(struct mp_image *img, uint32_t *seed)
+{
+    for (int p = 0; p < img->num_planes; p++) {
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + img->stride[p] * (ptrdiff_t)y;
+            for (int x = 0; x < img->stride[p]; x++) {
+                *seed = *seed * 1664525 + 1013904223;
+                line[x] = *seed >> 24;
+            }
+        }
+    }
+}
+
+static bool imgs_equal(struct mp_image *a, struct mp_image *b)
+{
+    for (int p = 0; p < a->num_planes; p++) {
+        size_t size = a->fmt.bytes[p] * (size_t)mp_image_plane_w(a, p);
+        for (int y = 0; y < mp_image_plane_h(a, p); y++) {
+            void *line_a = a->planes[p] + a->stride[p] * (ptrdiff_t)y;
+            void *line_b = b->planes[p] + b->stride[p] * (ptrdiff_t)y;
+            if (memcmp(line_a, line_b, size) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Planar format with the same components (one per plane, in GBRP or YUV
+// order), subsampling and depth, or 0 if there is none.
+static int planar_imgfmt(int imgfmt)
+{
+    struct mp_regular_imgfmt reg;
+    if (!mp_get_regular_imgfmt(&reg, imgfmt))
+        return 0;
+
+    bool present[MP_NUM_COMPONENTS + 1] = {0};
+    for (int p = 0; p < reg.num_planes; p++) {
+        for (int c = 0; c < reg.planes[p].num_components; c++)
+            present[reg.planes[p].components[c]] = true;
+    }
+
+    static const int rgb_order[] = {2, 3, 1, 4}, yuv_order[] = {1, 2, 3, 4};
+    const int *order = reg.forced_csp == MP_CSP_RGB ? rgb_order : yuv_order;
+    struct mp_regular_imgfmt planar = reg;
+    planar.num_planes = 0;
+    for (int n = 0; n < MP_NUM_COMPONENTS; n++) {
+        if (present[order[n]]) {
+            planar.planes[planar.num_planes++] = (struct mp_regular_imgfmt_plane)
+                {.num_components = 1, .components = {order[n]}};
+        }
+    }
+
+    int res = mp_find_regular_imgfmt(&planar);
+    if (!res && planar.component_pad > 0) {
+        // E.g. P010 => yuv420p16.
+        planar.component_pad = 0;
+        res = mp_find_regular_imgfmt(&planar);
+    }
+    return res;
+}
+
+// Convert src to out iterations times with priv, and return the speed.
+static double convert(struct scale_test *stest, void *priv,
+                      struct mp_image *out, struct mp_image *src,
+                      int iterations)
+{
+    int64_t t = mp_time_us();
+    for (int n = 0; n < iterations; n++) {
+        bool ok = stest->fns->scale(priv, out, src);
+        assert(ok);
+    }
+    double mpx = src->w * (double)src->h * iterations / 1e6;
+    return test_rate(mpx, mp_time_us() - t);
+}
+
+// Convert src to dst_fmt with both implementations, and return the result of
+// ref_priv, or NULL if the conversion isn't supported.
+static struct mp_image *compare_conversion(struct scale_test *stest,
+                                           void *ref_priv, int dst_fmt,
+                                           struct mp_image *src)
+{
+    if (!stest->fns->supports_fmts(stest->fns_priv, dst_fmt, src->imgfmt))
+        return NULL;
+
+    struct mp_image *dst = mp_image_alloc(dst_fmt, src->w, src->h);
+    struct mp_image *ref = mp_image_alloc(dst_fmt, src->w, src->h);
+    assert(dst && ref);
+
+    int iterations = test_passes(stest->ctx, 20);
+    double speed = convert(stest, stest->fns_priv, dst, src, iterations);
+    double speed_ref = convert(stest, ref_priv, ref, src, iterations);
+
+    bool ok = imgs_equal(ref, dst);
+    char *pair = mp_tprintf(40, "%s -> %s", mp_imgfmt_to_name(src->imgfmt),
+                            mp_imgfmt_to_name(dst_fmt));
+    if (stest->ctx->bench) {
+        MP_INFO(stest->ctx, "%-28s %10.1f Mpx/s %10.1f Mpx/s (ref)%s\n",
+                pair, speed, speed_ref, ok ? "" : " MISMATCH");
+    } else if (!ok) {
+        MP_ERR(stest->ctx, "%s: mismatch\n", pair);
+    } else {
+        MP_VERBOSE(stest->ctx, "%s: ok\n", pair);
+    }
+    if (!ok)
+        stest->fail += 1;
+
+    talloc_free(dst);
+    return ref;
+}
+
+void repack_test_compare(struct scale_test *stest, void *ref_priv)
+{
+    // Odd width to exercise the non-vectorized remainder of each line.
+    int w = 1023, h = 128;
+    uint32_t seed = 1;
+
+    init_imgfmts_list();
+
+    for (int a = 0; a < num_imgfmts; a++) {
+        int mpfmt = imgfmts[a];
+        struct mp_imgfmt_desc fmtdesc = mp_imgfmt_get_desc(mpfmt);
+        if (!(fmtdesc.flags & MP_IMGFLAG_BYTE_ALIGNED) ||
+            !stest->fns->supports_fmts(stest->fns_priv, mpfmt, mpfmt))
+            continue;
+
+        int fw = MP_ALIGN_UP(w, fmtdesc.align_x);
+        int fh = MP_ALIGN_UP(h, fmtdesc.align_y);
+        struct mp_image *src = mp_image_alloc(mpfmt, fw, fh);
+        assert(src);
+        fill_random(src, &seed);
+
+        // Round trip through the same format: unpacks and packs.
+        talloc_free(compare_conversion(stest, ref_priv, mpfmt, src));
+
+        // An unpacker and packer with mirrored bugs (like swapped
+        // components) cancel out in the round trip, so check them separately
+        // against a planar format. The reference's planar image is valid
+        // input for the way back.
+        int planar = planar_imgfmt(mpfmt);
+        if (planar && planar != mpfmt) {
+            struct mp_image *tmp =
+                compare_conversion(stest, ref_priv, planar, src);
+            if (tmp) {
+                talloc_free(compare_conversion(stest, ref_priv, mpfmt, tmp));
+            }
+            talloc_free(tmp);
+        }
+
+        talloc_free(src);
+    }
+
+    assert_int_equal(stest->fail, 0);
+}
@@ -26,3 +26,11 @@ struct scale_test {
 
 // Test color repacking between packed formats (typically RGB).
 void repack_test_run(struct scale_test *stest);
+
+// For each format supported by stest->fns, convert random data with
+// stest->fns_priv and ref_priv (e.g. a reference implementation), and check
+// that the results are bit-exact. Each format is converted to itself, and to
+// and from the planar format with the same components, so that unpacking and
+// packing are checked separately. When benchmarking, the speed of both is
+// logged per format pair.
+void repack_test_compare(struct scale_test *stest, void *ref_priv);
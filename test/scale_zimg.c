@@ -57,3 +57,29 @@ const struct unittest test_repack_zimg = {
     .name = "repack_zimg",
     .run = run,
 };
+
+// Check the optimized repackers against the C ones.
+static void run_simd(struct test_ctx *ctx)
+{
+    struct mp_zimg_context *zimg = mp_zimg_alloc();
+    struct mp_zimg_context *zimg_c = mp_zimg_alloc();
+    zimg_c->no_simd = true;
+
+    struct scale_test *stest = talloc_zero(NULL, struct scale_test);
+    stest->fns = &fns;
+    stest->fns_priv = zimg;
+    stest->test_name = "repack_zimg_simd";
+    stest->ctx = ctx;
+
+    repack_test_compare(stest, zimg_c);
+
+    talloc_free(stest);
+    talloc_free(zimg);
+    talloc_free(zimg_c);
+}
+
+const struct unittest test_repack_zimg_simd = {
+    .name = "repack_zimg_simd",
+    .run = run_simd,
+    .run_bench = run_simd,
+};
@@ -0,0 +1,152 @@
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux/packet.h"
+#include "demux/seek_index.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+// Reference implementation.
+static struct demux_packet *find_linear(struct demux_packet *pkts, int start,
+                                        int end, double pts)
+{
+    struct demux_packet *res = NULL;
+    for (int n = start; n < end; n++) {
+        if (pkts[n].pts <= pts)
+            res = &pkts[n];
+    }
+    return res;
+}
+
+static void check_find(struct seek_index *idx, struct demux_packet *pkts,
+                       int start, int end)
+{
+    assert_int_equal(idx->num, end - start);
+    if (start < end) {
+        assert_true(seek_index_first(idx)->pkt == &pkts[start]);
+        assert_true(seek_index_last(idx)->pkt == &pkts[end - 1]);
+    }
+    for (int n = start - 1; n <= end; n++) {
+        for (double d = -0.5; d <= 0.5; d += 0.5) {
+            struct seek_index_entry *e = seek_index_find(idx, n + d);
+            struct demux_packet *ref = find_linear(pkts, start, end, n + d);
+            assert_true((e ? e->pkt : NULL) == ref);
+        }
+    }
+}
+
+static void run(struct test_ctx *ctx)
+{
+    int num = SEEK_INDEX_BLOCK_SIZE * 5 + 3;
+    struct demux_packet *pkts =
+        talloc_zero_array(NULL, struct demux_packet, num);
+    for (int n = 0; n < num; n++)
+        pkts[n].pts = n;
+
+    struct seek_index idx = {0};
+    check_find(&idx, pkts, 0, 0);
+
+    for (int n = 0; n < num; n++)
+        seek_index_append(&idx, pkts[n].pts, &pkts[n]);
+    check_find(&idx, pkts, 0, num);
+
+    // Removing from the start frees and reuses blocks.
+    int start = 0;
+    while (start < SEEK_INDEX_BLOCK_SIZE * 3 + 1) {
+        seek_index_remove_first(&idx);
+        start++;
+    }
+    check_find(&idx, pkts, start, num);
+    for (int n = 0; n < 5; n++) {
+        assert_true(seek_index_get(&idx, n)->pkt == &pkts[start + n]);
+    }
+
+    // Append a second index, with overlapping entries dropped.
+    struct demux_packet *pkts2 =
+        talloc_zero_array(pkts, struct demux_packet, num);
+    struct seek_index idx2 = {0};
+    for (int n = 0; n < num; n++) {
+        pkts2[n].pts = num - 10 + n;
+        seek_index_append(&idx2, pkts2[n].pts, &pkts2[n]);
+    }
+    seek_index_move(&idx, &idx2, 1.0);
+    assert_int_equal(idx2.num, 0);
+    assert_int_equal(idx.num, num - start + num - 10);
+    assert_true(seek_index_find(&idx, num - 0.5)->pkt == &pkts[num - 1]);
+    assert_true(seek_index_find(&idx, num + 0.5)->pkt == &pkts2[10]);
+    assert_true(seek_index_last(&idx)->pkt == &pkts2[num - 1]);
+    for (int n = start; n < num * 2 - 10; n++)
+        assert_float_equal(seek_index_find(&idx, n + 0.5)->pts, n, 0);
+
+    seek_index_clear(&idx);
+    check_find(&idx, pkts, 0, 0);
+    assert_int_equal(seek_index_get_alloc_size(&idx), 0);
+
+    talloc_free(pkts);
+}
+
+// Simulate a cached seek: look up the index, then walk the packet list to the
+// last keyframe before the target (like find_seek_target() in demux.c).
+static struct demux_packet *seek_packets(struct seek_index *idx,
+                                         struct demux_packet *head, double pts)
+{
+    struct seek_index_entry *e = idx ? seek_index_find(idx, pts) : NULL;
+    struct demux_packet *target = NULL;
+    for (struct demux_packet *dp = e ? e->pkt : head; dp; dp = dp->next) {
+        if (dp->keyframe) {
+            if (target && dp->pts > pts)
+                break;
+            target = dp;
+        }
+    }
+    return target;
+}
+
+static void run_bench(struct test_ctx *ctx)
+{
+    const int fps = 10, kf_interval = 20; // 2 second GOPs
+    const double durations[] = {60, 600, 3600, 4 * 3600, 12 * 3600};
+    const int num_seeks = 2000;
+
+    for (int i = 0; i < MP_ARRAY_SIZE(durations); i++) {
+        int num = durations[i] * fps;
+        struct demux_packet *pkts =
+            talloc_zero_array(NULL, struct demux_packet, num);
+        struct seek_index idx = {0};
+        for (int n = 0; n < num; n++) {
+            pkts[n].pts = n / (double)fps;
+            pkts[n].keyframe = n % kf_interval == 0;
+            pkts[n].next = n + 1 < num ? &pkts[n + 1] : NULL;
+            if (pkts[n].keyframe)
+                seek_index_append(&idx, pkts[n].pts, &pkts[n]);
+        }
+
+        // Also compare with walking the list without index, but only for short
+        // ranges to keep the runtime sane.
+        for (int use_index = 1; use_index >= 0; use_index--) {
+            if (!use_index && durations[i] > 3600)
+                continue;
+            uint32_t seed = 1;
+            int64_t t = mp_time_us();
+            for (int n = 0; n < num_seeks; n++) {
+                seed = seed * 1664525 + 1013904223;
+                double pts = (seed >> 8) / (double)(1 << 24) * durations[i];
+                struct demux_packet *dp =
+                    seek_packets(use_index ? &idx : NULL, pkts, pts);
+                assert_true(dp && dp->pts <= pts && pts - dp->pts <
+                            kf_interval / (double)fps);
+            }
+            t = mp_time_us() - t;
+            MP_INFO(ctx, "range %6.0fs, %-8s: %8.3f us/seek\n", durations[i],
+                    use_index ? "index" : "no index", t / (double)num_seeks);
+        }
+
+        seek_index_clear(&idx);
+        talloc_free(pkts);
+    }
+}
+
+const struct unittest test_seek_index = {
+    .name = "seek_index",
+    .run = run,
+    .run_bench = run_bench,
+};
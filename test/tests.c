@@ -5,18 +5,34 @@
 
 static const struct unittest *unittests[] = {
     &test_chmap,
+    &test_draw_bmp,
     &test_gl_video,
+    &test_image_copy,
     &test_img_format,
     &test_json,
     &test_linked_list,
+    &test_msgpack,
     &test_paths,
+    &test_property_lookup,
     &test_repack_sws,
+    &test_seek_index,
+#if HAVE_POSIX
+    &test_ipc,
+#endif
 #if HAVE_ZIMG
     &test_repack_zimg,
+    &test_repack_zimg_simd,
 #endif
     NULL
 };
 
+// Whether sel is "<name>_bench".
+static bool is_bench(const char *sel, const char *name)
+{
+    size_t len = strlen(name);
+    return strncmp(sel, name, len) == 0 && strcmp(sel + len, "_bench") == 0;
+}
+
 bool run_tests(struct MPContext *mpctx)
 {
     char *sel = mpctx->opts->test_mode;
@@ -24,8 +40,11 @@ bool run_tests(struct MPContext *mpctx)
 
     if (strcmp(sel, "help") == 0) {
         MP_INFO(mpctx, "Available tests:\n");
-        for (int n = 0; unittests[n]; n++)
+        for (int n = 0; unittests[n]; n++) {
             MP_INFO(mpctx, "   %s\n", unittests[n]->name);
+            if (unittests[n]->run_bench)
+                MP_INFO(mpctx, "   %s_bench\n", unittests[n]->name);
+        }
         MP_INFO(mpctx, "   all-simple\n");
         return true;
     }
@@ -35,6 +54,7 @@ bool run_tests(struct MPContext *mpctx)
         .log = mpctx->log,
         .ref_path = "test/ref",
         .out_path = "test/out",
+        .dispatch = mpctx->dispatch,
     };
 
     if (!mp_path_isdir(ctx.ref_path)) {
@@ -62,6 +82,13 @@ bool run_tests(struct MPContext *mpctx)
                 t->run(&ctx);
             num_run++;
         }
+
+        if (t->run_bench && is_bench(sel, t->name)) {
+            ctx.bench = true;
+            t->run_bench(&ctx);
+            ctx.bench = false;
+            num_run++;
+        }
     }
 
     MP_INFO(mpctx, "%d unittests successfully run.\n", num_run);
@@ -110,6 +137,24 @@ FILE *test_open_out(struct test_ctx *ctx, const char *name)
     return f;
 }
 
+int test_passes(struct test_ctx *ctx, int n)
+{
+    return ctx->bench ? n : 1;
+}
+
+void test_timing(struct test_ctx *ctx, const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    mp_msg_va(ctx->log, ctx->bench ? MSGL_INFO : MSGL_V, format, va);
+    va_end(va);
+}
+
+double test_rate(double items, int64_t us)
+{
+    return items / MPMAX(us, 1) * 1e6;
+}
+
 void assert_text_files_equal_impl(const char *file, int line,
                                   struct test_ctx *ctx, const char *ref,
                                   const char *new, const char *err)
@@ -7,6 +7,7 @@
 #include "common/common.h"
 
 struct MPContext;
+struct mp_dispatch_queue;
 
 bool run_tests(struct MPContext *mpctx);
 
@@ -19,6 +20,14 @@ struct test_ctx {
 
     // Path for result files, without trailing "/".
     const char *out_path;
+
+    // The core doesn't run while tests are executed. Tests which need it to
+    // handle requests from other threads call mp_dispatch_queue_process() on
+    // this.
+    struct mp_dispatch_queue *dispatch;
+
+    // Set while run_bench is executing (see test_passes()).
+    bool bench;
 };
 
 struct unittest {
@@ -34,16 +43,27 @@ struct unittest {
     // Entrypoint for tests which have a simple dependency on the mpv core. The
     // core is sufficiently initialized at this point.
     void (*run)(struct test_ctx *ctx);
+
+    // Optional benchmark, selected with --unittest=<name>_bench. It is never
+    // run by all-simple, and prints its results with MP_INFO().
+    void (*run_bench)(struct test_ctx *ctx);
 };
 
 extern const struct unittest test_chmap;
+extern const struct unittest test_draw_bmp;
 extern const struct unittest test_gl_video;
+extern const struct unittest test_image_copy;
 extern const struct unittest test_img_format;
+extern const struct unittest test_ipc;
 extern const struct unittest test_json;
 extern const struct unittest test_linked_list;
+extern const struct unittest test_msgpack;
 extern const struct unittest test_repack_sws;
 extern const struct unittest test_repack_zimg;
+extern const struct unittest test_repack_zimg_simd;
 extern const struct unittest test_paths;
+extern const struct unittest test_property_lookup;
+extern const struct unittest test_seek_index;
 
 #define assert_true(x) assert(x)
 #define assert_false(x) assert(!(x))
@@ -73,6 +93,17 @@ void assert_text_files_equal_impl(const char *file, int line,
 // Open a new file in the out_path. Always succeeds.
 FILE *test_open_out(struct test_ctx *ctx, const char *name);
 
+// For code shared by run and run_bench: return n when benchmarking, else 1.
+int test_passes(struct test_ctx *ctx, int n);
+
+// Log timings. They are shown with MP_INFO() when benchmarking, and as verbose
+// messages otherwise.
+void test_timing(struct test_ctx *ctx, const char *format, ...)
+    PRINTF_ATTRIBUTE(2, 3);
+
+// Items (pixels, bytes...) per second, for a duration taken with mp_time_us().
+double test_rate(double items, int64_t us);
+
 // Sorted list of valid imgfmts. Call init_imgfmts_list() before use.
 extern int imgfmts[];
 extern int num_imgfmts;
@@ -213,6 +213,7 @@ static struct mp_filter *f_create(struct mp_filter *parent, void *options)
         .scaler_chroma = ZIMG_RESIZE_BILINEAR,
         .dither = ZIMG_DITHER_NONE,
         .fast = 1,
+        .threads = 1,
     };
     return f;
 }
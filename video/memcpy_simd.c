@@ -0,0 +1,90 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "memcpy_simd.h"
+
+// Copies with non-temporal stores: the destination bypasses the cache, so a
+// huge copy does not evict everything else, and the CPU does not need to read
+// the destination cache lines before overwriting them.
+// The x86 code is compiled with function specific target attributes, so it
+// does not require special compiler flags, and is selected at runtime.
+// (ARM has no non-temporal stores in the NEON intrinsics.)
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define HAVE_SIMD_X86 0
+#endif
+
+#if HAVE_SIMD_X86
+TARGET_SSE2
+static void memcpy_pic_nt_sse2(void *dst, const void *src, int bytesPerLine,
+                               int height, int dstStride, int srcStride)
+{
+    for (int y = 0; y < height; y++) {
+        uint8_t *d = (uint8_t *)dst + dstStride * (ptrdiff_t)y;
+        const uint8_t *s = (const uint8_t *)src + srcStride * (ptrdiff_t)y;
+
+        // Streaming stores must be aligned; the source can be unaligned.
+        int x = MPMIN(bytesPerLine, (16 - ((uintptr_t)d & 15)) & 15);
+        memcpy(d, s, x);
+
+        for (; x + 64 <= bytesPerLine; x += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(s + x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(s + x + 16));
+            __m128i c = _mm_loadu_si128((const __m128i *)(s + x + 32));
+            __m128i e = _mm_loadu_si128((const __m128i *)(s + x + 48));
+            _mm_stream_si128((__m128i *)(d + x), a);
+            _mm_stream_si128((__m128i *)(d + x + 16), b);
+            _mm_stream_si128((__m128i *)(d + x + 32), c);
+            _mm_stream_si128((__m128i *)(d + x + 48), e);
+        }
+        for (; x + 16 <= bytesPerLine; x += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(s + x));
+            _mm_stream_si128((__m128i *)(d + x), a);
+        }
+
+        memcpy(d + x, s + x, bytesPerLine - x);
+    }
+
+    // Make the stores visible to other threads (weakly ordered otherwise).
+    _mm_sfence();
+}
+#endif
+
+mp_memcpy_pic_fn mp_memcpy_simd_pic_nt(void)
+{
+    int flags = av_get_cpu_flags();
+
+#if HAVE_SIMD_X86
+    if (flags & AV_CPU_FLAG_SSE2)
+        return memcpy_pic_nt_sse2;
+#endif
+
+    (void)flags;
+    return NULL;
+}
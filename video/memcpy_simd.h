@@ -0,0 +1,10 @@
+#pragma once
+
+// Same signature and semantics as memcpy_pic().
+typedef void (*mp_memcpy_pic_fn)(void *dst, const void *src, int bytesPerLine,
+                                 int height, int dstStride, int srcStride);
+
+// Return a memcpy_pic() variant which uses non-temporal (streaming) stores,
+// or NULL if there is none for this CPU. This is only faster if the
+// destination is larger than the CPU cache, and is not read again soon.
+mp_memcpy_pic_fn mp_memcpy_simd_pic_nt(void);
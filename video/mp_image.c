@@ -22,6 +22,7 @@
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/rational.h>
 #include <libavcodec/avcodec.h>
@@ -32,7 +33,10 @@
 #include "config.h"
 #include "common/av_common.h"
 #include "common/common.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "hwdec.h"
+#include "memcpy_simd.h"
 #include "mp_image.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
@@ -449,10 +453,22 @@ void mp_image_unrefp(struct mp_image **p_img)
     *p_img = NULL;
 }
 
-void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
-                int dstStride, int srcStride)
+// Copies of at least this size use non-temporal stores if possible. They are
+// slower if the destination fits into the CPU cache and is used right away.
+#define COPY_NT_MIN_BYTES (8 * 1024 * 1024)
+
+// mp_image_copy() uses 1 thread per this many bytes, up to COPY_MAX_THREADS.
+// A few threads are enough to saturate memory bandwidth.
+#define COPY_THREAD_MIN_BYTES (8 * 1024 * 1024)
+#define COPY_MAX_THREADS 4
+
+static void copy_pic(void *dst, const void *src, int bytesPerLine, int height,
+                     int dstStride, int srcStride, bool nt)
 {
-    if (bytesPerLine == dstStride && dstStride == srcStride && height) {
+    mp_memcpy_pic_fn nt_fn = nt ? mp_memcpy_simd_pic_nt() : NULL;
+    if (nt_fn) {
+        nt_fn(dst, src, bytesPerLine, height, dstStride, srcStride);
+    } else if (bytesPerLine == dstStride && dstStride == srcStride && height) {
         if (srcStride < 0) {
             src = (uint8_t*)src + (height - 1) * srcStride;
             dst = (uint8_t*)dst + (height - 1) * dstStride;
@@ -469,17 +485,101 @@ void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
     }
 }
 
+void memcpy_pic(void *dst, const void *src, int bytesPerLine, int height,
+                int dstStride, int srcStride)
+{
+    bool nt = bytesPerLine * (int64_t)height >= COPY_NT_MIN_BYTES;
+    copy_pic(dst, src, bytesPerLine, height, dstStride, srcStride, nt);
+}
+
+static pthread_once_t slice_pool_once = PTHREAD_ONCE_INIT;
+static struct mp_thread_pool *slice_pool;
+
+static void init_slice_pool(void)
+{
+    // Process-wide and never freed. Idle threads exit after a while, so this
+    // costs nothing while no large images are processed.
+    slice_pool = mp_thread_pool_create(NULL, 0, 0,
+                                       MPCLAMP(av_cpu_count(), 1, 64));
+}
+
+struct mp_thread_pool *mp_image_slice_pool(void)
+{
+    pthread_once(&slice_pool_once, init_slice_pool);
+    return slice_pool;
+}
+
+struct copy_slice {
+    struct mp_image *dst, *src;
+    int index, num_slices;
+    bool nt;
+    struct mp_waiter waiter;
+};
+
+// Copy the index-th of num_slices horizontal stripes of each plane.
+static void copy_slice(struct copy_slice *s)
+{
+    struct mp_image *dst = s->dst, *src = s->src;
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int plane_h = mp_image_plane_h(dst, n);
+        int y0 = plane_h * (int64_t)s->index / s->num_slices;
+        int y1 = plane_h * (int64_t)(s->index + 1) / s->num_slices;
+        copy_pic(dst->planes[n] + dst->stride[n] * (ptrdiff_t)y0,
+                 src->planes[n] + src->stride[n] * (ptrdiff_t)y0,
+                 line_bytes, y1 - y0, dst->stride[n], src->stride[n], s->nt);
+    }
+}
+
+static void copy_slice_thread(void *p)
+{
+    struct copy_slice *s = p;
+    copy_slice(s);
+    mp_waiter_wakeup(&s->waiter, 0);
+}
+
 void mp_image_copy(struct mp_image *dst, struct mp_image *src)
 {
     assert(dst->imgfmt == src->imgfmt);
     assert(dst->w == src->w && dst->h == src->h);
     assert(mp_image_is_writeable(dst));
+
+    int64_t size = 0;
     for (int n = 0; n < dst->num_planes; n++) {
         int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
-        int plane_h = mp_image_plane_h(dst, n);
-        memcpy_pic(dst->planes[n], src->planes[n], line_bytes, plane_h,
-                   dst->stride[n], src->stride[n]);
+        size += line_bytes * (int64_t)mp_image_plane_h(dst, n);
     }
+
+    // Large copies (like 8K frames) are split into stripes, which are copied
+    // on the shared slice thread pool.
+    int num_slices = MPCLAMP(size / COPY_THREAD_MIN_BYTES, 1,
+                             MPMIN(COPY_MAX_THREADS, av_cpu_count()));
+    struct mp_thread_pool *pool = num_slices > 1 ? mp_image_slice_pool() : NULL;
+    struct copy_slice slices[COPY_MAX_THREADS];
+    bool queued[COPY_MAX_THREADS] = {0};
+    for (int n = 0; n < num_slices; n++) {
+        slices[n] = (struct copy_slice){
+            .dst = dst,
+            .src = src,
+            .index = n,
+            .num_slices = num_slices,
+            .nt = size >= COPY_NT_MIN_BYTES,
+            .waiter = MP_WAITER_INITIALIZER,
+        };
+        if (n > 0)
+            queued[n] = mp_thread_pool_queue(pool, copy_slice_thread, &slices[n]);
+    }
+    // The calling thread copies the first slice, and any slice that could not
+    // be queued.
+    for (int n = 0; n < num_slices; n++) {
+        if (!queued[n])
+            copy_slice(&slices[n]);
+    }
+    for (int n = 1; n < num_slices; n++) {
+        if (queued[n])
+            mp_waiter_wait(&slices[n].waiter);
+    }
+
     if (dst->fmt.flags & MP_IMGFLAG_PAL)
         memcpy(dst->planes[1], src->planes[1], AVPALETTE_SIZE);
 }
@@ -128,6 +128,11 @@ struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
+// Shared thread pool for splitting work on large images into slices. Queued
+// work may wait for other users' slices; the caller should process one slice
+// itself. Work run on the pool must not wait for other work on it (e.g. by
+// calling mp_image_copy()). Never freed.
+struct mp_thread_pool *mp_image_slice_pool(void);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
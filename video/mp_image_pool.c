@@ -21,6 +21,7 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <assert.h>
+#include <string.h>
 
 #include <libavutil/buffer.h>
 #include <libavutil/hwcontext.h>
@@ -29,6 +30,7 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "common/stats.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
@@ -64,6 +66,193 @@ struct image_flags {
     unsigned int order;         // for LRU allocation (basically a timestamp)
 };
 
+// Process-wide pool of plain (mp_image_alloc() allocated) images. Pools that
+// do not use a custom allocator take their images from here if a budget is
+// set, so that images released by one filter or decoder can be reused by
+// another one, and the total amount of cached memory is bounded.
+struct global_entry {
+    struct mp_image *img;       // owns the data; never handed out directly
+    size_t size;
+};
+
+struct global_budget {
+    void *owner;
+    int64_t bytes;
+};
+
+static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    int64_t budget;             // largest of budgets[]; 0 means disabled
+    // Budgets requested by each player instance (budget > 0 only).
+    struct global_budget *budgets;
+    int num_budgets;
+    // Unreferenced images, least recently used first.
+    struct global_entry *idle;
+    int num_idle;
+    int64_t idle_bytes;
+    int64_t used_bytes;         // handed out and still referenced
+    uint64_t hits, misses, evictions;
+} global_pool;
+
+// Remove the least recently used idle images until the budget is kept. The
+// images are appended to *out, and must be freed by the caller outside of the
+// lock.
+static void global_pool_evict(struct mp_image ***out, int *num_out)
+{
+    int n = 0;
+    while (n < global_pool.num_idle &&
+           global_pool.idle_bytes > global_pool.budget)
+    {
+        struct global_entry *e = &global_pool.idle[n++];
+        global_pool.idle_bytes -= e->size;
+        global_pool.evictions++;
+        MP_TARRAY_APPEND(NULL, *out, *num_out, e->img);
+    }
+    global_pool.num_idle -= n;
+    memmove(&global_pool.idle[0], &global_pool.idle[n],
+            global_pool.num_idle * sizeof(global_pool.idle[0]));
+}
+
+static void free_images(struct mp_image **imgs, int num)
+{
+    for (int n = 0; n < num; n++)
+        talloc_free(imgs[n]);
+    talloc_free(imgs);
+}
+
+static void global_unref_image(void *opaque, uint8_t *data)
+{
+    struct mp_image *img = opaque;
+    size_t size = img->bufs[0]->size;
+    struct mp_image **dead = NULL;
+    int num_dead = 0;
+
+    pthread_mutex_lock(&global_mutex);
+    global_pool.used_bytes -= size;
+    if (global_pool.budget > 0) {
+        struct global_entry e = {img, size};
+        MP_TARRAY_APPEND(NULL, global_pool.idle, global_pool.num_idle, e);
+        global_pool.idle_bytes += size;
+        global_pool_evict(&dead, &num_dead);
+    } else {
+        MP_TARRAY_APPEND(NULL, dead, num_dead, img);
+    }
+    pthread_mutex_unlock(&global_mutex);
+
+    free_images(dead, num_dead);
+}
+
+// Return an image from the global pool, or allocate a new one. Returns NULL
+// if the global pool is disabled, or on OOM.
+static struct mp_image *global_pool_get(int fmt, int w, int h)
+{
+    struct mp_image *img = NULL;
+
+    pthread_mutex_lock(&global_mutex);
+    if (global_pool.budget <= 0) {
+        pthread_mutex_unlock(&global_mutex);
+        return NULL;
+    }
+    // Most recently used first; it's the most likely to be still in cache.
+    for (int n = global_pool.num_idle - 1; n >= 0; n--) {
+        struct mp_image *cur = global_pool.idle[n].img;
+        if (cur->imgfmt == fmt && cur->w == w && cur->h == h) {
+            img = cur;
+            global_pool.idle_bytes -= global_pool.idle[n].size;
+            MP_TARRAY_REMOVE_AT(global_pool.idle, global_pool.num_idle, n);
+            break;
+        }
+    }
+    if (img) {
+        global_pool.hits++;
+    } else {
+        global_pool.misses++;
+    }
+    pthread_mutex_unlock(&global_mutex);
+
+    if (!img) {
+        img = mp_image_alloc(fmt, w, h);
+        if (!img)
+            return NULL;
+    }
+
+    for (int p = 0; p < MP_MAX_PLANES; p++)
+        assert(!!img->bufs[p] == !p); // only 1 AVBufferRef
+
+    size_t size = img->bufs[0]->size;
+    struct mp_image *ref = mp_image_new_dummy_ref(img);
+    ref->bufs[0] = av_buffer_create(img->bufs[0]->data, size,
+                                    global_unref_image, img, 0);
+    if (!ref->bufs[0]) {
+        talloc_free(ref);
+        talloc_free(img);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&global_mutex);
+    global_pool.used_bytes += size;
+    pthread_mutex_unlock(&global_mutex);
+    return ref;
+}
+
+// Set the maximum number of bytes the global pool keeps in unused images on
+// behalf of owner (normally a player instance). The largest budget of all
+// owners is used. 0 removes the owner's budget; once no owner is left, the
+// global pool is disabled and all unused images are freed. Images that are
+// still referenced are not affected, and are freed or cached on release.
+void mp_image_pool_set_global_budget(void *owner, int64_t bytes)
+{
+    struct mp_image **dead = NULL;
+    int num_dead = 0;
+
+    pthread_mutex_lock(&global_mutex);
+    for (int n = global_pool.num_budgets - 1; n >= 0; n--) {
+        if (global_pool.budgets[n].owner == owner)
+            MP_TARRAY_REMOVE_AT(global_pool.budgets, global_pool.num_budgets, n);
+    }
+    if (bytes > 0) {
+        MP_TARRAY_APPEND(NULL, global_pool.budgets, global_pool.num_budgets,
+                         (struct global_budget){owner, bytes});
+    }
+    global_pool.budget = 0;
+    for (int n = 0; n < global_pool.num_budgets; n++) {
+        global_pool.budget = MPMAX(global_pool.budget,
+                                   global_pool.budgets[n].bytes);
+    }
+    if (!global_pool.num_budgets)
+        TA_FREEP(&global_pool.budgets);
+    global_pool_evict(&dead, &num_dead);
+    if (!global_pool.num_idle)
+        TA_FREEP(&global_pool.idle);
+    pthread_mutex_unlock(&global_mutex);
+
+    free_images(dead, num_dead);
+}
+
+// Report the state of the global pool to the given stats context.
+void mp_image_pool_report_global_stats(struct stats_ctx *ctx)
+{
+    pthread_mutex_lock(&global_mutex);
+    int64_t budget = global_pool.budget;
+    int64_t idle = global_pool.idle_bytes;
+    int64_t used = global_pool.used_bytes;
+    int num_idle = global_pool.num_idle;
+    uint64_t hits = global_pool.hits, misses = global_pool.misses,
+             evictions = global_pool.evictions;
+    pthread_mutex_unlock(&global_mutex);
+
+    if (!budget && !used)
+        return;
+
+    stats_size_value(ctx, "image-pool-budget", budget);
+    stats_size_value(ctx, "image-pool-idle", idle);
+    stats_size_value(ctx, "image-pool-used", used);
+    stats_value(ctx, "image-pool-idle-images", num_idle);
+    stats_value(ctx, "image-pool-hits", hits);
+    stats_value(ctx, "image-pool-misses", misses);
+    stats_value(ctx, "image-pool-evictions", evictions);
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
@@ -178,6 +367,9 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 // mp_image_alloc() is that there is a transparent mechanism to recycle image
 // data allocations through this pool.
 // If pool==NULL, mp_image_alloc() is called (for convenience).
+// If the pool uses neither a custom allocator nor LRU mode, and the global pool
+// is enabled (mp_image_pool_set_global_budget()), the image is taken from the
+// global pool instead, and is returned to it when it is released.
 // The image can be free'd with talloc_free().
 // Returns NULL on OOM.
 struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
@@ -185,6 +377,14 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
 {
     if (!pool)
         return mp_image_alloc(fmt, w, h);
+    if (!pool->allocator && !pool->use_lru) {
+        struct mp_image *new = global_pool_get(fmt, w, h);
+        if (new) {
+            // Don't keep stale per-pool images around in addition.
+            mp_image_pool_clear(pool);
+            return new;
+        }
+    }
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     if (!new) {
         if (fmt != pool->fmt || w != pool->w || h != pool->h)
@@ -2,6 +2,7 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -21,6 +22,10 @@ typedef struct mp_image *(*mp_image_allocator)(void *data, int fmt, int w, int h
 void mp_image_pool_set_allocator(struct mp_image_pool *pool,
                                  mp_image_allocator cb, void  *cb_data);
 
+struct stats_ctx;
+void mp_image_pool_set_global_budget(void *owner, int64_t bytes);
+void mp_image_pool_report_global_stats(struct stats_ctx *ctx);
+
 struct mp_image *mp_image_pool_new_copy(struct mp_image_pool *pool,
                                         struct mp_image *img);
 bool mp_image_pool_make_writeable(struct mp_image_pool *pool,
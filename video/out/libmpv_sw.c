@@ -0,0 +1,207 @@
+#include <limits.h>
+#include <string.h>
+
+#include "libmpv/render.h"
+#include "libmpv.h"
+#include "sub/osd.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+// Renders video and OSD into memory provided by the API user. Scaling and
+// conversion are done by mp_sws_context (libswscale or zimg, depending on the
+// options), and write directly to the target buffer. The OSD is blended on
+// top of it with draw_bmp.
+
+struct priv {
+    struct mp_sws_context *sws;
+    struct osd_state *osd;
+
+    struct mp_image_params src_params, dst_params;
+    struct mp_rect src_rc, dst_rc;
+    struct mp_osd_res osd_rc;
+    bool anything_changed;
+};
+
+static int init(struct render_backend *ctx, mpv_render_param *params)
+{
+    ctx->priv = talloc_zero(NULL, struct priv);
+    struct priv *p = ctx->priv;
+
+    char *api = get_mpv_render_param(params, MPV_RENDER_PARAM_API_TYPE, NULL);
+    if (!api)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    if (strcmp(api, MPV_RENDER_API_TYPE_SW) != 0)
+        return MPV_ERROR_NOT_IMPLEMENTED;
+
+    p->sws = mp_sws_alloc(p);
+    mp_sws_enable_cmdline_opts(p->sws, ctx->global);
+
+    p->anything_changed = true;
+
+    return 0;
+}
+
+static bool check_format(struct render_backend *ctx, int imgfmt)
+{
+    struct priv *p = ctx->priv;
+
+    // The output format is not known yet. Any supported input format can be
+    // converted to any supported output format, so use a common one.
+    return mp_sws_supports_formats(p->sws, IMGFMT_RGB0, imgfmt);
+}
+
+static int set_parameter(struct render_backend *ctx, mpv_render_param param)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
+
+static void reconfig(struct render_backend *ctx, struct mp_image_params *params)
+{
+    struct priv *p = ctx->priv;
+
+    p->src_params = *params;
+    p->anything_changed = true;
+}
+
+static void reset(struct render_backend *ctx)
+{
+    // stateless
+}
+
+static void update_external(struct render_backend *ctx, struct vo *vo)
+{
+    struct priv *p = ctx->priv;
+
+    p->osd = vo ? vo->osd : NULL;
+}
+
+static void resize(struct render_backend *ctx, struct mp_rect *src,
+                   struct mp_rect *dst, struct mp_osd_res *osd)
+{
+    struct priv *p = ctx->priv;
+
+    p->src_rc = *src;
+    p->dst_rc = *dst;
+    p->osd_rc = *osd;
+    p->anything_changed = true;
+}
+
+static int get_target_size(struct render_backend *ctx, mpv_render_param *params,
+                           int *out_w, int *out_h)
+{
+    int *sz = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_SIZE, NULL);
+    if (!sz)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    *out_w = sz[0];
+    *out_h = sz[1];
+    return 0;
+}
+
+// Clear everything in img outside of rc.
+static void clear_borders(struct mp_image *img, struct mp_rect rc)
+{
+    mp_image_clear(img, 0, 0, img->w, rc.y0);
+    mp_image_clear(img, 0, rc.y1, img->w, img->h);
+    mp_image_clear(img, 0, rc.y0, rc.x0, rc.y1);
+    mp_image_clear(img, rc.x1, rc.y0, img->w, rc.y1);
+}
+
+static int render(struct render_backend *ctx, mpv_render_param *params,
+                  struct vo_frame *frame)
+{
+    struct priv *p = ctx->priv;
+
+    int *sz = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_SIZE, NULL);
+    char *fmt = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_FORMAT, NULL);
+    size_t *stride = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_STRIDE, NULL);
+    void *ptr = get_mpv_render_param(params, MPV_RENDER_PARAM_SW_POINTER, NULL);
+
+    if (!sz || !fmt || !stride || !ptr || sz[0] < 1 || sz[1] < 1)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    int imgfmt = mp_imgfmt_from_name(bstr0(fmt));
+    if (imgfmt != p->dst_params.imgfmt || sz[0] != p->dst_params.w ||
+        sz[1] != p->dst_params.h)
+        p->anything_changed = true;
+
+    if (p->anything_changed) {
+        // Only packed RGB formats with whole bytes per pixel are allowed,
+        // which keeps the stride checks below simple.
+        struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+        if (!(desc.flags & MP_IMGFLAG_RGB) ||
+            !(desc.flags & MP_IMGFLAG_BYTE_ALIGNED) ||
+            (desc.flags & (MP_IMGFLAG_PAL | MP_IMGFLAG_HWACCEL)) ||
+            desc.num_planes != 1 ||
+            !mp_sws_supports_formats(p->sws, imgfmt, IMGFMT_420P))
+            return MPV_ERROR_UNSUPPORTED;
+
+        p->dst_params = (struct mp_image_params){
+            .imgfmt = imgfmt,
+            .w = sz[0],
+            .h = sz[1],
+        };
+        mp_image_params_guess_csp(&p->dst_params);
+
+        p->anything_changed = false;
+    }
+
+    struct mp_image wrap_img = {0};
+    mp_image_set_params(&wrap_img, &p->dst_params);
+
+    size_t bpp = wrap_img.fmt.bytes[0];
+    if (!bpp || bpp * wrap_img.w > *stride || *stride % bpp ||
+        *stride > INT_MAX)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    wrap_img.planes[0] = ptr;
+    wrap_img.stride[0] = *stride;
+
+    struct mp_image *img = frame->current;
+    if (img && p->src_params.imgfmt && mp_rect_w(p->dst_rc) > 0 &&
+        mp_rect_h(p->dst_rc) > 0)
+    {
+        clear_borders(&wrap_img, p->dst_rc);
+
+        struct mp_image src = *img;
+        struct mp_rect src_rc = p->src_rc;
+        src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, src.fmt.align_x);
+        src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src.fmt.align_y);
+        mp_image_crop_rc(&src, src_rc);
+
+        struct mp_image dst = wrap_img;
+        mp_image_crop_rc(&dst, p->dst_rc);
+
+        if (mp_sws_scale(p->sws, &dst, &src) < 0) {
+            mp_image_clear(&wrap_img, 0, 0, wrap_img.w, wrap_img.h);
+            return MPV_ERROR_GENERIC;
+        }
+    } else {
+        mp_image_clear(&wrap_img, 0, 0, wrap_img.w, wrap_img.h);
+    }
+
+    if (p->osd)
+        osd_draw_on_image(p->osd, p->osd_rc, img ? img->pts : 0, 0, &wrap_img);
+
+    return 0;
+}
+
+static void destroy(struct render_backend *ctx)
+{
+    // nop
+}
+
+const struct render_backend_fns render_backend_sw = {
+    .init = init,
+    .check_format = check_format,
+    .set_parameter = set_parameter,
+    .reconfig = reconfig,
+    .reset = reset,
+    .update_external = update_external,
+    .resize = resize,
+    .get_target_size = get_target_size,
+    .render = render,
+    .destroy = destroy,
+};
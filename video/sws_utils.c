@@ -16,10 +16,12 @@
  */
 
 #include <assert.h>
+#include <math.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
 
 #include "config.h"
@@ -34,6 +36,8 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "osdep/endian.h"
 
 #if HAVE_ZIMG
@@ -52,6 +56,7 @@ struct sws_opts {
     int fast;
     int bitexact;
     int zimg;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -78,12 +83,14 @@ const struct m_sub_options sws_conf = {
         {"fast", OPT_FLAG(fast)},
         {"bitexact", OPT_FLAG(bitexact)},
         {"allow-zimg", OPT_FLAG(zimg)},
+        {"threads", OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_LANCZOS,
         .zimg = 1,
+        .threads = 0,
     },
 };
 
@@ -114,6 +121,7 @@ static void mp_sws_update_from_cmdline(struct mp_sws_context *ctx)
         ctx->flags |= SWS_BITEXACT;
 
     ctx->allow_zimg = opts->zimg;
+    ctx->threads = opts->threads;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -168,12 +176,44 @@ static bool cache_valid(struct mp_sws_context *ctx)
            ctx->flags == old->flags &&
            ctx->allow_zimg == old->allow_zimg &&
            ctx->force_scaler == old->force_scaler &&
+           ctx->threads == old->threads &&
            (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache));
 }
 
+// One horizontal stripe of the destination image, scaled by its own context.
+// To get the same result as scaling the whole image, the stripe is extended
+// by some margin on both sides (so the scaler sees the same source lines
+// around the stripe borders), scaled into tmp, and then the inner part is
+// copied to the destination.
+struct mp_sws_slice {
+    struct SwsContext *sws;
+    int src_y, src_h;       // source lines the context scales
+    int out_y;              // destination line corresponding to tmp line 0
+    int dst_y, dst_h;       // destination lines this slice writes
+    struct mp_image *tmp;   // sws output, including the margins
+
+    // Set for the duration of mp_sws_scale().
+    struct mp_image *cur_src, *cur_dst;
+    struct mp_waiter thread_waiter;
+};
+
+static void free_slice(void *p)
+{
+    struct mp_sws_slice *s = p;
+    sws_freeContext(s->sws);
+}
+
+static void destroy_slices(struct mp_sws_context *ctx)
+{
+    for (int n = 0; n < ctx->num_slices; n++)
+        talloc_free(ctx->slices[n]);
+    ctx->num_slices = 0;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    destroy_slices(ctx);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -189,6 +229,7 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
         .flags = SWS_BILINEAR,
         .force_reload = true,
         .params = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT},
+        .threads = 1,
         .cached = talloc_zero(ctx, struct mp_sws_context),
     };
     talloc_set_destructor(ctx, free_mp_sws);
@@ -218,6 +259,219 @@ void mp_sws_enable_cmdline_opts(struct mp_sws_context *ctx, struct mpv_global *g
 #endif
 }
 
+// Create a context for the current parameters, but with the given source and
+// destination heights. Return NULL on failure.
+static struct SwsContext *create_sws(struct mp_sws_context *ctx,
+                                     int src_h, int dst_h)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
+
+    int s_csp = mp_csp_to_sws_colorspace(src->color.space);
+    int s_range = src->color.levels == MP_CSP_LEVELS_PC;
+
+    int d_csp = mp_csp_to_sws_colorspace(dst->color.space);
+    int d_range = dst->color.levels == MP_CSP_LEVELS_PC;
+
+    av_opt_set_int(sws, "sws_flags", ctx->flags, 0);
+
+    av_opt_set_int(sws, "srcw", src->w, 0);
+    av_opt_set_int(sws, "srch", src_h, 0);
+    av_opt_set_int(sws, "src_format", imgfmt2pixfmt(src->imgfmt), 0);
+
+    av_opt_set_int(sws, "dstw", dst->w, 0);
+    av_opt_set_int(sws, "dsth", dst_h, 0);
+    av_opt_set_int(sws, "dst_format", imgfmt2pixfmt(dst->imgfmt), 0);
+
+    av_opt_set_double(sws, "param0", ctx->params[0], 0);
+    av_opt_set_double(sws, "param1", ctx->params[1], 0);
+
+    int cr_src = mp_chroma_location_to_av(src->chroma_location);
+    int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
+    int cr_xpos, cr_ypos;
+    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
+    }
+    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
+    }
+
+    // This can fail even with normal operation, e.g. if a conversion path
+    // simply does not support these settings.
+    int r =
+        sws_setColorspaceDetails(sws, sws_getCoefficients(s_csp), s_range,
+                                 sws_getCoefficients(d_csp), d_range,
+                                 0, 1 << 16, 1 << 16);
+    ctx->supports_csp = r >= 0;
+
+    if (sws_init_context(sws, ctx->src_filter, ctx->dst_filter) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+
+    return sws;
+}
+
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Images smaller than this (in pixels, source or destination) are never
+// scaled with multiple threads.
+#define SLICE_MIN_PIXELS (1280 * 720)
+// Minimum number of destination lines per slice.
+#define SLICE_MIN_LINES 64
+
+static int filter_length(struct SwsVector *v)
+{
+    return v ? v->length : 1;
+}
+
+// Return how many source lines (of a plane with the given source and
+// destination heights) the vertical filter for one output line can span. This
+// follows the filter size computation in libswscale's initFilter(), including
+// the user filters, and is used as margin on each side of a slice, which also
+// covers chroma siting offsets.
+static int filter_lines(struct mp_sws_context *ctx, int src_h, int dst_h,
+                        bool chroma)
+{
+    int flags = ctx->flags;
+    int size;
+    if (flags & SWS_POINT) {
+        size = 1;
+    } else if (flags & SWS_FAST_BILINEAR) {
+        size = 2;
+    } else if (flags & SWS_BICUBIC) {
+        size = 4;
+    } else if (flags & (SWS_X | SWS_GAUSS)) {
+        size = 8;
+    } else if (flags & SWS_AREA) {
+        size = 2; // bilinear when upscaling
+    } else if (flags & SWS_LANCZOS) {
+        double p = ctx->params[0];
+        size = p != SWS_PARAM_DEFAULT ? ceil(2 * p) : 6;
+    } else if (flags & (SWS_SINC | SWS_SPLINE)) {
+        size = 20;
+    } else {
+        size = 2;
+    }
+
+    // Downscaling widens the filter by the scale factor.
+    int lines = 1 + size;
+    if (src_h > dst_h)
+        lines = 1 + (size * (int64_t)src_h + dst_h - 1) / dst_h;
+
+    // Source filters are applied on source lines, destination filters on
+    // output lines, which are at most this many source lines apart.
+    int ratio = (src_h + dst_h - 1) / dst_h;
+    if (ctx->src_filter) {
+        lines += filter_length(chroma ? ctx->src_filter->chrV
+                                      : ctx->src_filter->lumV) - 1;
+    }
+    if (ctx->dst_filter) {
+        lines += (filter_length(chroma ? ctx->dst_filter->chrV
+                                       : ctx->dst_filter->lumV) - 1) * ratio;
+    }
+
+    return lines + 1;
+}
+
+// Set up slice threading, if enabled and possible for the current parameters.
+// Returns false if the caller should use a single context instead.
+static bool init_slices(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    int threads = ctx->threads;
+    if (threads < 1)
+        threads = av_cpu_count();
+    threads = MPCLAMP(threads, 1, 64);
+
+    if (threads < 2 || (ctx->flags & SWS_BITEXACT) ||
+        MPMAX(src->w * src->h, dst->w * dst->h) < SLICE_MIN_PIXELS)
+        return false;
+
+    struct mp_imgfmt_desc s_desc = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc d_desc = mp_imgfmt_get_desc(dst->imgfmt);
+    if ((s_desc.flags | d_desc.flags) & MP_IMGFLAG_PAL)
+        return false;
+
+    // Slice borders must map to whole source lines, so that every slice
+    // context uses the same nominal scale factor as a context for the whole
+    // image would. The filter phases can still differ slightly, because
+    // libswscale truncates its fixed point increment, so the result is not
+    // necessarily bit-identical. Slices also must be aligned to chroma
+    // subsampling on both sides, and to the size of the ordered dither matrix
+    // libswscale uses on the destination side.
+    int g = gcd(src->h, dst->h);
+    int src_unit = src->h / g;
+    int dst_unit = dst->h / g;
+    int src_align = MPMAX(s_desc.align_y, 1);
+    int dst_align = MPMAX(d_desc.align_y, 8);
+    while ((src_unit % src_align) || (dst_unit % dst_align)) {
+        src_unit *= 2;
+        dst_unit *= 2;
+    }
+
+    int slices = MPMIN(threads, dst->h / MPMAX(dst_unit, SLICE_MIN_LINES));
+    if (slices < 2)
+        return false;
+    int slice_h = (dst->h + slices - 1) / slices;
+    slice_h = (slice_h + dst_unit - 1) / dst_unit * dst_unit; // not a power of 2
+
+    // Source lines around each slice the vertical filters may access, on
+    // either side, in units of src_unit.
+    int src_chr_h = mp_chroma_div_up(src->h, s_desc.chroma_ys);
+    int dst_chr_h = mp_chroma_div_up(dst->h, d_desc.chroma_ys);
+    int lines = MPMAX(filter_lines(ctx, src->h, dst->h, false),
+                      filter_lines(ctx, src_chr_h, dst_chr_h, true)
+                        << s_desc.chroma_ys);
+    int margin = (lines + src_unit - 1) / src_unit;
+    if (margin * dst_unit > slice_h)
+        return false; // too much redundant work
+
+    for (int y = 0; y < dst->h; y += slice_h) {
+        struct mp_sws_slice *s = talloc_zero(ctx, struct mp_sws_slice);
+        talloc_set_destructor(s, free_slice);
+        MP_TARRAY_APPEND(ctx, ctx->slices, ctx->num_slices, s);
+
+        s->dst_y = y;
+        s->dst_h = MPMIN(slice_h, dst->h - y);
+        s->out_y = MPMAX(y - margin * dst_unit, 0);
+        int out_end = MPMIN(y + s->dst_h + margin * dst_unit, dst->h);
+        int src_end = out_end / dst_unit * src_unit;
+        if (out_end == dst->h)
+            src_end = src->h; // last slice may be unaligned
+        s->src_y = s->out_y / dst_unit * src_unit;
+        s->src_h = src_end - s->src_y;
+
+        s->sws = create_sws(ctx, s->src_h, out_end - s->out_y);
+        s->tmp = mp_image_alloc(dst->imgfmt, dst->w, out_end - s->out_y);
+        if (!s->sws || !s->tmp) {
+            destroy_slices(ctx);
+            return false;
+        }
+        talloc_steal(s, s->tmp);
+    }
+
+    MP_VERBOSE(ctx, "Using %d slices with %d lines.\n", ctx->num_slices,
+               slice_h);
+    return true;
+}
+
 // Reinitialize (if needed) - return error code.
 // Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
 int mp_sws_reinit(struct mp_sws_context *ctx)
@@ -237,6 +491,7 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
 
     sws_freeContext(ctx->sws);
     ctx->sws = NULL;
+    destroy_slices(ctx);
     ctx->zimg_ok = false;
 
 #if HAVE_ZIMG
@@ -258,10 +513,6 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
     }
 
-    ctx->sws = sws_alloc_context();
-    if (!ctx->sws)
-        return -1;
-
     mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
     mp_image_params_guess_csp(dst);
 
@@ -279,52 +530,77 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
     }
 
-    int s_csp = mp_csp_to_sws_colorspace(src->color.space);
-    int s_range = src->color.levels == MP_CSP_LEVELS_PC;
+    if (!init_slices(ctx)) {
+        ctx->sws = create_sws(ctx, src->h, dst->h);
+        if (!ctx->sws)
+            return -1;
+    }
 
-    int d_csp = mp_csp_to_sws_colorspace(dst->color.space);
-    int d_range = dst->color.levels == MP_CSP_LEVELS_PC;
+success:
+    ctx->force_reload = false;
+    *ctx->cached = *ctx;
+    return 1;
+}
+
+static void scale_slice(struct mp_sws_slice *s)
+{
+    struct mp_image src = *s->cur_src;
+    mp_image_crop(&src, 0, s->src_y, src.w, s->src_y + s->src_h);
 
-    av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
+    sws_scale(s->sws, (const uint8_t *const *) src.planes, src.stride,
+              0, src.h, s->tmp->planes, s->tmp->stride);
 
-    av_opt_set_int(ctx->sws, "srcw", src->w, 0);
-    av_opt_set_int(ctx->sws, "srch", src->h, 0);
-    av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
+    struct mp_image tmp = *s->tmp;
+    int y0 = s->dst_y - s->out_y;
+    mp_image_crop(&tmp, 0, y0, tmp.w, y0 + s->dst_h);
 
-    av_opt_set_int(ctx->sws, "dstw", dst->w, 0);
-    av_opt_set_int(ctx->sws, "dsth", dst->h, 0);
-    av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
+    struct mp_image dst = *s->cur_dst;
+    mp_image_crop(&dst, 0, s->dst_y, dst.w, s->dst_y + s->dst_h);
 
-    av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
-    av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
+    // Not mp_image_copy(), which may wait for work on the shared pool. This
+    // can run on the pool itself.
+    for (int p = 0; p < dst.num_planes; p++) {
+        memcpy_pic(dst.planes[p], tmp.planes[p],
+                   (mp_image_plane_w(&dst, p) * dst.fmt.bpp[p] + 7) / 8,
+                   mp_image_plane_h(&dst, p), dst.stride[p], tmp.stride[p]);
+    }
+}
 
-    int cr_src = mp_chroma_location_to_av(src->chroma_location);
-    int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
-    int cr_xpos, cr_ypos;
-    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
+static void scale_slice_thread(void *ptr)
+{
+    struct mp_sws_slice *s = ptr;
+
+    scale_slice(s);
+    mp_waiter_wakeup(&s->thread_waiter, 0);
+}
+
+static void scale_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    for (int n = 0; n < ctx->num_slices; n++) {
+        struct mp_sws_slice *s = ctx->slices[n];
+        s->cur_src = src;
+        s->cur_dst = dst;
     }
-    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
+
+    // Run the first slice on the calling thread, the rest on the shared pool.
+    struct mp_thread_pool *pool = mp_image_slice_pool();
+    for (int n = 1; n < ctx->num_slices; n++) {
+        struct mp_sws_slice *s = ctx->slices[n];
+        s->thread_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+        if (!mp_thread_pool_queue(pool, scale_slice_thread, s))
+            scale_slice_thread(s);
     }
 
-    // This can fail even with normal operation, e.g. if a conversion path
-    // simply does not support these settings.
-    int r =
-        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
-                                 sws_getCoefficients(d_csp), d_range,
-                                 0, 1 << 16, 1 << 16);
-    ctx->supports_csp = r >= 0;
+    scale_slice(ctx->slices[0]);
 
-    if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
-        return -1;
+    for (int n = 1; n < ctx->num_slices; n++)
+        mp_waiter_wait(&ctx->slices[n]->thread_waiter);
 
-success:
-    ctx->force_reload = false;
-    *ctx->cached = *ctx;
-    return 1;
+    for (int n = 0; n < ctx->num_slices; n++) {
+        struct mp_sws_slice *s = ctx->slices[n];
+        s->cur_src = s->cur_dst = NULL;
+    }
 }
 
 // Scale from src to dst - if src/dst have different parameters from previous
@@ -347,6 +623,11 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return mp_zimg_convert(ctx->zimg, dst, src) ? 0 : -1;
 #endif
 
+    if (ctx->num_slices) {
+        scale_slices(ctx, dst, src);
+        return 0;
+    }
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
@@ -37,6 +37,8 @@ struct mp_sws_context {
     int flags;
     bool allow_zimg; // use zimg if available (ignores filters and all)
     bool force_reload;
+    // Number of threads for large images (0 means auto, 1 disables threading).
+    int threads;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -59,6 +61,8 @@ struct mp_sws_context {
     struct mp_sws_context *cached; // contains parameters for which sws is valid
     struct mp_zimg_context *zimg;
     bool zimg_ok;
+    struct mp_sws_slice **slices;
+    int num_slices;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
@@ -18,16 +18,20 @@
 #include <math.h>
 
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/pixfmt.h>
 
 #include "common/common.h"
 #include "common/msg.h"
 #include "csputils.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
 #include "zimg.h"
+#include "zimg_simd.h"
 
 static_assert(MP_IMAGE_BYTE_ALIGN >= ZIMG_ALIGN, "");
 
@@ -60,6 +64,7 @@ const struct m_sub_options zimg_conf = {
             {"random",          ZIMG_DITHER_RANDOM},
             {"error-diffusion", ZIMG_DITHER_ERROR_DIFFUSION})},
         {"fast", OPT_FLAG(fast)},
+        {"threads", OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct zimg_opts),
@@ -70,6 +75,7 @@ const struct m_sub_options zimg_conf = {
         .scaler_chroma = ZIMG_RESIZE_BILINEAR,
         .dither = ZIMG_DITHER_RANDOM,
         .fast = 1,
+        .threads = 1,
     },
 };
 
@@ -90,12 +96,15 @@ struct mp_zimg_repack {
     // Endian-swap (done before/after actual repacker).
     int endian_size;            // 0=no swapping, 2/4=word byte size to swap
     int endian_items[4];        // number of words per pixel/plane
+    mp_zimg_bswap_fn bswap;     // optimized swapping (optional)
 
     // For packed_repack.
     int components[4];          // p2[n] = mp_image.planes[components[n]]
     //  pack:   p1 is dst, p2 is src
     //  unpack: p1 is src, p2 is dst
     void (*packed_repack_scanline)(void *p1, void *p2[], int x0, int x1);
+    // Set if packed_repack_scanline is from regular_repackers[].
+    const struct regular_repacker *regular;
 
     // Fringe RGB/YUV.
     uint8_t comp_size;
@@ -128,6 +137,22 @@ struct mp_zimg_repack {
     int real_w, real_h;         // aligned size
 };
 
+// The destination image is split into horizontal slices, each converted with
+// its own zimg graph (possibly on a worker thread).
+struct mp_zimg_state {
+    zimg_filter_graph *graph;
+    void *tmp;
+    void *tmp_alloc;
+    struct mp_zimg_repack *src;
+    struct mp_zimg_repack *dst;
+    int slice_y, slice_h;       // destination lines converted by this slice
+    double scale_y;             // source lines per destination line
+
+    // Per-call state for mp_zimg_convert().
+    struct mp_image *cur_src, *cur_dst;
+    struct mp_waiter thread_waiter;
+};
+
 static void mp_zimg_update_from_cmdline(struct mp_zimg_context *ctx)
 {
     m_config_cache_update(ctx->opts_cache);
@@ -202,14 +227,18 @@ static zimg_color_primaries_e mp_to_z_prim(enum mp_csp_prim prim)
     }
 }
 
+static void free_mp_zimg_state(void *p)
+{
+    struct mp_zimg_state *st = p;
+
+    zimg_filter_graph_free(st->graph);
+}
+
 static void destroy_zimg(struct mp_zimg_context *ctx)
 {
-    talloc_free(ctx->zimg_tmp_alloc);
-    ctx->zimg_tmp = ctx->zimg_tmp_alloc = NULL;
-    zimg_filter_graph_free(ctx->zimg_graph);
-    ctx->zimg_graph = NULL;
-    TA_FREEP(&ctx->zimg_src);
-    TA_FREEP(&ctx->zimg_dst);
+    for (int n = 0; n < ctx->num_states; n++)
+        talloc_free(ctx->states[n]);
+    ctx->num_states = 0;
 }
 
 static void free_mp_zimg(void *p)
@@ -294,6 +323,10 @@ static void swap_endian(struct mp_zimg_repack *r, struct mp_image *dst, int dst_
             void *d = dst->planes[p] +
                       dst->stride[p] * (ptrdiff_t)((y + dst_y) >> ys) +
                       bpp * (x0 >> xs);
+            if (r->bswap) {
+                r->bswap(d, s, num_words);
+                continue;
+            }
             switch (r->endian_size) {
             case 2:
                 for (int w = 0; w < num_words; w++)
@@ -822,7 +855,7 @@ static int find_gray_format(int depth, int num_planes)
 }
 
 static void setup_fringe_rgb_packer(struct mp_zimg_repack *r,
-                                    struct mp_zimg_context *ctx)
+                                    struct mp_zimg_state *st)
 {
     enum AVPixelFormat avfmt = imgfmt2pixfmt(r->zimgfmt);
 
@@ -848,8 +881,8 @@ static void setup_fringe_rgb_packer(struct mp_zimg_repack *r,
     r->zimgfmt = find_gbrp_format(depth, 3);
     if (!r->zimgfmt)
         return;
-    if (ctx)
-        r->comp_lut = talloc_array(ctx, uint8_t, 256 * 3);
+    if (st)
+        r->comp_lut = talloc_array(r, uint8_t, 256 * 3);
     r->repack = fringe_rgb_repack;
     static const int c_order_rgb[] = {3, 1, 2};
     static const int c_order_bgr[] = {2, 1, 3};
@@ -974,6 +1007,7 @@ static void setup_nv_packer(struct mp_zimg_repack *r)
         r->repack = repack_nv;
         r->pass_through_y = true;
         r->packed_repack_scanline = repack_cb;
+        r->regular = pa;
         r->zimgfmt = planar_fmt;
         r->components[0] = desc.planes[1].components[0] - 1;
         r->components[1] = desc.planes[1].components[1] - 1;
@@ -1067,6 +1101,7 @@ static void setup_regular_rgb_packer(struct mp_zimg_repack *r)
 
         r->repack = packed_repack;
         r->packed_repack_scanline = repack_cb;
+        r->regular = pa;
         r->zimgfmt = planar_fmt;
         for (int n = 0; n < num_real_components; n++) {
             // Determine permutation that maps component order between the two
@@ -1079,9 +1114,10 @@ static void setup_regular_rgb_packer(struct mp_zimg_repack *r)
 }
 
 // (If native_fmt!=r->fmt.imgfmt, this is the swap-endian case; native_fmt is NE.)
-// (ctx can be NULL for the sake of probing.)
+// (ctx and st can be NULL for the sake of probing.)
 static bool setup_format_ne(zimg_image_format *zfmt, struct mp_zimg_repack *r,
-                            int native_fmt, struct mp_zimg_context *ctx)
+                            int native_fmt, struct mp_zimg_context *ctx,
+                            struct mp_zimg_state *st)
 {
     zimg_image_format_default(zfmt, ZIMG_API_VERSION);
 
@@ -1097,7 +1133,7 @@ static bool setup_format_ne(zimg_image_format *zfmt, struct mp_zimg_repack *r,
     if (!r->repack)
         setup_regular_rgb_packer(r);
     if (!r->repack)
-        setup_fringe_rgb_packer(r, ctx);
+        setup_fringe_rgb_packer(r, st);
     if (!r->repack)
         setup_fringe_yuv422_packer(r);
 
@@ -1154,11 +1190,13 @@ static bool setup_format_ne(zimg_image_format *zfmt, struct mp_zimg_repack *r,
     // rectangle. Reconstruct the image allocation size and set the cropping.
     zfmt->width = r->real_w = MP_ALIGN_UP(fmt.w, 1 << desc.chroma_xs);
     zfmt->height = r->real_h = MP_ALIGN_UP(fmt.h, 1 << desc.chroma_ys);
-    if (!r->pack && ctx) {
-        // Relies on ctx->zimg_dst being initialized first.
-        struct mp_zimg_repack *dst = ctx->zimg_dst;
+    if (!r->pack && st) {
+        // Relies on st->dst being initialized first. The source covers the
+        // full image; only the part mapping to the destination slice is used.
+        struct mp_zimg_repack *dst = st->dst;
         zfmt->active_region.width = dst->real_w * (double)fmt.w / dst->fmt.w;
-        zfmt->active_region.height = dst->real_h * (double)fmt.h / dst->fmt.h;
+        zfmt->active_region.height = dst->real_h * st->scale_y;
+        zfmt->active_region.top = st->slice_y * st->scale_y;
     }
 
     zfmt->subsample_w = desc.chroma_xs;
@@ -1214,37 +1252,53 @@ static bool setup_format_ne(zimg_image_format *zfmt, struct mp_zimg_repack *r,
         zfmt->matrix_coefficients == ZIMG_MATRIX_RGB)
         zfmt->matrix_coefficients = ZIMG_MATRIX_BT470_BG;
 
+    // Use optimized code for the most common cases, if available.
+    if (ctx && !ctx->no_simd) {
+        const struct regular_repacker *pa = r->regular;
+        if (pa) {
+            mp_zimg_scanline_fn fn =
+                mp_zimg_simd_scanline(r->pack, pa->packed_width,
+                                      pa->component_width, pa->prepadding,
+                                      pa->num_components);
+            if (fn)
+                r->packed_repack_scanline = fn;
+        }
+        if (r->endian_size)
+            r->bswap = mp_zimg_simd_bswap(r->endian_size);
+    }
+
     return true;
 }
 
 static bool setup_format(zimg_image_format *zfmt, struct mp_zimg_repack *r,
                          bool pack, struct mp_image_params *fmt,
-                         struct mp_zimg_context *ctx)
+                         struct mp_zimg_context *ctx,
+                         struct mp_zimg_state *st)
 {
     struct mp_zimg_repack repack_init = {
         .pack = pack,
         .fmt = *fmt,
     };
     *r = repack_init;
-    if (setup_format_ne(zfmt, r, fmt->imgfmt, ctx))
+    if (setup_format_ne(zfmt, r, fmt->imgfmt, ctx, st))
         return true;
     // Try reverse endian.
     int nimgfmt = mp_find_other_endian(fmt->imgfmt);
     if (!nimgfmt)
         return false;
     *r = repack_init;
-    return setup_format_ne(zfmt, r, nimgfmt, ctx);
+    return setup_format_ne(zfmt, r, nimgfmt, ctx, st);
 }
 
-static bool allocate_buffer(struct mp_zimg_context *ctx,
+static bool allocate_buffer(struct mp_zimg_state *st,
                             struct mp_zimg_repack *r)
 {
     unsigned lines = 0;
     int err;
     if (r->pack) {
-        err = zimg_filter_graph_get_output_buffering(ctx->zimg_graph, &lines);
+        err = zimg_filter_graph_get_output_buffering(st->graph, &lines);
     } else {
-        err = zimg_filter_graph_get_input_buffering(ctx->zimg_graph, &lines);
+        err = zimg_filter_graph_get_input_buffering(st->graph, &lines);
     }
 
     if (err)
@@ -1284,24 +1338,27 @@ static bool allocate_buffer(struct mp_zimg_context *ctx,
     return true;
 }
 
-bool mp_zimg_config(struct mp_zimg_context *ctx)
+static bool mp_zimg_state_init(struct mp_zimg_context *ctx,
+                               struct mp_zimg_state *st,
+                               int slice_y, int slice_h)
 {
     struct zimg_opts *opts = &ctx->opts;
 
-    destroy_zimg(ctx);
+    st->src = talloc_zero(st, struct mp_zimg_repack);
+    st->dst = talloc_zero(st, struct mp_zimg_repack);
+    st->slice_y = slice_y;
+    st->slice_h = slice_h;
+    st->scale_y = ctx->src.h / (double)ctx->dst.h;
 
-    if (ctx->opts_cache)
-        mp_zimg_update_from_cmdline(ctx);
-
-    ctx->zimg_src = talloc_zero(NULL, struct mp_zimg_repack);
-    ctx->zimg_dst = talloc_zero(NULL, struct mp_zimg_repack);
+    struct mp_image_params dst_params = ctx->dst;
+    dst_params.h = slice_h;
 
     zimg_image_format src_fmt, dst_fmt;
 
-    // Note: do zimg_dst first, because zimg_src uses fields from zimg_dst.
-    if (!setup_format(&dst_fmt, ctx->zimg_dst, true, &ctx->dst, ctx) ||
-        !setup_format(&src_fmt, ctx->zimg_src, false, &ctx->src, ctx))
-        goto fail;
+    // Note: do st->dst first, because st->src uses fields from st->dst.
+    if (!setup_format(&dst_fmt, st->dst, true, &dst_params, ctx, st) ||
+        !setup_format(&src_fmt, st->src, false, &ctx->src, ctx, st))
+        return false;
 
     zimg_graph_builder_params params;
     zimg_graph_builder_params_default(&params, ZIMG_API_VERSION);
@@ -1324,32 +1381,78 @@ bool mp_zimg_config(struct mp_zimg_context *ctx)
     if (ctx->src.color.sig_peak > 0)
         params.nominal_peak_luminance = ctx->src.color.sig_peak;
 
-    ctx->zimg_graph = zimg_filter_graph_build(&src_fmt, &dst_fmt, &params);
-    if (!ctx->zimg_graph) {
+    st->graph = zimg_filter_graph_build(&src_fmt, &dst_fmt, &params);
+    if (!st->graph) {
         char err[128] = {0};
         zimg_get_last_error(err, sizeof(err) - 1);
         MP_ERR(ctx, "zimg_filter_graph_build: %s \n", err);
-        goto fail;
+        return false;
     }
 
     size_t tmp_size;
-    if (!zimg_filter_graph_get_tmp_size(ctx->zimg_graph, &tmp_size)) {
+    if (!zimg_filter_graph_get_tmp_size(st->graph, &tmp_size)) {
         tmp_size = MP_ALIGN_UP(tmp_size, ZIMG_ALIGN) + ZIMG_ALIGN;
-        ctx->zimg_tmp_alloc = ta_alloc_size(NULL, tmp_size);
-        if (ctx->zimg_tmp_alloc) {
-            ctx->zimg_tmp =
-                (void *)MP_ALIGN_UP((uintptr_t)ctx->zimg_tmp_alloc, ZIMG_ALIGN);
-        }
+        st->tmp_alloc = ta_alloc_size(st, tmp_size);
+        if (st->tmp_alloc)
+            st->tmp = (void *)MP_ALIGN_UP((uintptr_t)st->tmp_alloc, ZIMG_ALIGN);
     }
 
-    if (!ctx->zimg_tmp_alloc)
-        goto fail;
+    if (!st->tmp_alloc)
+        return false;
 
-    if (!allocate_buffer(ctx, ctx->zimg_src) ||
-        !allocate_buffer(ctx, ctx->zimg_dst))
-        goto fail;
+    if (!allocate_buffer(st, st->src) || !allocate_buffer(st, st->dst))
+        return false;
 
     return true;
+}
+
+bool mp_zimg_config(struct mp_zimg_context *ctx)
+{
+    destroy_zimg(ctx);
+
+    if (ctx->opts_cache)
+        mp_zimg_update_from_cmdline(ctx);
+
+    int threads = ctx->opts.threads;
+    if (threads < 1)
+        threads = av_cpu_count();
+    threads = MPCLAMP(threads, 1, 64);
+
+    if (threads != ctx->current_thread_count) {
+        // Just destroy and recreate all - dumb and costly, but rarely happens.
+        TA_FREEP(&ctx->tp);
+        ctx->current_thread_count = 0;
+        if (threads > 1) {
+            // The calling thread converts one of the slices.
+            ctx->tp = mp_thread_pool_create(ctx, threads - 1, threads - 1,
+                                            threads - 1);
+            if (!ctx->tp)
+                goto fail;
+        }
+        ctx->current_thread_count = threads;
+    }
+
+    // Don't make slices smaller than a few lines; the overhead (overlapping
+    // filter taps, thread wakeups) would eat the gain. Slice boundaries must
+    // be aligned to the destination's chroma subsampling.
+    int align = mp_imgfmt_get_desc(ctx->dst.imgfmt).align_y;
+    align = MPMAX(align, 1);
+    int slices = MPMAX(MPMIN(threads, ctx->dst.h / 32), 1);
+    int slice_h = MP_ALIGN_UP((ctx->dst.h + slices - 1) / slices, align);
+
+    for (int y = 0; y < ctx->dst.h; y += slice_h) {
+        struct mp_zimg_state *st = talloc_zero(NULL, struct mp_zimg_state);
+        talloc_set_destructor(st, free_mp_zimg_state);
+        MP_TARRAY_APPEND(ctx, ctx->states, ctx->num_states, st);
+
+        if (!mp_zimg_state_init(ctx, st, y, MPMIN(slice_h, ctx->dst.h - y)))
+            goto fail;
+    }
+
+    ctx->cfg_src = ctx->src;
+    ctx->cfg_dst = ctx->dst;
+
+    return ctx->num_states > 0;
 
 fail:
     destroy_zimg(ctx);
@@ -1358,14 +1461,53 @@ fail:
 
 bool mp_zimg_config_image_params(struct mp_zimg_context *ctx)
 {
-    if (ctx->zimg_src && mp_image_params_equal(&ctx->src, &ctx->zimg_src->fmt) &&
-        ctx->zimg_dst && mp_image_params_equal(&ctx->dst, &ctx->zimg_dst->fmt) &&
-        (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache)) &&
-        ctx->zimg_graph)
+    if (ctx->num_states && mp_image_params_equal(&ctx->src, &ctx->cfg_src) &&
+        mp_image_params_equal(&ctx->dst, &ctx->cfg_dst) &&
+        (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache)))
         return true;
     return mp_zimg_config(ctx);
 }
 
+static void do_convert(struct mp_zimg_state *st)
+{
+    assert(st->graph);
+
+    // An annoyance.
+    zimg_image_buffer zsrc, zdst;
+    zimg_image_buffer_const zsrc_c = {ZIMG_API_VERSION};
+
+    // The destination repacker only sees its own slice of the image.
+    struct mp_image dst = *st->cur_dst;
+    mp_image_crop(&dst, 0, st->slice_y, dst.w, st->slice_y + st->slice_h);
+
+    wrap_buffer(st->src, &zsrc, st->cur_src);
+    wrap_buffer(st->dst, &zdst, &dst);
+
+    for (int n = 0; n < MP_ARRAY_SIZE(zsrc_c.plane); n++) {
+        zsrc_c.plane[n].data = zsrc.plane[n].data;
+        zsrc_c.plane[n].stride = zsrc.plane[n].stride;
+        zsrc_c.plane[n].mask = zsrc.plane[n].mask;
+    }
+
+    // (The API promises to succeed if no user callbacks fail, so no need
+    // to check the return value.)
+    zimg_filter_graph_process(st->graph, &zsrc_c, &zdst,
+                              st->tmp,
+                              repack_entrypoint, st->src,
+                              repack_entrypoint, st->dst);
+
+    st->src->user_mpi = NULL;
+    st->dst->user_mpi = NULL;
+}
+
+static void do_convert_thread(void *ptr)
+{
+    struct mp_zimg_state *st = ptr;
+
+    do_convert(st);
+    mp_waiter_wakeup(&st->thread_waiter, 0);
+}
+
 bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
                      struct mp_image *src)
 {
@@ -1377,29 +1519,28 @@ bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
         return false;
     }
 
-    assert(ctx->zimg_graph);
-
-    zimg_image_buffer zsrc, zdst;
-    wrap_buffer(ctx->zimg_src, &zsrc, src);
-    wrap_buffer(ctx->zimg_dst, &zdst, dst);
+    for (int n = 0; n < ctx->num_states; n++) {
+        struct mp_zimg_state *st = ctx->states[n];
+        st->cur_src = src;
+        st->cur_dst = dst;
+    }
 
-    // An annoyance.
-    zimg_image_buffer_const zsrc_c = {ZIMG_API_VERSION};
-    for (int n = 0; n < MP_ARRAY_SIZE(zsrc_c.plane); n++) {
-        zsrc_c.plane[n].data = zsrc.plane[n].data;
-        zsrc_c.plane[n].stride = zsrc.plane[n].stride;
-        zsrc_c.plane[n].mask = zsrc.plane[n].mask;
+    // Run the first slice on the calling thread, the rest on the pool.
+    for (int n = 1; n < ctx->num_states; n++) {
+        struct mp_zimg_state *st = ctx->states[n];
+        st->thread_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+        mp_thread_pool_queue(ctx->tp, do_convert_thread, st);
     }
 
-    // (The API promises to succeed if no user callbacks fail, so no need
-    // to check the return value.)
-    zimg_filter_graph_process(ctx->zimg_graph, &zsrc_c, &zdst,
-                              ctx->zimg_tmp,
-                              repack_entrypoint, ctx->zimg_src,
-                              repack_entrypoint, ctx->zimg_dst);
+    do_convert(ctx->states[0]);
 
-    ctx->zimg_src->user_mpi = NULL;
-    ctx->zimg_dst->user_mpi = NULL;
+    for (int n = 1; n < ctx->num_states; n++)
+        mp_waiter_wait(&ctx->states[n]->thread_waiter);
+
+    for (int n = 0; n < ctx->num_states; n++) {
+        struct mp_zimg_state *st = ctx->states[n];
+        st->cur_src = st->cur_dst = NULL;
+    }
 
     return true;
 }
@@ -1409,7 +1550,7 @@ static bool supports_format(int imgfmt, bool out)
     struct mp_image_params fmt = {.imgfmt = imgfmt};
     struct mp_zimg_repack t;
     zimg_image_format zfmt;
-    return setup_format(&zfmt, &t, out, &fmt, NULL);
+    return setup_format(&zfmt, &t, out, &fmt, NULL, NULL);
 }
 
 bool mp_zimg_supports_in_format(int imgfmt)
@@ -20,8 +20,11 @@ struct zimg_opts {
     double scaler_chroma_params[2];
     int dither;
     int fast;
+    int threads;
 };
 
+struct mp_zimg_state;
+
 struct mp_zimg_context {
     // Can be set for verbose error printing.
     struct mp_log *log;
@@ -36,13 +39,17 @@ struct mp_zimg_context {
     // automatically.
     struct mp_image_params src, dst;
 
+    // Use only the portable C repackers (for testing). Like the fields above,
+    // changing this requires calling mp_zimg_config().
+    bool no_simd;
+
     // Cached zimg state (if any). Private, do not touch.
     struct m_config_cache *opts_cache;
-    zimg_filter_graph *zimg_graph;
-    void *zimg_tmp;
-    void *zimg_tmp_alloc;
-    struct mp_zimg_repack *zimg_src;
-    struct mp_zimg_repack *zimg_dst;
+    struct mp_zimg_state **states;
+    int num_states;
+    struct mp_image_params cfg_src, cfg_dst; // parameters of states
+    struct mp_thread_pool *tp;
+    int current_thread_count;
 };
 
 // Allocate a zimg context. Always succeeds. Returns a talloc pointer (use
@@ -0,0 +1,578 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "zimg_simd.h"
+
+// Vectorized versions of some of the repackers in zimg.c. They must produce
+// exactly the same output as the C versions (test/scale_zimg.c checks this).
+// Everything uses unaligned loads/stores, and the remaining pixels at the end
+// of a line are handled with plain C.
+// The x86 code is compiled with function specific target attributes, so it
+// does not require special compiler flags, and is selected at runtime.
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HAVE_SIMD_X86 0
+#endif
+
+// (The packed formats are accessed as words in zimg.c; little endian only.)
+#if (defined(__ARM_NEON) || defined(__aarch64__)) && !defined(__ARM_BIG_ENDIAN)
+#define HAVE_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define HAVE_SIMD_NEON 0
+#endif
+
+#define INLINE inline __attribute__((always_inline))
+
+// Remainders. first/num select the used bytes within a 4 byte pixel.
+static INLINE void un_4x8_c(uint8_t *s, void *dst[], int x0, int x1,
+                            int first, int num)
+{
+    for (int x = x0; x < x1; x++) {
+        for (int n = 0; n < num; n++)
+            ((uint8_t *)dst[n])[x] = s[x * 4 + first + n];
+    }
+}
+
+static INLINE void pa_4x8_c(uint8_t *d, void *src[], int x0, int x1,
+                            int first, int num)
+{
+    for (int x = x0; x < x1; x++) {
+        uint8_t px[4] = {0};
+        for (int n = 0; n < num; n++)
+            px[first + n] = ((uint8_t *)src[n])[x];
+        memcpy(d + x * 4, px, 4);
+    }
+}
+
+static INLINE void un_2x8_c(uint8_t *s, void *dst[], int x0, int x1)
+{
+    for (int x = x0; x < x1; x++) {
+        ((uint8_t *)dst[0])[x] = s[x * 2 + 0];
+        ((uint8_t *)dst[1])[x] = s[x * 2 + 1];
+    }
+}
+
+static INLINE void pa_2x8_c(uint8_t *d, void *src[], int x0, int x1)
+{
+    for (int x = x0; x < x1; x++) {
+        d[x * 2 + 0] = ((uint8_t *)src[0])[x];
+        d[x * 2 + 1] = ((uint8_t *)src[1])[x];
+    }
+}
+
+static INLINE void un_2x16_c(uint16_t *s, void *dst[], int x0, int x1)
+{
+    for (int x = x0; x < x1; x++) {
+        ((uint16_t *)dst[0])[x] = s[x * 2 + 0];
+        ((uint16_t *)dst[1])[x] = s[x * 2 + 1];
+    }
+}
+
+static INLINE void pa_2x16_c(uint16_t *d, void *src[], int x0, int x1)
+{
+    for (int x = x0; x < x1; x++) {
+        d[x * 2 + 0] = ((uint16_t *)src[0])[x];
+        d[x * 2 + 1] = ((uint16_t *)src[1])[x];
+    }
+}
+
+static INLINE void bswap16_c(uint16_t *d, uint16_t *s, int x0, int x1)
+{
+    for (int x = x0; x < x1; x++)
+        d[x] = av_bswap16(s[x]);
+}
+
+static INLINE void bswap32_c(uint32_t *d, uint32_t *s, int x0, int x1)
+{
+    for (int x = x0; x < x1; x++)
+        d[x] = av_bswap32(s[x]);
+}
+
+#if HAVE_SIMD_X86
+
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+TARGET_SSE4 static INLINE void un_4x8_sse4(void *src, void *dst[], int x0,
+                                           int x1, int first, int num)
+{
+    uint8_t *s = src;
+    const __m128i shuf = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                       2, 6, 10, 14, 3, 7, 11, 15);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        // Each vector: component 0 of 4 pixels, component 1, ...
+        __m128i a = _mm_shuffle_epi8(LOAD(s + x * 4 + 0), shuf);
+        __m128i b = _mm_shuffle_epi8(LOAD(s + x * 4 + 16), shuf);
+        __m128i c = _mm_shuffle_epi8(LOAD(s + x * 4 + 32), shuf);
+        __m128i d = _mm_shuffle_epi8(LOAD(s + x * 4 + 48), shuf);
+        __m128i ab_lo = _mm_unpacklo_epi32(a, b);
+        __m128i ab_hi = _mm_unpackhi_epi32(a, b);
+        __m128i cd_lo = _mm_unpacklo_epi32(c, d);
+        __m128i cd_hi = _mm_unpackhi_epi32(c, d);
+        __m128i r[4] = {
+            _mm_unpacklo_epi64(ab_lo, cd_lo),
+            _mm_unpackhi_epi64(ab_lo, cd_lo),
+            _mm_unpacklo_epi64(ab_hi, cd_hi),
+            _mm_unpackhi_epi64(ab_hi, cd_hi),
+        };
+        for (int n = 0; n < num; n++)
+            STORE((uint8_t *)dst[n] + x, r[first + n]);
+    }
+    un_4x8_c(s, dst, x, x1, first, num);
+}
+
+TARGET_SSE4 static INLINE void pa_4x8_sse4(void *dst, void *src[], int x0,
+                                           int x1, int first, int num)
+{
+    uint8_t *d = dst;
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i c[4] = {0};
+        for (int n = 0; n < num; n++)
+            c[first + n] = LOAD((uint8_t *)src[n] + x);
+        __m128i lo01 = _mm_unpacklo_epi8(c[0], c[1]);
+        __m128i hi01 = _mm_unpackhi_epi8(c[0], c[1]);
+        __m128i lo23 = _mm_unpacklo_epi8(c[2], c[3]);
+        __m128i hi23 = _mm_unpackhi_epi8(c[2], c[3]);
+        STORE(d + x * 4 + 0,  _mm_unpacklo_epi16(lo01, lo23));
+        STORE(d + x * 4 + 16, _mm_unpackhi_epi16(lo01, lo23));
+        STORE(d + x * 4 + 32, _mm_unpacklo_epi16(hi01, hi23));
+        STORE(d + x * 4 + 48, _mm_unpackhi_epi16(hi01, hi23));
+    }
+    pa_4x8_c(d, src, x, x1, first, num);
+}
+
+TARGET_SSE4 static void un_cc8_sse4(void *src, void *dst[], int x0, int x1)
+{
+    uint8_t *s = src;
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i a = LOAD(s + x * 2 + 0);
+        __m128i b = LOAD(s + x * 2 + 16);
+        STORE((uint8_t *)dst[0] + x,
+              _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        STORE((uint8_t *)dst[1] + x,
+              _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    un_2x8_c(s, dst, x, x1);
+}
+
+TARGET_SSE4 static void pa_cc8_sse4(void *dst, void *src[], int x0, int x1)
+{
+    uint8_t *d = dst;
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m128i c0 = LOAD((uint8_t *)src[0] + x);
+        __m128i c1 = LOAD((uint8_t *)src[1] + x);
+        STORE(d + x * 2 + 0,  _mm_unpacklo_epi8(c0, c1));
+        STORE(d + x * 2 + 16, _mm_unpackhi_epi8(c0, c1));
+    }
+    pa_2x8_c(d, src, x, x1);
+}
+
+TARGET_SSE4 static void un_cc16_sse4(void *src, void *dst[], int x0, int x1)
+{
+    uint16_t *s = src;
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m128i a = LOAD(s + x * 2 + 0);
+        __m128i b = LOAD(s + x * 2 + 8);
+        STORE((uint16_t *)dst[0] + x,
+              _mm_packus_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        STORE((uint16_t *)dst[1] + x,
+              _mm_packus_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)));
+    }
+    un_2x16_c(s, dst, x, x1);
+}
+
+TARGET_SSE4 static void pa_cc16_sse4(void *dst, void *src[], int x0, int x1)
+{
+    uint16_t *d = dst;
+    int x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m128i c0 = LOAD((uint16_t *)src[0] + x);
+        __m128i c1 = LOAD((uint16_t *)src[1] + x);
+        STORE(d + x * 2 + 0, _mm_unpacklo_epi16(c0, c1));
+        STORE(d + x * 2 + 8, _mm_unpackhi_epi16(c0, c1));
+    }
+    pa_2x16_c(d, src, x, x1);
+}
+
+TARGET_SSE4 static void bswap16_sse4(void *dst, void *src, int num)
+{
+    const __m128i shuf = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                       9, 8, 11, 10, 13, 12, 15, 14);
+    uint16_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 8 <= num; x += 8)
+        STORE(d + x, _mm_shuffle_epi8(LOAD(s + x), shuf));
+    bswap16_c(d, s, x, num);
+}
+
+TARGET_SSE4 static void bswap32_sse4(void *dst, void *src, int num)
+{
+    const __m128i shuf = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                       11, 10, 9, 8, 15, 14, 13, 12);
+    uint32_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 4 <= num; x += 4)
+        STORE(d + x, _mm_shuffle_epi8(LOAD(s + x), shuf));
+    bswap32_c(d, s, x, num);
+}
+
+// AVX2 shuffles/unpacks work within 128 bit lanes, so the results need to be
+// permuted to get the pixel order right.
+
+TARGET_AVX2 static INLINE void un_4x8_avx2(void *src, void *dst[], int x0,
+                                           int x1, int first, int num)
+{
+    uint8_t *s = src;
+    const __m256i shuf = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                          2, 6, 10, 14, 3, 7, 11, 15,
+                                          0, 4, 8, 12, 1, 5, 9, 13,
+                                          2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        __m256i a = _mm256_shuffle_epi8(LOAD256(s + x * 4 + 0), shuf);
+        __m256i b = _mm256_shuffle_epi8(LOAD256(s + x * 4 + 32), shuf);
+        __m256i c = _mm256_shuffle_epi8(LOAD256(s + x * 4 + 64), shuf);
+        __m256i d = _mm256_shuffle_epi8(LOAD256(s + x * 4 + 96), shuf);
+        __m256i ab_lo = _mm256_unpacklo_epi32(a, b);
+        __m256i ab_hi = _mm256_unpackhi_epi32(a, b);
+        __m256i cd_lo = _mm256_unpacklo_epi32(c, d);
+        __m256i cd_hi = _mm256_unpackhi_epi32(c, d);
+        __m256i r[4] = {
+            _mm256_unpacklo_epi64(ab_lo, cd_lo),
+            _mm256_unpackhi_epi64(ab_lo, cd_lo),
+            _mm256_unpacklo_epi64(ab_hi, cd_hi),
+            _mm256_unpackhi_epi64(ab_hi, cd_hi),
+        };
+        for (int n = 0; n < num; n++) {
+            STORE256((uint8_t *)dst[n] + x,
+                     _mm256_permutevar8x32_epi32(r[first + n], perm));
+        }
+    }
+    un_4x8_c(s, dst, x, x1, first, num);
+}
+
+TARGET_AVX2 static INLINE void pa_4x8_avx2(void *dst, void *src[], int x0,
+                                           int x1, int first, int num)
+{
+    uint8_t *d = dst;
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        __m256i c[4] = {0};
+        for (int n = 0; n < num; n++)
+            c[first + n] = LOAD256((uint8_t *)src[n] + x);
+        __m256i lo01 = _mm256_unpacklo_epi8(c[0], c[1]);
+        __m256i hi01 = _mm256_unpackhi_epi8(c[0], c[1]);
+        __m256i lo23 = _mm256_unpacklo_epi8(c[2], c[3]);
+        __m256i hi23 = _mm256_unpackhi_epi8(c[2], c[3]);
+        // Pixels 0-3|16-19, 4-7|20-23, 8-11|24-27, 12-15|28-31.
+        __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23);
+        __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23);
+        __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23);
+        __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23);
+        STORE256(d + x * 4 + 0,  _mm256_permute2x128_si256(q0, q1, 0x20));
+        STORE256(d + x * 4 + 32, _mm256_permute2x128_si256(q2, q3, 0x20));
+        STORE256(d + x * 4 + 64, _mm256_permute2x128_si256(q0, q1, 0x31));
+        STORE256(d + x * 4 + 96, _mm256_permute2x128_si256(q2, q3, 0x31));
+    }
+    pa_4x8_c(d, src, x, x1, first, num);
+}
+
+TARGET_AVX2 static void un_cc8_avx2(void *src, void *dst[], int x0, int x1)
+{
+    uint8_t *s = src;
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        __m256i a = LOAD256(s + x * 2 + 0);
+        __m256i b = LOAD256(s + x * 2 + 32);
+        __m256i c0 = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                         _mm256_srli_epi16(b, 8));
+        STORE256((uint8_t *)dst[0] + x, _mm256_permute4x64_epi64(c0, 0xD8));
+        STORE256((uint8_t *)dst[1] + x, _mm256_permute4x64_epi64(c1, 0xD8));
+    }
+    un_2x8_c(s, dst, x, x1);
+}
+
+TARGET_AVX2 static void pa_cc8_avx2(void *dst, void *src[], int x0, int x1)
+{
+    uint8_t *d = dst;
+    int x = x0;
+    for (; x + 32 <= x1; x += 32) {
+        __m256i c0 = LOAD256((uint8_t *)src[0] + x);
+        __m256i c1 = LOAD256((uint8_t *)src[1] + x);
+        __m256i lo = _mm256_unpacklo_epi8(c0, c1);
+        __m256i hi = _mm256_unpackhi_epi8(c0, c1);
+        STORE256(d + x * 2 + 0,  _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(d + x * 2 + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    pa_2x8_c(d, src, x, x1);
+}
+
+TARGET_AVX2 static void un_cc16_avx2(void *src, void *dst[], int x0, int x1)
+{
+    uint16_t *s = src;
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i a = LOAD256(s + x * 2 + 0);
+        __m256i b = LOAD256(s + x * 2 + 16);
+        __m256i c0 = _mm256_packus_epi32(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi32(_mm256_srli_epi32(a, 16),
+                                         _mm256_srli_epi32(b, 16));
+        STORE256((uint16_t *)dst[0] + x, _mm256_permute4x64_epi64(c0, 0xD8));
+        STORE256((uint16_t *)dst[1] + x, _mm256_permute4x64_epi64(c1, 0xD8));
+    }
+    un_2x16_c(s, dst, x, x1);
+}
+
+TARGET_AVX2 static void pa_cc16_avx2(void *dst, void *src[], int x0, int x1)
+{
+    uint16_t *d = dst;
+    int x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m256i c0 = LOAD256((uint16_t *)src[0] + x);
+        __m256i c1 = LOAD256((uint16_t *)src[1] + x);
+        __m256i lo = _mm256_unpacklo_epi16(c0, c1);
+        __m256i hi = _mm256_unpackhi_epi16(c0, c1);
+        STORE256(d + x * 2 + 0,  _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(d + x * 2 + 16, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    pa_2x16_c(d, src, x, x1);
+}
+
+TARGET_AVX2 static void bswap16_avx2(void *dst, void *src, int num)
+{
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14);
+    uint16_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 16 <= num; x += 16)
+        STORE256(d + x, _mm256_shuffle_epi8(LOAD256(s + x), shuf));
+    bswap16_c(d, s, x, num);
+}
+
+TARGET_AVX2 static void bswap32_avx2(void *dst, void *src, int num)
+{
+    const __m256i shuf = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12);
+    uint32_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 8 <= num; x += 8)
+        STORE256(d + x, _mm256_shuffle_epi8(LOAD256(s + x), shuf));
+    bswap32_c(d, s, x, num);
+}
+
+#define DEF_4X8(isa, target, name, first, num)                              \
+    target static void pa_##name##_##isa(void *d, void *s[], int x0, int x1) \
+        { pa_4x8_##isa(d, s, x0, x1, first, num); }                         \
+    target static void un_##name##_##isa(void *s, void *d[], int x0, int x1) \
+        { un_4x8_##isa(s, d, x0, x1, first, num); }
+
+DEF_4X8(sse4, TARGET_SSE4, cccc8,  0, 4)
+DEF_4X8(sse4, TARGET_SSE4, ccc8x8, 0, 3)
+DEF_4X8(sse4, TARGET_SSE4, x8ccc8, 1, 3)
+DEF_4X8(avx2, TARGET_AVX2, cccc8,  0, 4)
+DEF_4X8(avx2, TARGET_AVX2, ccc8x8, 0, 3)
+DEF_4X8(avx2, TARGET_AVX2, x8ccc8, 1, 3)
+
+#endif /* HAVE_SIMD_X86 */
+
+#if HAVE_SIMD_NEON
+
+// NEON has interleaving loads/stores, which map directly to packed formats.
+// n is the number of components in a packed pixel, first/num select the used
+// ones (the others are padding).
+#define DEF_NEON(name, comp_t, n, first, num, vec_t, ldn, stn, ld1, st1, dup) \
+    static void un_##name##_neon(void *src, void *dst[], int x0, int x1) {  \
+        comp_t *s = src;                                                    \
+        int step = 16 / sizeof(comp_t);                                     \
+        int x = x0;                                                         \
+        for (; x + step <= x1; x += step) {                                 \
+            vec_t v = ldn(s + x * (n));                                     \
+            for (int c = 0; c < (num); c++)                                 \
+                st1((comp_t *)dst[c] + x, v.val[(first) + c]);              \
+        }                                                                   \
+        for (; x < x1; x++) {                                               \
+            for (int c = 0; c < (num); c++)                                 \
+                ((comp_t *)dst[c])[x] = s[x * (n) + (first) + c];           \
+        }                                                                   \
+    }                                                                       \
+    static void pa_##name##_neon(void *dst, void *src[], int x0, int x1) {  \
+        comp_t *d = dst;                                                    \
+        int step = 16 / sizeof(comp_t);                                     \
+        int x = x0;                                                         \
+        for (; x + step <= x1; x += step) {                                 \
+            vec_t v;                                                        \
+            for (int c = 0; c < (n); c++)                                   \
+                v.val[c] = dup(0);                                          \
+            for (int c = 0; c < (num); c++)                                 \
+                v.val[(first) + c] = ld1((comp_t *)src[c] + x);             \
+            stn(d + x * (n), v);                                            \
+        }                                                                   \
+        for (; x < x1; x++) {                                               \
+            for (int c = 0; c < (n); c++)                                   \
+                d[x * (n) + c] = 0;                                         \
+            for (int c = 0; c < (num); c++)                                 \
+                d[x * (n) + (first) + c] = ((comp_t *)src[c])[x];           \
+        }                                                                   \
+    }
+
+#define DEF_NEON_U8(name, n, first, num)                                    \
+    DEF_NEON(name, uint8_t, n, first, num, uint8x16x##n##_t,                \
+             vld##n##q_u8, vst##n##q_u8, vld1q_u8, vst1q_u8, vdupq_n_u8)
+#define DEF_NEON_U16(name, n, first, num)                                   \
+    DEF_NEON(name, uint16_t, n, first, num, uint16x8x##n##_t,               \
+             vld##n##q_u16, vst##n##q_u16, vld1q_u16, vst1q_u16, vdupq_n_u16)
+
+DEF_NEON_U8(cccc8,   4, 0, 4)
+DEF_NEON_U8(ccc8x8,  4, 0, 3)
+DEF_NEON_U8(x8ccc8,  4, 1, 3)
+DEF_NEON_U8(ccc8,    3, 0, 3)
+DEF_NEON_U8(cc8,     2, 0, 2)
+DEF_NEON_U16(cccc16, 4, 0, 4)
+DEF_NEON_U16(ccc16,  3, 0, 3)
+DEF_NEON_U16(cc16,   2, 0, 2)
+
+static void bswap16_neon(void *dst, void *src, int num)
+{
+    uint16_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 8 <= num; x += 8) {
+        uint8x16_t v = vld1q_u8((uint8_t *)(s + x));
+        vst1q_u8((uint8_t *)(d + x), vrev16q_u8(v));
+    }
+    bswap16_c(d, s, x, num);
+}
+
+static void bswap32_neon(void *dst, void *src, int num)
+{
+    uint32_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 4 <= num; x += 4) {
+        uint8x16_t v = vld1q_u8((uint8_t *)(s + x));
+        vst1q_u8((uint8_t *)(d + x), vrev32q_u8(v));
+    }
+    bswap32_c(d, s, x, num);
+}
+
+#endif /* HAVE_SIMD_NEON */
+
+struct simd_repacker {
+    int cpu_flag;           // AV_CPU_FLAG_* required
+    int packed_width;       // see struct regular_repacker
+    int component_width;
+    int prepadding;
+    int num_components;
+    mp_zimg_scanline_fn pa_scanline;
+    mp_zimg_scanline_fn un_scanline;
+};
+
+#define X86_ENTRIES(isa, flag)                                              \
+    {flag, 32, 8,  0, 3, pa_ccc8x8_##isa, un_ccc8x8_##isa},                 \
+    {flag, 32, 8,  8, 3, pa_x8ccc8_##isa, un_x8ccc8_##isa},                 \
+    {flag, 32, 8,  0, 4, pa_cccc8_##isa,  un_cccc8_##isa},                  \
+    {flag, 16, 8,  0, 2, pa_cc8_##isa,    un_cc8_##isa},                    \
+    {flag, 32, 16, 0, 2, pa_cc16_##isa,   un_cc16_##isa}
+
+// Preferred implementations first.
+static const struct simd_repacker simd_repackers[] = {
+#if HAVE_SIMD_X86
+    X86_ENTRIES(avx2, AV_CPU_FLAG_AVX2),
+    X86_ENTRIES(sse4, AV_CPU_FLAG_SSE4),
+#endif
+#if HAVE_SIMD_NEON
+    {AV_CPU_FLAG_NEON, 32, 8,  0, 3, pa_ccc8x8_neon, un_ccc8x8_neon},
+    {AV_CPU_FLAG_NEON, 32, 8,  8, 3, pa_x8ccc8_neon, un_x8ccc8_neon},
+    {AV_CPU_FLAG_NEON, 32, 8,  0, 4, pa_cccc8_neon,  un_cccc8_neon},
+    {AV_CPU_FLAG_NEON, 64, 16, 0, 4, pa_cccc16_neon, un_cccc16_neon},
+    {AV_CPU_FLAG_NEON, 24, 8,  0, 3, pa_ccc8_neon,   un_ccc8_neon},
+    {AV_CPU_FLAG_NEON, 48, 16, 0, 3, pa_ccc16_neon,  un_ccc16_neon},
+    {AV_CPU_FLAG_NEON, 16, 8,  0, 2, pa_cc8_neon,    un_cc8_neon},
+    {AV_CPU_FLAG_NEON, 32, 16, 0, 2, pa_cc16_neon,   un_cc16_neon},
+#endif
+    {0}
+};
+
+mp_zimg_scanline_fn mp_zimg_simd_scanline(bool pack, int packed_width,
+                                          int component_width, int prepadding,
+                                          int num_components)
+{
+    int flags = av_get_cpu_flags();
+
+    for (int n = 0; simd_repackers[n].cpu_flag; n++) {
+        const struct simd_repacker *e = &simd_repackers[n];
+        if ((flags & e->cpu_flag) &&
+            e->packed_width == packed_width &&
+            e->component_width == component_width &&
+            e->prepadding == prepadding &&
+            e->num_components == num_components)
+            return pack ? e->pa_scanline : e->un_scanline;
+    }
+
+    return NULL;
+}
+
+mp_zimg_bswap_fn mp_zimg_simd_bswap(int size)
+{
+    int flags = av_get_cpu_flags();
+
+#if HAVE_SIMD_X86
+    if (flags & AV_CPU_FLAG_AVX2)
+        return size == 2 ? bswap16_avx2 : bswap32_avx2;
+    if (flags & AV_CPU_FLAG_SSE4)
+        return size == 2 ? bswap16_sse4 : bswap32_sse4;
+#endif
+#if HAVE_SIMD_NEON
+    if (flags & AV_CPU_FLAG_NEON)
+        return size == 2 ? bswap16_neon : bswap32_neon;
+#endif
+
+    (void)flags;
+    return NULL;
+}
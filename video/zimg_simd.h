@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+
+// See regular_repacker in zimg.c.
+//  pack:   p1 is dst, p2 is src
+//  unpack: p1 is src, p2 is dst
+typedef void (*mp_zimg_scanline_fn)(void *p1, void *p2[], int x0, int x1);
+
+// Byte-swap num words of the given size from src to dst (src==dst allowed).
+typedef void (*mp_zimg_bswap_fn)(void *dst, void *src, int num);
+
+// Return an optimized version of the regular repacker with the given
+// parameters (same meaning as the fields of struct regular_repacker), or NULL
+// if there is none for this format or CPU.
+mp_zimg_scanline_fn mp_zimg_simd_scanline(bool pack, int packed_width,
+                                          int component_width, int prepadding,
+                                          int num_components);
+
+// Return an optimized byte swapping function for word size 2 or 4, or NULL.
+mp_zimg_bswap_fn mp_zimg_simd_bswap(int size);
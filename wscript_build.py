@@ -296,6 +296,7 @@ def build(ctx):
         ( "demux/demux_timeline.c" ),
         ( "demux/ebml.c" ),
         ( "demux/packet.c" ),
+        ( "demux/seek_index.c" ),
         ( "demux/timeline.c" ),
 
         ( "filters/f_async_queue.c" ),
@@ -328,6 +329,8 @@ def build(ctx):
         ( "misc/dispatch.c" ),
         ( "misc/jni.c",                          "android" ),
         ( "misc/json.c" ),
+        ( "misc/msgpack.c" ),
+        ( "misc/name_index.c" ),
         ( "misc/natural_sort.c" ),
         ( "misc/node.c" ),
         ( "misc/rendezvous.c" ),
@@ -386,6 +389,7 @@ def build(ctx):
         ( "sub/ass_mp.c" ),
         ( "sub/dec_sub.c" ),
         ( "sub/draw_bmp.c" ),
+        ( "sub/draw_bmp_simd.c" ),
         ( "sub/filter_regex.c",                  "posix" ),
         ( "sub/filter_sdh.c" ),
         ( "sub/img_convert.c" ),
@@ -397,14 +401,20 @@ def build(ctx):
 
         ## Tests
         ( "test/chmap.c",                        "tests" ),
+        ( "test/draw_bmp.c",                     "tests" ),
         ( "test/gl_video.c",                     "tests" ),
+        ( "test/image_copy.c",                   "tests" ),
         ( "test/img_format.c",                   "tests" ),
+        ( "test/ipc.c",                          "tests && posix" ),
         ( "test/json.c",                         "tests" ),
         ( "test/linked_list.c",                  "tests" ),
+        ( "test/msgpack.c",                      "tests" ),
         ( "test/paths.c",                        "tests" ),
+        ( "test/property_lookup.c",              "tests" ),
         ( "test/scale_sws.c",                    "tests" ),
         ( "test/scale_test.c",                   "tests" ),
         ( "test/scale_zimg.c",                   "tests && zimg" ),
+        ( "test/seek_index.c",                   "tests" ),
         ( "test/tests.c",                        "tests" ),
 
         ## Video
@@ -426,6 +436,7 @@ def build(ctx):
         ( "video/image_loader.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
+        ( "video/memcpy_simd.c" ),
         ( "video/mp_image.c" ),
         ( "video/mp_image_pool.c" ),
         ( "video/out/android_common.c",          "android" ),
@@ -466,6 +477,7 @@ def build(ctx):
         ( "video/out/hwdec/hwdec_vaapi.c",       "vaapi-egl || vaapi-vulkan" ),
         ( "video/out/hwdec/hwdec_vaapi_gl.c",    "vaapi-egl" ),
         ( "video/out/hwdec/hwdec_vaapi_vk.c",    "vaapi-vulkan" ),
+        ( "video/out/libmpv_sw.c" ),
         ( "video/out/placebo/ra_pl.c",           "libplacebo" ),
         ( "video/out/placebo/utils.c",           "libplacebo" ),
         ( "video/out/opengl/angle_dynamic.c",    "egl-angle" ),
@@ -531,6 +543,7 @@ def build(ctx):
         ( "video/out/x11_common.c",              "x11" ),
         ( "video/sws_utils.c" ),
         ( "video/zimg.c",                        "zimg" ),
+        ( "video/zimg_simd.c",                   "zimg" ),
         ( "video/vaapi.c",                       "vaapi" ),
         ( "video/vdpau.c",                       "vdpau" ),
         ( "video/vdpau_mixer.c",                 "vdpau" ),